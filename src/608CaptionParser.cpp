@@ -97,6 +97,8 @@ C608CaptionParser::C608CaptionParser()
 , _channelOne(true)
 {
 	memset(_ccLastCmd, 0, sizeof(_ccLastCmd));
+	memset(&_timecode, 0, sizeof(_timecode));
+	memset(&_currentTimecode, 0, sizeof(_currentTimecode));
 
 	BYTE tmpMatrix[128] = { 
 		0x80, 0x01, 0x02, 0x83, 0x04, 0x85, 0x86, 0x07, 0x08, 0x89, 0x8a, 0x0b, 0x8c, 0x0d, 0x0e, 0x8f,
@@ -156,6 +158,12 @@ int C608CaptionParser::GetRow(BYTE *pBuffer)
 	return -1;
 }
 
+// Time code of the frame carrying the next byte pair
+void C608CaptionParser::SetTimecode(const _smpte_timecode& timecode)
+{
+	_timecode = timecode;
+}
+
 HRESULT C608CaptionParser::BufferCB(double SampleTime, BYTE *pBuffer2, long BufferLen)
 {
 	if (BufferLen == 2)
@@ -168,7 +176,10 @@ HRESULT C608CaptionParser::BufferCB(double SampleTime, BYTE *pBuffer2, long Buff
 			return S_OK;
   
 		if (_currentTime == 0.0)
+		{
 			_currentTime = SampleTime;
+			_currentTimecode = _timecode;
+		}
   
 		// Convert CC from 7-bit
 		pBuffer[0] = _ccTxMatrix[ pBuffer[0] ];
@@ -261,7 +272,12 @@ void C608CaptionParser::RenderBuffer(double SampleTime)
 
 	// Send the line to the closed captioning handler.
 	DWORD timeStamp = (DWORD)(_currentTime * 1000);
-	ATLTRACE("%s\n", _currentBuffer.c_str());
+
+	if (_currentTimecode.valid)
+		ATLTRACE("[%02i:%02i:%02i%c%02i] %s\n", _currentTimecode.hours, _currentTimecode.minutes, _currentTimecode.seconds, 
+			_currentTimecode.drop_frame ? ';' : ':', _currentTimecode.frames, _currentBuffer.c_str());
+	else
+		ATLTRACE("%s\n", _currentBuffer.c_str());
 
 	#pragma region CC_DEBUG_INFO
 
@@ -274,5 +290,6 @@ void C608CaptionParser::RenderBuffer(double SampleTime)
 	
 	_currentBuffer.clear();
 	_currentTime = SampleTime;
+	_currentTimecode = _timecode;
 }
 
@@ -7,6 +7,7 @@
 
 #include "stdafx.h"
 #include <string>
+#include "Timecode.h"
 #pragma once
 
 using namespace std;
@@ -18,6 +19,7 @@ class C608CaptionParser
 		~C608CaptionParser();
 		
 		HRESULT BufferCB(double SampleTime, BYTE *pBuffer2, long BufferLen);
+		void SetTimecode(const _smpte_timecode& timecode);
 
 	private:
 		int GetRow(BYTE *pBuffer);
@@ -26,6 +28,8 @@ class C608CaptionParser
 	private:
 		BYTE _ccTxMatrix[256];
 		double _currentTime;
+		_smpte_timecode _timecode;
+		_smpte_timecode _currentTimecode;
 		std::string _currentBuffer;
 		bool _channelOne;
 		BYTE _ccRowTable[45]; 
@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "CDPContinuity.h"
+
+// Smallest CDP: 7 byte header followed by the 4 byte footer
+#define CDP_MIN_LENGTH 11
+
+CDPContinuity::CDPContinuity(void)
+{
+	Reset();
+}
+
+CDPContinuity::~CDPContinuity(void)
+{
+}
+
+void CDPContinuity::Reset()
+{
+	m_bHaveLast = false;
+	m_nLastCounter = 0;
+	m_nLastChecksum = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+// Classify a CDP against the previous one. The header counter lives in UDW 6-7
+// and the footer counter in the two words after the 0x74 footer id.
+cdp_continuity CDPContinuity::Check(const _anc_packet_entry& packet)
+{
+	if (packet.dc < CDP_MIN_LENGTH)
+		return CDP_INVALID;
+
+	const __int16* udw = packet.words + ANC_WORD_UDW;
+	unsigned short headerCounter = (unsigned short)(((udw[5] & 0xff) << 8) | (udw[6] & 0xff));
+	unsigned short footerCounter = (unsigned short)(((udw[packet.dc - 3] & 0xff) << 8) | (udw[packet.dc - 2] & 0xff));
+	unsigned char checksum = (unsigned char)(udw[packet.dc - 1] & 0xff);
+
+	m_stats.nPackets++;
+
+	if (headerCounter != footerCounter)
+		m_stats.nMismatches++;
+
+	cdp_continuity result = CDP_CONTINUOUS;
+
+	if (!m_bHaveLast)
+		result = CDP_FIRST;
+	else if (headerCounter == m_nLastCounter && checksum == m_nLastChecksum)
+		result = CDP_REPEAT;
+	else if (headerCounter != (unsigned short)(m_nLastCounter + 1))
+		result = CDP_GAP;
+
+	if (result == CDP_REPEAT)
+	{
+		m_stats.nRepeats++;
+		return result;
+	}
+
+	if (result == CDP_GAP)
+		m_stats.nGaps++;
+
+	m_bHaveLast = true;
+	m_nLastCounter = headerCounter;
+	m_nLastChecksum = checksum;
+	return result;
+}
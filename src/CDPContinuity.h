@@ -0,0 +1,40 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "VANCIndex.h"
+
+enum cdp_continuity { CDP_FIRST = 0, CDP_CONTINUOUS = 1, CDP_GAP = 2, CDP_REPEAT = 3, CDP_INVALID = 4 };
+
+struct _cdp_continuity_stats
+{
+	LONG nPackets;			// CDPs checked
+	LONG nGaps;				// sequence counter jumps
+	LONG nRepeats;			// exact duplicates (dropped)
+	LONG nMismatches;		// header and footer counters disagree
+};
+
+// Tracks the cdp_hdr_sequence_cntr of consecutive CDPs so that repeated frames
+// can be dropped before any caption decoding is done.
+class CDPContinuity
+{
+	public:
+		CDPContinuity(void);
+		~CDPContinuity(void);
+
+	public:
+		void Reset();
+		cdp_continuity Check(const _anc_packet_entry& packet);
+		void GetStats(_cdp_continuity_stats* pStats) const { *pStats = m_stats; }
+
+	private:
+		bool m_bHaveLast;
+		unsigned short m_nLastCounter;
+		unsigned char m_nLastChecksum;
+		_cdp_continuity_stats m_stats;
+};
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "CaptionRing.h"
+
+#define CAPTION_RING_MASK (CAPTION_RING_SIZE - 1)
+
+inline bool IsNullPair(const VANC_CAPTION_RECORD& record)
+{
+	return (record.pair[0] == 0x80 && record.pair[1] == 0x80);
+}
+
+CCaptionRing::CCaptionRing(void)
+{
+	Reset();
+}
+
+CCaptionRing::~CCaptionRing(void)
+{
+}
+
+void CCaptionRing::Reset()
+{
+	m_nHead = 0;
+	m_nTail = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+// Queue a byte pair, applying the overflow policy when the ring is full
+void CCaptionRing::Push(const VANC_CAPTION_RECORD& record, caption_overflow_policy policy)
+{
+	if (GetCount() == CAPTION_RING_SIZE)
+	{
+		if (policy == CAPTION_DROP_NEWEST)
+		{
+			m_stats.nDroppedNewest++;
+			return;
+		}
+
+		if (policy == CAPTION_COALESCE_NULL)
+		{
+			// An incoming null pair carries nothing the queued pairs do not
+			if (IsNullPair(record))
+			{
+				m_stats.nCoalesced++;
+				return;
+			}
+
+			if (RemoveNull())
+				m_stats.nCoalesced++;
+		}
+
+		// Drop the oldest pair if nothing else made room
+		if (GetCount() == CAPTION_RING_SIZE)
+		{
+			m_nHead++;
+			m_stats.nDroppedOldest++;
+		}
+	}
+
+	m_records[m_nTail & CAPTION_RING_MASK] = record;
+	m_nTail++;
+}
+
+// Remove the oldest queued null pair, closing the gap it leaves
+bool CCaptionRing::RemoveNull()
+{
+	for (unsigned long i = m_nHead; i != m_nTail; i++)
+	{
+		if (!IsNullPair(m_records[i & CAPTION_RING_MASK]))
+			continue;
+
+		for (unsigned long j = i; j != m_nHead; j--)
+			m_records[j & CAPTION_RING_MASK] = m_records[(j - 1) & CAPTION_RING_MASK];
+
+		m_nHead++;
+		return true;
+	}
+
+	return false;
+}
+
+// Discard the oldest nRecords pairs once they have been delivered
+void CCaptionRing::Pop(long nRecords)
+{
+	m_nHead += (unsigned long)min(nRecords, GetCount());
+}
+
+// Copy the oldest nRecords pairs to a contiguous buffer without removing them
+long CCaptionRing::CopyTo(VANC_CAPTION_RECORD* pDest, long nRecords) const
+{
+	nRecords = min(nRecords, GetCount());
+
+	long nFirst = min(nRecords, (long)(CAPTION_RING_SIZE - (m_nHead & CAPTION_RING_MASK)));
+	memcpy(pDest, &m_records[m_nHead & CAPTION_RING_MASK], nFirst * sizeof(VANC_CAPTION_RECORD));
+
+	if (nRecords > nFirst)
+		memcpy(pDest + nFirst, &m_records[0], (nRecords - nFirst) * sizeof(VANC_CAPTION_RECORD));
+
+	return nRecords;
+}
@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "VANCSplitterTypes.h"
+
+// Pending caption capacity, a power of two holding at least two full batches
+#define CAPTION_RING_SIZE (VANC_CAPTION_MAX_BATCH * 2)
+
+struct _caption_ring_stats
+{
+	LONG nDroppedOldest;	// queued pairs discarded to make room
+	LONG nDroppedNewest;	// incoming pairs discarded because the ring was full
+	LONG nCoalesced;		// null (0x80 0x80) pairs merged away on overflow
+};
+
+// Caption byte pairs waiting for a free Line21 sample. Only the streaming thread
+// touches the ring so it needs no locking.
+class CCaptionRing
+{
+	public:
+		CCaptionRing(void);
+		~CCaptionRing(void);
+
+	public:
+		void Reset();
+		void Push(const VANC_CAPTION_RECORD& record, caption_overflow_policy policy);
+		void Pop(long nRecords);
+		long CopyTo(VANC_CAPTION_RECORD* pDest, long nRecords) const;
+		long GetCount() const { return (long)(m_nTail - m_nHead); }
+		const VANC_CAPTION_RECORD& Peek(long n) const { return m_records[(m_nHead + n) & (CAPTION_RING_SIZE - 1)]; }
+		void GetStats(_caption_ring_stats* pStats) const { *pStats = m_stats; }
+
+	private:
+		bool RemoveNull();
+
+	private:
+		VANC_CAPTION_RECORD m_records[CAPTION_RING_SIZE];
+		unsigned long m_nHead;
+		unsigned long m_nTail;
+		_caption_ring_stats m_stats;
+};
@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "FrameLayout.h"
+
+// Full SDI rasters, in SMPTE line numbers (1 based). The VANC ranges start at
+// the switching line of each field.
+struct _raster_standard
+{
+	const char* name;
+	long nLines;
+	bool bInterlaced;
+	long nTopField;
+	long nVANC1First, nVANC1Last, nPicture1First, nPicture1Last;
+	long nVANC2First, nVANC2Last, nPicture2First, nPicture2Last;
+};
+
+static const _raster_standard g_rasters[] =
+{
+	{ "1080i (ST 274)", 1125, true,  0, 7,  20,  21,  560, 569, 583, 584, 1123 },
+	{ "1080p (ST 274)", 1125, false, 0, 7,  41,  42, 1121,   0,   0,   0,    0 },
+	{ "720p (ST 296)",   750, false, 0, 7,  25,  26,  745,   0,   0,   0,    0 },
+	{ "525i (ST 125)",   525, true,  1, 10, 20,  21,  263, 273, 282, 283,  525 },
+	{ "625i (ITU-R BT.656)", 625, true, 0, 6, 22, 23, 310, 319, 335, 336, 623 }
+};
+
+// Picture heights of frames carrying their VANC rows above the picture
+static const long g_pictureHeights[] = { 1080, 720, 576, 486, 480 };
+
+//
+// SetFullRaster
+//
+static void SetFullRaster(const _raster_standard& raster, _frame_layout* pLayout)
+{
+	pLayout->standard = raster.name;
+	pLayout->bInterlaced = raster.bInterlaced;
+	pLayout->bFullRaster = true;
+	pLayout->nTopField = raster.nTopField;
+	pLayout->nFields = raster.bInterlaced ? 2 : 1;
+	pLayout->nPictureRanges = pLayout->nFields;
+
+	pLayout->vanc[0].nFirstRow = raster.nVANC1First - 1;
+	pLayout->vanc[0].nRows = raster.nVANC1Last - raster.nVANC1First + 1;
+	pLayout->vanc[0].nRowStep = 1;
+	pLayout->picture[0].nFirstRow = raster.nPicture1First - 1;
+	pLayout->picture[0].nRows = raster.nPicture1Last - raster.nPicture1First + 1;
+
+	if (raster.bInterlaced)
+	{
+		pLayout->vanc[1].nFirstRow = raster.nVANC2First - 1;
+		pLayout->vanc[1].nRows = raster.nVANC2Last - raster.nVANC2First + 1;
+		pLayout->vanc[1].nRowStep = 1;
+		pLayout->picture[1].nFirstRow = raster.nPicture2First - 1;
+		pLayout->picture[1].nRows = raster.nPicture2Last - raster.nPicture2First + 1;
+	}
+} // SetFullRaster
+
+//
+// SetTallFrame
+//
+// nVANC rows above the picture. The rows of an interlaced frame alternate
+// between the fields, field 1 first.
+//
+static void SetTallFrame(long nVANC, long nHeight, bool bInterlaced, _frame_layout* pLayout)
+{
+	pLayout->bInterlaced = bInterlaced;
+	pLayout->bFullRaster = false;
+	pLayout->nPictureRanges = 1;
+	pLayout->picture[0].nFirstRow = nVANC;
+	pLayout->picture[0].nRows = nHeight - nVANC;
+
+	if (bInterlaced)
+	{
+		pLayout->nFields = 2;
+		pLayout->vanc[0].nFirstRow = 0;
+		pLayout->vanc[0].nRows = (nVANC + 1) / 2;
+		pLayout->vanc[0].nRowStep = 2;
+		pLayout->vanc[1].nFirstRow = 1;
+		pLayout->vanc[1].nRows = nVANC / 2;
+		pLayout->vanc[1].nRowStep = 2;
+	}
+	else
+	{
+		pLayout->nFields = 1;
+		pLayout->vanc[0].nFirstRow = 0;
+		pLayout->vanc[0].nRows = nVANC;
+		pLayout->vanc[0].nRowStep = 1;
+	}
+} // SetTallFrame
+
+//
+// ComputeFrameLayout
+//
+// Work out the layout of a captured frame from its format and geometry
+//
+void ComputeFrameLayout(const _pixel_format* pFormat, long nWidth, long nHeight, bool bInterlaced, _frame_layout* pLayout)
+{
+	ZeroMemory(pLayout, sizeof(_frame_layout));
+
+	nHeight = abs(nHeight);
+
+	pLayout->dwStride = pFormat->pfnStride(nWidth);
+	pLayout->nPlanes = pFormat->planes;
+	pLayout->nHeight = nHeight;
+
+	bool bFound = false;
+
+	// The whole raster including the blanking of both fields
+	for (int i = 0; i < (int)(sizeof(g_rasters) / sizeof(g_rasters[0])) && !bFound; i++)
+	{
+		const _raster_standard& raster = g_rasters[i];
+
+		if (raster.nLines == nHeight && (raster.bInterlaced == bInterlaced || raster.nLines != 1125))
+		{
+			SetFullRaster(raster, pLayout);
+			bFound = true;
+		}
+	}
+
+	// A standard picture with the VANC rows on top
+	for (int i = 0; i < (int)(sizeof(g_pictureHeights) / sizeof(g_pictureHeights[0])) && !bFound; i++)
+	{
+		long nVANC = nHeight - g_pictureHeights[i];
+
+		if (nVANC > 0 && nVANC <= FRAME_LAYOUT_MAX_VANC_ROWS)
+		{
+			SetTallFrame(nVANC, nHeight, bInterlaced, pLayout);
+			pLayout->standard = "VANC above picture";
+			bFound = true;
+		}
+	}
+
+	if (!bFound)
+	{
+		SetTallFrame(min(FRAME_LAYOUT_DEFAULT_VANC, nHeight - 1), nHeight, bInterlaced, pLayout);
+		pLayout->standard = "unknown, default VANC rows";
+	}
+
+	pLayout->nPictureHeight = 0;
+	pLayout->nVANCRows = 0;
+
+	for (long i = 0; i < pLayout->nPictureRanges; i++)
+		pLayout->nPictureHeight += pLayout->picture[i].nRows;
+
+	for (long i = 0; i < pLayout->nFields; i++)
+		pLayout->nVANCRows += pLayout->vanc[i].nRows;
+} // ComputeFrameLayout
+
+//
+// FrameLayoutCopyPicture
+//
+// Copy the picture rows of each plane to pPicture, dropping the VANC rows. The
+// fields of a full interlaced raster are woven together, top field row k then
+// bottom field row k, so the picture is the interleaved frame the output media
+// type describes. pPicture may be pFrame: field 1 is then set aside in
+// pFieldBuffer (FrameLayoutFieldBufferLength bytes) and field 2, which sits
+// further down the raster than any row written before it is read, moves in
+// place. Returns the bytes copied.
+//
+DWORD FrameLayoutCopyPicture(const _frame_layout& layout, const BYTE* pFrame, BYTE* pPicture, BYTE* pFieldBuffer)
+{
+	DWORD dwPlane = layout.dwStride * layout.nHeight;
+	DWORD dwCopied = 0;
+	BYTE* pTarget = pPicture;
+
+	for (long nPlane = 0; nPlane < layout.nPlanes; nPlane++)
+	{
+		const BYTE* pPlane = pFrame + (nPlane * dwPlane);
+
+		if (!FrameLayoutIsWoven(layout))
+		{
+			for (long nRange = 0; nRange < layout.nPictureRanges; nRange++)
+			{
+				DWORD dwLength = layout.dwStride * layout.picture[nRange].nRows;
+				memmove(pTarget, pPlane + (layout.dwStride * layout.picture[nRange].nFirstRow), dwLength);
+				pTarget += dwLength;
+				dwCopied += dwLength;
+			}
+
+			continue;
+		}
+
+		const BYTE* pField[FRAME_LAYOUT_MAX_FIELDS];
+		pField[0] = pPlane + (layout.dwStride * layout.picture[0].nFirstRow);
+		pField[1] = pPlane + (layout.dwStride * layout.picture[1].nFirstRow);
+
+		if (pPicture == pFrame)
+		{
+			memcpy(pFieldBuffer, pField[0], layout.dwStride * layout.picture[0].nRows);
+			pField[0] = pFieldBuffer;
+			dwCopied += layout.dwStride * layout.picture[0].nRows;
+		}
+
+		long nRows = max(layout.picture[0].nRows, layout.picture[1].nRows);
+
+		for (long n = 0; n < nRows; n++)
+		{
+			for (long i = 0; i < FRAME_LAYOUT_MAX_FIELDS; i++)
+			{
+				long nField = (i == 0) ? layout.nTopField : (1 - layout.nTopField);
+
+				if (n < layout.picture[nField].nRows)
+				{
+					memmove(pTarget, pField[nField] + (layout.dwStride * n), layout.dwStride);
+					pTarget += layout.dwStride;
+					dwCopied += layout.dwStride;
+				}
+			}
+		}
+	}
+
+	return dwCopied;
+} // FrameLayoutCopyPicture
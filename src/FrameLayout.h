@@ -0,0 +1,103 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+#include "PixelFormat.h"
+
+#define FRAME_LAYOUT_MAX_FIELDS		2
+
+// VANC rows of frames whose geometry matches no known standard
+#define FRAME_LAYOUT_DEFAULT_VANC	22
+
+// Most VANC rows a frame may carry
+#define FRAME_LAYOUT_MAX_VANC_ROWS	50
+
+// VANC rows of one field: nRows rows starting at nFirstRow, nRowStep apart
+struct _vanc_rows
+{
+	long nFirstRow;
+	long nRows;
+	long nRowStep;
+};
+
+// Picture rows of one field kept in the delivered frame
+struct _picture_rows
+{
+	long nFirstRow;
+	long nRows;
+};
+
+// Where the VANC and the picture sit in a captured frame. A frame is either
+// a "tall" frame with the VANC rows above the picture (interleaved fields when
+// interlaced), or the full SDI raster with each field's blanking and picture
+// in line order.
+struct _frame_layout
+{
+	const char* standard;			// raster name for tracing
+	DWORD dwStride;					// bytes per row of a plane
+	long nPlanes;
+	long nHeight;					// rows of the captured frame
+	long nPictureHeight;			// rows delivered downstream
+	bool bInterlaced;
+	bool bFullRaster;				// fields stored one after the other
+	long nTopField;					// field whose picture rows are on top (1 = field 2 in 525 line systems)
+	long nFields;					// entries used in vanc
+	_vanc_rows vanc[FRAME_LAYOUT_MAX_FIELDS];
+	long nPictureRanges;			// entries used in picture
+	_picture_rows picture[FRAME_LAYOUT_MAX_FIELDS];
+	long nVANCRows;					// VANC rows of all fields
+};
+
+void ComputeFrameLayout(const _pixel_format* pFormat, long nWidth, long nHeight, bool bInterlaced, _frame_layout* pLayout);
+DWORD FrameLayoutCopyPicture(const _frame_layout& layout, const BYTE* pFrame, BYTE* pPicture, BYTE* pFieldBuffer);
+
+// Frame row of the n-th VANC row of a field
+inline long FrameLayoutVANCRow(const _frame_layout& layout, long nField, long n)
+{
+	return layout.vanc[nField].nFirstRow + (n * layout.vanc[nField].nRowStep);
+}
+
+// Field (0 or 1) a frame row belongs to
+inline long FrameLayoutFieldOfRow(const _frame_layout& layout, long nRow)
+{
+	for (long f = layout.nFields - 1; f > 0; f--)
+	{
+		const _vanc_rows& vanc = layout.vanc[f];
+		long n = nRow - vanc.nFirstRow;
+
+		if (n >= 0 && n < vanc.nRows * vanc.nRowStep && (n % vanc.nRowStep) == 0)
+			return f;
+	}
+
+	return 0;
+}
+
+// Byte length of the delivered picture
+inline DWORD FrameLayoutPictureLength(const _frame_layout& layout)
+{
+	return layout.dwStride * layout.nPictureHeight * layout.nPlanes;
+}
+
+// Byte length of the captured frame
+inline DWORD FrameLayoutFrameLength(const _frame_layout& layout)
+{
+	return layout.dwStride * layout.nHeight * layout.nPlanes;
+}
+
+// The fields of a full interlaced raster are woven into an interleaved picture
+inline bool FrameLayoutIsWoven(const _frame_layout& layout)
+{
+	return layout.bFullRaster && layout.nPictureRanges == 2;
+}
+
+// Bytes FrameLayoutCopyPicture needs to set a field aside when it copies in place
+inline DWORD FrameLayoutFieldBufferLength(const _frame_layout& layout)
+{
+	return FrameLayoutIsWoven(layout) ? layout.dwStride * layout.picture[0].nRows : 0;
+}
@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "FrameMemory.h"
+#include <malloc.h>
+
+// The large page and NUMA functions are not available on every Windows version
+// the filter targets so they are resolved at run time.
+typedef SIZE_T (WINAPI *PFN_GETLARGEPAGEMINIMUM)(void);
+typedef LPVOID (WINAPI *PFN_VIRTUALALLOCEXNUMA)(HANDLE, LPVOID, SIZE_T, DWORD, DWORD, DWORD);
+typedef DWORD (WINAPI *PFN_GETCURRENTPROCESSORNUMBER)(void);
+typedef BOOL (WINAPI *PFN_GETNUMAPROCESSORNODE)(UCHAR, PUCHAR);
+
+static volatile LONG g_nFrameMemoryInit = 0;
+static SIZE_T g_cbLargePage = 0;
+static PFN_VIRTUALALLOCEXNUMA g_pfnVirtualAllocExNuma = NULL;
+static PFN_GETCURRENTPROCESSORNUMBER g_pfnGetCurrentProcessorNumber = NULL;
+static PFN_GETNUMAPROCESSORNODE g_pfnGetNumaProcessorNode = NULL;
+
+// Large pages need the lock memory privilege granted to the account and enabled
+// in the process token. The filter lives in the host's process and never changes
+// its token, large pages are only used when the host enabled the privilege.
+static bool IsLockMemoryPrivilegeEnabled()
+{
+	HANDLE hToken = NULL;
+	LUID luid;
+
+	if (!LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &luid))
+		return false;
+
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken))
+		return false;
+
+	DWORD cbPrivileges = 0;
+	GetTokenInformation(hToken, TokenPrivileges, NULL, 0, &cbPrivileges);
+
+	TOKEN_PRIVILEGES* pPrivileges = (cbPrivileges > 0) ? (TOKEN_PRIVILEGES*)malloc(cbPrivileges) : NULL;
+	bool bEnabled = false;
+
+	if (pPrivileges != NULL && GetTokenInformation(hToken, TokenPrivileges, pPrivileges, cbPrivileges, &cbPrivileges))
+	{
+		for (DWORD i = 0; i < pPrivileges->PrivilegeCount && !bEnabled; i++)
+		{
+			const LUID_AND_ATTRIBUTES& privilege = pPrivileges->Privileges[i];
+
+			bEnabled = privilege.Luid.LowPart == luid.LowPart && privilege.Luid.HighPart == luid.HighPart &&
+				(privilege.Attributes & SE_PRIVILEGE_ENABLED) != 0;
+		}
+	}
+
+	free(pPrivileges);
+	CloseHandle(hToken);
+	return bEnabled;
+}
+
+static void InitFrameMemory()
+{
+	if (g_nFrameMemoryInit != 0)
+		return;
+
+	HMODULE hKernel = GetModuleHandle(TEXT("kernel32.dll"));
+
+	if (hKernel != NULL)
+	{
+		PFN_GETLARGEPAGEMINIMUM pfnGetLargePageMinimum = (PFN_GETLARGEPAGEMINIMUM)GetProcAddress(hKernel, "GetLargePageMinimum");
+
+		if (pfnGetLargePageMinimum != NULL && IsLockMemoryPrivilegeEnabled())
+			g_cbLargePage = pfnGetLargePageMinimum();
+
+		g_pfnVirtualAllocExNuma = (PFN_VIRTUALALLOCEXNUMA)GetProcAddress(hKernel, "VirtualAllocExNuma");
+		g_pfnGetCurrentProcessorNumber = (PFN_GETCURRENTPROCESSORNUMBER)GetProcAddress(hKernel, "GetCurrentProcessorNumber");
+		g_pfnGetNumaProcessorNode = (PFN_GETNUMAPROCESSORNODE)GetProcAddress(hKernel, "GetNumaProcessorNode");
+	}
+
+	FilterTrace("InitFrameMemory() large page size %u, NUMA %s\n", (unsigned int)g_cbLargePage,
+		g_pfnVirtualAllocExNuma != NULL ? "available" : "not available");
+
+	InterlockedExchange(&g_nFrameMemoryInit, 1);
+}
+
+//
+// GetFrameLargePageSize
+//
+// Size of a large page, or zero when large pages cannot be used by the process
+//
+SIZE_T GetFrameLargePageSize()
+{
+	InitFrameMemory();
+	return g_cbLargePage;
+} // GetFrameLargePageSize
+
+//
+// GetCurrentNumaNode
+//
+// NUMA node of the processor running the calling thread
+//
+DWORD GetCurrentNumaNode()
+{
+	InitFrameMemory();
+
+	if (g_pfnGetCurrentProcessorNumber == NULL || g_pfnGetNumaProcessorNode == NULL)
+		return FRAME_NUMA_NODE_ANY;
+
+	UCHAR node = 0;
+
+	if (!g_pfnGetNumaProcessorNode((UCHAR)g_pfnGetCurrentProcessorNumber(), &node))
+		return FRAME_NUMA_NODE_ANY;
+
+	return node;
+} // GetCurrentNumaNode
+
+//
+// AllocFrameBuffer
+//
+// Commit a frame buffer, on large pages when it is big enough and the privilege
+// is held, and on the given NUMA node when one is set. Falls back to regular
+// pages when no large pages are free. Small buffers come from the heap.
+//
+BYTE* AllocFrameBuffer(SIZE_T cbSize, SIZE_T cbAlign, DWORD nNumaNode, _frame_buffer_info* pInfo)
+{
+	InitFrameMemory();
+
+	BYTE* pBuffer = NULL;
+	bool bNuma = (nNumaNode != FRAME_NUMA_NODE_ANY && g_pfnVirtualAllocExNuma != NULL);
+
+	pInfo->bLargePages = false;
+	pInfo->bHeap = false;
+
+	if (cbSize < FRAME_HEAP_LIMIT && cbAlign <= FRAME_HEAP_ALIGNMENT)
+	{
+		pBuffer = (BYTE*)_aligned_malloc(cbSize, FRAME_HEAP_ALIGNMENT);
+		pInfo->cbCommitted = (pBuffer != NULL) ? cbSize : 0;
+		pInfo->bHeap = true;
+		return pBuffer;
+	}
+
+	if (g_cbLargePage > 0 && cbSize >= FRAME_LARGE_PAGE_THRESHOLD)
+	{
+		SIZE_T cbLarge = ((cbSize + g_cbLargePage - 1) / g_cbLargePage) * g_cbLargePage;
+		DWORD flags = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+
+		if (bNuma)
+			pBuffer = (BYTE*)g_pfnVirtualAllocExNuma(GetCurrentProcess(), NULL, cbLarge, flags, PAGE_READWRITE, nNumaNode);
+		else
+			pBuffer = (BYTE*)VirtualAlloc(NULL, cbLarge, flags, PAGE_READWRITE);
+
+		if (pBuffer != NULL)
+		{
+			pInfo->cbCommitted = cbLarge;
+			pInfo->bLargePages = true;
+			return pBuffer;
+		}
+	}
+
+	if (bNuma)
+		pBuffer = (BYTE*)g_pfnVirtualAllocExNuma(GetCurrentProcess(), NULL, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, nNumaNode);
+	else
+		pBuffer = (BYTE*)VirtualAlloc(NULL, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+	pInfo->cbCommitted = (pBuffer != NULL) ? cbSize : 0;
+	return pBuffer;
+} // AllocFrameBuffer
+
+//
+// FreeFrameBuffer
+//
+void FreeFrameBuffer(BYTE* pBuffer, const _frame_buffer_info& info)
+{
+	if (pBuffer == NULL)
+		return;
+
+	if (info.bHeap)
+		_aligned_free(pBuffer);
+	else
+		VirtualFree(pBuffer, 0, MEM_RELEASE);
+} // FreeFrameBuffer
@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+
+// Buffers of at least this size are backed by large pages when the host process
+// enabled the lock memory privilege before the first frame buffer. Smaller
+// buffers would waste too much of a 2 MB page.
+#define FRAME_LARGE_PAGE_THRESHOLD	(4 * 1024 * 1024)
+
+// Buffers smaller than this come from the heap rather than their own allocation
+// granule, so a pool of small caption buffers does not use 64 KB of address space
+// per buffer
+#define FRAME_HEAP_LIMIT			(64 * 1024)
+#define FRAME_HEAP_ALIGNMENT		64
+
+// No preferred NUMA node, pages come from the node of the first thread touching them
+#define FRAME_NUMA_NODE_ANY			((DWORD)-1)
+
+// How a frame buffer was committed
+struct _frame_buffer_info
+{
+	SIZE_T cbCommitted;		// bytes committed (rounded up to the page size)
+	bool   bLargePages;		// backed by large pages
+	bool   bHeap;			// small buffer allocated from the heap
+};
+
+SIZE_T GetFrameLargePageSize();
+DWORD GetCurrentNumaNode();
+BYTE* AllocFrameBuffer(SIZE_T cbSize, SIZE_T cbAlign, DWORD nNumaNode, _frame_buffer_info* pInfo);
+void FreeFrameBuffer(BYTE* pBuffer, const _frame_buffer_info& info);
@@ -0,0 +1,271 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "PixelFormat.h"
+#include <emmintrin.h>
+
+#define PIXEL_FORMAT_ENTRY(fourcc, name, format) \
+	{ fourcc, name, format::planes, format::group_pixels, format::checksum_mask, PlaneStride<format>, \
+	  ExtractLuma<format>, ExtractChroma<format>, ExtractMultiplexed<format>, \
+	  InsertLuma<format>, InsertChroma<format>, InsertMultiplexed<format> }
+
+// The formats the input pin accepts
+static const _pixel_format g_pixelFormats[] =
+{
+	PIXEL_FORMAT_ENTRY(MAKEFOURCC('v', '2', '1', '0'), "v210", v210_format),
+	PIXEL_FORMAT_ENTRY(MAKEFOURCC('U', 'Y', 'V', 'Y'), "UYVY", uyvy_format),
+	PIXEL_FORMAT_ENTRY(MAKEFOURCC('2', 'v', 'u', 'y'), "2vuy", uyvy_format),
+	PIXEL_FORMAT_ENTRY(MAKEFOURCC('P', '2', '1', '0'), "P210", p210_format),
+	PIXEL_FORMAT_ENTRY(MAKEFOURCC('Y', '2', '1', '0'), "Y210", y210_format)
+};
+
+//
+// v210 kernels
+//
+// A 64-bit lane holds two v210 words and three of their samples are wanted,
+// either Y (word 0 bits 10-19, word 1 bits 0-9 and 20-29) or Cb Cr (word 0 bits
+// 0-9 and 20-29, word 1 bits 10-19). Shifting and masking moves the three into
+// the low three 16-bit fields of the lane, which is stored as four words. The
+// fourth (zero) word is overwritten by the next store.
+//
+
+//
+// ExtractLuma<v210_format>
+//
+template <> DWORD ExtractLuma<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pRow = pFrame + nLine * dwStride;
+	long nGroups = (nWidth + v210_format::group_pixels - 1) / v210_format::group_pixels;
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 16, 0, 0x3ff << 16);
+	const __m128i mask2 = _mm_set_epi32(0x3ff, 0, 0x3ff, 0);
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 6)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)pRow);
+		__m128i y = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_srli_epi64(v, 10), mask0),
+			_mm_and_si128(_mm_srli_epi64(v, 16), mask1)),
+			_mm_and_si128(_mm_srli_epi64(v, 20), mask2));
+
+		_mm_storel_epi64((__m128i*)(pWords + n), y);
+		_mm_storel_epi64((__m128i*)(pWords + n + 3), _mm_unpackhi_epi64(y, y));
+	}
+
+	return n;
+} // ExtractLuma<v210_format>
+
+//
+// ExtractChroma<v210_format>
+//
+template <> DWORD ExtractChroma<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pRow = pFrame + nLine * dwStride;
+	long nGroups = (nWidth + v210_format::group_pixels - 1) / v210_format::group_pixels;
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 16, 0, 0x3ff << 16);
+	const __m128i mask2 = _mm_set_epi32(0x3ff, 0, 0x3ff, 0);
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 6)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)pRow);
+		__m128i c = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(v, mask0),
+			_mm_and_si128(_mm_srli_epi64(v, 4), mask1)),
+			_mm_and_si128(_mm_srli_epi64(v, 10), mask2));
+
+		_mm_storel_epi64((__m128i*)(pWords + n), c);
+		_mm_storel_epi64((__m128i*)(pWords + n + 3), _mm_unpackhi_epi64(c, c));
+	}
+
+	return n;
+} // ExtractChroma<v210_format>
+
+//
+// ExtractMultiplexed<v210_format>
+//
+// Every sample is wanted, so each word gets a lane of its own
+//
+template <> DWORD ExtractMultiplexed<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pRow = pFrame + nLine * dwStride;
+	long nGroups = (nWidth + v210_format::group_pixels - 1) / v210_format::group_pixels;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 16, 0, 0x3ff << 16);
+	const __m128i mask2 = _mm_set_epi32(0x3ff, 0, 0x3ff, 0);
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 12)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)pRow);
+		__m128i lo = _mm_unpacklo_epi32(v, zero);
+		__m128i hi = _mm_unpackhi_epi32(v, zero);
+
+		lo = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(lo, mask0),
+			_mm_and_si128(_mm_slli_epi64(lo, 6), mask1)),
+			_mm_and_si128(_mm_slli_epi64(lo, 12), mask2));
+		hi = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(hi, mask0),
+			_mm_and_si128(_mm_slli_epi64(hi, 6), mask1)),
+			_mm_and_si128(_mm_slli_epi64(hi, 12), mask2));
+
+		_mm_storel_epi64((__m128i*)(pWords + n), lo);
+		_mm_storel_epi64((__m128i*)(pWords + n + 3), _mm_unpackhi_epi64(lo, lo));
+		_mm_storel_epi64((__m128i*)(pWords + n + 6), hi);
+		_mm_storel_epi64((__m128i*)(pWords + n + 9), _mm_unpackhi_epi64(hi, hi));
+	}
+
+	return n;
+} // ExtractMultiplexed<v210_format>
+
+//
+// v210 packers
+//
+// The reverse of the kernels above: three words of a 64-bit lane are moved to
+// their 10-bit fields in a pair of v210 words and merged with the samples that
+// are kept. Whole groups are written with one 16 byte store, a partial last
+// group is updated through the scalar code.
+//
+
+// Scalar update of the samples nOffset, nOffset + nStep, ... of one v210 group
+static void InsertV210Group(BYTE* pGroup, int nOffset, int nStep, const __int16* pWords, DWORD nWords)
+{
+	unsigned short samples[v210_format::group_samples];
+	v210_format::Unpack(pGroup, samples);
+
+	for (int i = nOffset; i < v210_format::group_samples && nWords > 0; i += nStep, nWords--)
+		samples[i] = v210_format::Sample(*pWords++);
+
+	v210_format::Pack(samples, pGroup);
+}
+
+//
+// InsertLuma<v210_format>
+//
+template <> void InsertLuma<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pRow = pFrame + nLine * dwStride;
+	DWORD nGroups = nWords / 6;
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 16, 0, 0x3ff << 16);
+	const __m128i mask2 = _mm_set_epi32(0x3ff, 0, 0x3ff, 0);
+	const __m128i lumaMask = _mm_set_epi32(0x3ff | (0x3ff << 20), 0x3ff << 10, 0x3ff | (0x3ff << 20), 0x3ff << 10);
+	DWORD n = 0;
+
+	for (DWORD g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 6)
+	{
+		__m128i x = _mm_unpacklo_epi64(
+			_mm_loadl_epi64((const __m128i*)(pWords + n)),
+			_mm_loadl_epi64((const __m128i*)(pWords + n + 3)));
+		__m128i y = _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi64(_mm_and_si128(x, mask0), 10),
+			_mm_slli_epi64(_mm_and_si128(x, mask1), 16)),
+			_mm_slli_epi64(_mm_and_si128(x, mask2), 20));
+		__m128i v = _mm_loadu_si128((const __m128i*)pRow);
+
+		_mm_storeu_si128((__m128i*)pRow, _mm_or_si128(_mm_andnot_si128(lumaMask, v), y));
+	}
+
+	if (n < nWords)
+		InsertV210Group(pRow, v210_format::luma_offset, v210_format::luma_step, pWords + n, nWords - n);
+} // InsertLuma<v210_format>
+
+//
+// InsertChroma<v210_format>
+//
+template <> void InsertChroma<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pRow = pFrame + nLine * dwStride;
+	DWORD nGroups = nWords / 6;
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 16, 0, 0x3ff << 16);
+	const __m128i mask2 = _mm_set_epi32(0x3ff, 0, 0x3ff, 0);
+	const __m128i chromaMask = _mm_set_epi32(0x3ff << 10, 0x3ff | (0x3ff << 20), 0x3ff << 10, 0x3ff | (0x3ff << 20));
+	DWORD n = 0;
+
+	for (DWORD g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 6)
+	{
+		__m128i x = _mm_unpacklo_epi64(
+			_mm_loadl_epi64((const __m128i*)(pWords + n)),
+			_mm_loadl_epi64((const __m128i*)(pWords + n + 3)));
+		__m128i c = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(x, mask0),
+			_mm_slli_epi64(_mm_and_si128(x, mask1), 4)),
+			_mm_slli_epi64(_mm_and_si128(x, mask2), 10));
+		__m128i v = _mm_loadu_si128((const __m128i*)pRow);
+
+		_mm_storeu_si128((__m128i*)pRow, _mm_or_si128(_mm_andnot_si128(chromaMask, v), c));
+	}
+
+	if (n < nWords)
+		InsertV210Group(pRow, v210_format::chroma_offset, v210_format::chroma_step, pWords + n, nWords - n);
+} // InsertChroma<v210_format>
+
+//
+// InsertMultiplexed<v210_format>
+//
+// Each lane builds one v210 word from three samples, whole groups are written
+// without reading the row
+//
+template <> void InsertMultiplexed<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pRow = pFrame + nLine * dwStride;
+	DWORD nGroups = nWords / 12;
+	const __m128i mask0 = _mm_set_epi32(0, 0x3ff, 0, 0x3ff);
+	const __m128i mask1 = _mm_set_epi32(0, 0x3ff << 10, 0, 0x3ff << 10);
+	const __m128i mask2 = _mm_set_epi32(0, 0x3ff << 20, 0, 0x3ff << 20);
+	DWORD n = 0;
+
+	for (DWORD g = 0; g < nGroups; g++, pRow += v210_format::group_bytes, n += 12)
+	{
+		__m128i lo = _mm_unpacklo_epi64(
+			_mm_loadl_epi64((const __m128i*)(pWords + n)),
+			_mm_loadl_epi64((const __m128i*)(pWords + n + 3)));
+		__m128i hi = _mm_unpacklo_epi64(
+			_mm_loadl_epi64((const __m128i*)(pWords + n + 6)),
+			_mm_loadl_epi64((const __m128i*)(pWords + n + 9)));
+
+		lo = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(lo, mask0),
+			_mm_and_si128(_mm_srli_epi64(lo, 6), mask1)),
+			_mm_and_si128(_mm_srli_epi64(lo, 12), mask2));
+		hi = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(hi, mask0),
+			_mm_and_si128(_mm_srli_epi64(hi, 6), mask1)),
+			_mm_and_si128(_mm_srli_epi64(hi, 12), mask2));
+
+		// The v210 words sit in the low half of each lane
+		lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+		hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+
+		_mm_storeu_si128((__m128i*)pRow, _mm_unpacklo_epi64(lo, hi));
+	}
+
+	if (n < nWords)
+		InsertV210Group(pRow, 0, 1, pWords + n, nWords - n);
+} // InsertMultiplexed<v210_format>
+
+//
+// FindPixelFormat
+//
+// Format of a FOURCC video subtype, NULL when the format is not supported
+//
+const _pixel_format* FindPixelFormat(const GUID& subtype)
+{
+	for (int i = 0; i < (int)(sizeof(g_pixelFormats) / sizeof(g_pixelFormats[0])); i++)
+	{
+		if (subtype == FOURCCMap(g_pixelFormats[i].fourcc))
+			return &g_pixelFormats[i];
+	}
+
+	return NULL;
+} // FindPixelFormat
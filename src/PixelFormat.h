@@ -0,0 +1,375 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+
+// Extra words a line buffer must have past the extracted or inserted words, the
+// v210 kernels load and store four words at a time
+#define PIXEL_FORMAT_WORD_SLACK	4
+
+// Pixel format traits of the supported capture formats. Every format is 4:2:2
+// and is unpacked in groups of pixels; a group unpacks to group_samples samples
+// of one plane. Luma and chroma are found at a fixed offset and step within the
+// unpacked samples of their plane, so the extraction loops are instantiated per
+// format at compile time and carry no per-sample format checks. Pack and Sample
+// are the inverse of Unpack and Word and are used to insert ANC packets.
+
+//
+// v210
+//
+// 10-bit, three samples per 32-bit word, six pixels (Cb Y Cr Y ...) in 16 bytes.
+// Rows are padded to 128 bytes.
+//
+struct v210_format
+{
+	enum
+	{
+		planes = 1,
+		group_pixels = 6,
+		group_bytes = 16,
+		group_samples = 12,
+		stride_align = 128,
+		luma_plane = 0, luma_offset = 1, luma_step = 2,
+		chroma_plane = 0, chroma_offset = 0, chroma_step = 2,
+		checksum_mask = 0x1ff
+	};
+
+	static void Unpack(const BYTE* pGroup, unsigned short* pSamples)
+	{
+		const DWORD* pWords = (const DWORD*)pGroup;
+
+		for (int i = 0; i < 4; i++)
+		{
+			DWORD word = pWords[i];
+			pSamples[i * 3] = (unsigned short)(word & 0x3ff);
+			pSamples[i * 3 + 1] = (unsigned short)((word >> 10) & 0x3ff);
+			pSamples[i * 3 + 2] = (unsigned short)((word >> 20) & 0x3ff);
+		}
+	}
+
+	static void Pack(const unsigned short* pSamples, BYTE* pGroup)
+	{
+		DWORD* pWords = (DWORD*)pGroup;
+
+		for (int i = 0; i < 4; i++)
+			pWords[i] = pSamples[i * 3] | ((DWORD)pSamples[i * 3 + 1] << 10) | ((DWORD)pSamples[i * 3 + 2] << 20);
+	}
+
+	static unsigned short Word(unsigned short sample) { return sample; }
+	static unsigned short Sample(__int16 word) { return (unsigned short)(word & 0x3ff); }
+};
+
+//
+// UYVY (2vuy)
+//
+// 8-bit, two pixels (Cb Y Cr Y) in 4 bytes. The ANC packets are 8-bit, the
+// ADF 00 FF FF is widened to 000 3FF 3FF and the checksum covers 8 bits.
+//
+struct uyvy_format
+{
+	enum
+	{
+		planes = 1,
+		group_pixels = 2,
+		group_bytes = 4,
+		group_samples = 4,
+		stride_align = 4,
+		luma_plane = 0, luma_offset = 1, luma_step = 2,
+		chroma_plane = 0, chroma_offset = 0, chroma_step = 2,
+		checksum_mask = 0xff
+	};
+
+	static void Unpack(const BYTE* pGroup, unsigned short* pSamples)
+	{
+		for (int i = 0; i < 4; i++)
+			pSamples[i] = pGroup[i];
+	}
+
+	static void Pack(const unsigned short* pSamples, BYTE* pGroup)
+	{
+		for (int i = 0; i < 4; i++)
+			pGroup[i] = (BYTE)pSamples[i];
+	}
+
+	static unsigned short Word(unsigned short sample) { return (sample == 0xff) ? 0x3ff : sample; }
+	static unsigned short Sample(__int16 word) { return ((word & 0x3ff) == 0x3ff) ? 0xff : (unsigned short)(word & 0xff); }
+};
+
+//
+// P210
+//
+// 16-bit planar, a luma plane followed by an interleaved Cb Cr plane of the same
+// height. Samples hold 10 bits in the upper bits of a little endian word.
+//
+struct p210_format
+{
+	enum
+	{
+		planes = 2,
+		group_pixels = 2,
+		group_bytes = 4,
+		group_samples = 2,
+		stride_align = 4,
+		luma_plane = 0, luma_offset = 0, luma_step = 1,
+		chroma_plane = 1, chroma_offset = 0, chroma_step = 1,
+		checksum_mask = 0x1ff
+	};
+
+	static void Unpack(const BYTE* pGroup, unsigned short* pSamples)
+	{
+		const WORD* pWords = (const WORD*)pGroup;
+		pSamples[0] = pWords[0];
+		pSamples[1] = pWords[1];
+	}
+
+	static void Pack(const unsigned short* pSamples, BYTE* pGroup)
+	{
+		WORD* pWords = (WORD*)pGroup;
+		pWords[0] = pSamples[0];
+		pWords[1] = pSamples[1];
+	}
+
+	static unsigned short Word(unsigned short sample) { return (unsigned short)(sample >> 6); }
+	static unsigned short Sample(__int16 word) { return (unsigned short)((word & 0x3ff) << 6); }
+};
+
+//
+// Y210
+//
+// 16-bit packed, two pixels (Y Cb Y Cr) in 8 bytes with 10 bits in the upper
+// bits of each little endian word
+//
+struct y210_format
+{
+	enum
+	{
+		planes = 1,
+		group_pixels = 2,
+		group_bytes = 8,
+		group_samples = 4,
+		stride_align = 4,
+		luma_plane = 0, luma_offset = 0, luma_step = 2,
+		chroma_plane = 0, chroma_offset = 1, chroma_step = 2,
+		checksum_mask = 0x1ff
+	};
+
+	static void Unpack(const BYTE* pGroup, unsigned short* pSamples)
+	{
+		const WORD* pWords = (const WORD*)pGroup;
+
+		for (int i = 0; i < 4; i++)
+			pSamples[i] = pWords[i];
+	}
+
+	static void Pack(const unsigned short* pSamples, BYTE* pGroup)
+	{
+		WORD* pWords = (WORD*)pGroup;
+
+		for (int i = 0; i < 4; i++)
+			pWords[i] = pSamples[i];
+	}
+
+	static unsigned short Word(unsigned short sample) { return (unsigned short)(sample >> 6); }
+	static unsigned short Sample(__int16 word) { return (unsigned short)((word & 0x3ff) << 6); }
+};
+
+//
+// Pixel format templates
+//
+
+// Bytes of one row of a plane
+template <class Format>
+DWORD PlaneStride(long nWidth)
+{
+	DWORD dwGroups = (DWORD)((nWidth + Format::group_pixels - 1) / Format::group_pixels);
+	DWORD dwBytes = dwGroups * Format::group_bytes;
+	return ((dwBytes + Format::stride_align - 1) / Format::stride_align) * Format::stride_align;
+}
+
+// Unpack the luma samples of a frame row to VANC words, returns the word count
+template <class Format>
+DWORD ExtractLuma(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pRow = pFrame + ((Format::luma_plane * nHeight) + nLine) * dwStride;
+	long nGroups = (nWidth + Format::group_pixels - 1) / Format::group_pixels;
+	unsigned short samples[Format::group_samples];
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pRow += Format::group_bytes)
+	{
+		Format::Unpack(pRow, samples);
+
+		for (int i = Format::luma_offset; i < Format::group_samples; i += Format::luma_step)
+			pWords[n++] = (__int16)Format::Word(samples[i]);
+	}
+
+	return n;
+}
+
+// Unpack the chroma samples (Cb Cr ...) of a frame row to VANC words
+template <class Format>
+DWORD ExtractChroma(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pRow = pFrame + ((Format::chroma_plane * nHeight) + nLine) * dwStride;
+	long nGroups = (nWidth + Format::group_pixels - 1) / Format::group_pixels;
+	unsigned short samples[Format::group_samples];
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pRow += Format::group_bytes)
+	{
+		Format::Unpack(pRow, samples);
+
+		for (int i = Format::chroma_offset; i < Format::group_samples; i += Format::chroma_step)
+			pWords[n++] = (__int16)Format::Word(samples[i]);
+	}
+
+	return n;
+}
+
+// Unpack all samples of a frame row in Cb Y Cr Y order, the SD (ST 125) ANC
+// multiplex. Returns the word count.
+template <class Format>
+DWORD ExtractMultiplexed(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords)
+{
+	const BYTE* pLumaRow = pFrame + ((Format::luma_plane * nHeight) + nLine) * dwStride;
+	const BYTE* pChromaRow = pFrame + ((Format::chroma_plane * nHeight) + nLine) * dwStride;
+	long nGroups = (nWidth + Format::group_pixels - 1) / Format::group_pixels;
+	unsigned short luma[Format::group_samples];
+	unsigned short chroma[Format::group_samples];
+	const unsigned short* pChroma = (Format::chroma_plane == Format::luma_plane) ? luma : chroma;
+	DWORD n = 0;
+
+	for (long g = 0; g < nGroups; g++, pLumaRow += Format::group_bytes, pChromaRow += Format::group_bytes)
+	{
+		Format::Unpack(pLumaRow, luma);
+
+		if (Format::chroma_plane != Format::luma_plane)
+			Format::Unpack(pChromaRow, chroma);
+
+		for (int j = 0; j < Format::group_pixels; j += 2)
+		{
+			pWords[n++] = (__int16)Format::Word(pChroma[Format::chroma_offset + (j * Format::chroma_step)]);
+			pWords[n++] = (__int16)Format::Word(luma[Format::luma_offset + (j * Format::luma_step)]);
+			pWords[n++] = (__int16)Format::Word(pChroma[Format::chroma_offset + ((j + 1) * Format::chroma_step)]);
+			pWords[n++] = (__int16)Format::Word(luma[Format::luma_offset + ((j + 1) * Format::luma_step)]);
+		}
+	}
+
+	return n;
+}
+
+// Write VANC words to the luma samples at the start of a frame row in place.
+// Only the pixel groups holding the words are read and written.
+template <class Format>
+void InsertLuma(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pRow = pFrame + ((Format::luma_plane * nHeight) + nLine) * dwStride;
+	unsigned short samples[Format::group_samples];
+	DWORD n = 0;
+
+	for (; n < nWords; pRow += Format::group_bytes)
+	{
+		Format::Unpack(pRow, samples);
+
+		for (int i = Format::luma_offset; i < Format::group_samples && n < nWords; i += Format::luma_step)
+			samples[i] = Format::Sample(pWords[n++]);
+
+		Format::Pack(samples, pRow);
+	}
+}
+
+// Write VANC words to the chroma samples (Cb Cr ...) of a frame row in place
+template <class Format>
+void InsertChroma(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pRow = pFrame + ((Format::chroma_plane * nHeight) + nLine) * dwStride;
+	unsigned short samples[Format::group_samples];
+	DWORD n = 0;
+
+	for (; n < nWords; pRow += Format::group_bytes)
+	{
+		Format::Unpack(pRow, samples);
+
+		for (int i = Format::chroma_offset; i < Format::group_samples && n < nWords; i += Format::chroma_step)
+			samples[i] = Format::Sample(pWords[n++]);
+
+		Format::Pack(samples, pRow);
+	}
+}
+
+// Write VANC words across all samples of a frame row in Cb Y Cr Y order
+template <class Format>
+void InsertMultiplexed(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords)
+{
+	BYTE* pLumaRow = pFrame + ((Format::luma_plane * nHeight) + nLine) * dwStride;
+	BYTE* pChromaRow = pFrame + ((Format::chroma_plane * nHeight) + nLine) * dwStride;
+	unsigned short luma[Format::group_samples];
+	unsigned short chroma[Format::group_samples];
+	unsigned short* pChroma = (Format::chroma_plane == Format::luma_plane) ? luma : chroma;
+	DWORD n = 0;
+
+	for (; n < nWords; pLumaRow += Format::group_bytes, pChromaRow += Format::group_bytes)
+	{
+		Format::Unpack(pLumaRow, luma);
+
+		if (Format::chroma_plane != Format::luma_plane)
+			Format::Unpack(pChromaRow, chroma);
+
+		// Cb or Cr of the pixel, then its Y
+		for (int j = 0; j < Format::group_pixels && n < nWords; j++)
+		{
+			pChroma[Format::chroma_offset + (j * Format::chroma_step)] = Format::Sample(pWords[n++]);
+
+			if (n < nWords)
+				luma[Format::luma_offset + (j * Format::luma_step)] = Format::Sample(pWords[n++]);
+		}
+
+		Format::Pack(luma, pLumaRow);
+
+		if (Format::chroma_plane != Format::luma_plane)
+			Format::Pack(chroma, pChromaRow);
+	}
+}
+
+// SSE2 versions for v210, the common capture format
+template <> DWORD ExtractLuma<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords);
+template <> DWORD ExtractChroma<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords);
+template <> DWORD ExtractMultiplexed<v210_format>(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords);
+template <> void InsertLuma<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords);
+template <> void InsertChroma<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords);
+template <> void InsertMultiplexed<v210_format>(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords);
+
+typedef DWORD (*PFN_EXTRACT_LINE)(const BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, long nWidth, __int16* pWords);
+typedef void (*PFN_INSERT_LINE)(BYTE* pFrame, DWORD dwStride, long nHeight, long nLine, const __int16* pWords, DWORD nWords);
+
+// Run-time description of a supported format, chosen from the media subtype
+struct _pixel_format
+{
+	DWORD fourcc;
+	const char* name;
+	long planes;
+	long group_pixels;
+	unsigned short checksum_mask;
+	DWORD (*pfnStride)(long nWidth);
+	PFN_EXTRACT_LINE pfnExtractLuma;
+	PFN_EXTRACT_LINE pfnExtractChroma;
+	PFN_EXTRACT_LINE pfnExtractMultiplexed;
+	PFN_INSERT_LINE pfnInsertLuma;
+	PFN_INSERT_LINE pfnInsertChroma;
+	PFN_INSERT_LINE pfnInsertMultiplexed;
+};
+
+const _pixel_format* FindPixelFormat(const GUID& subtype);
+
+// Largest number of VANC words extracted from one row, the multiplexed stream
+// has two samples per pixel
+inline DWORD PixelFormatWordsPerLine(const _pixel_format* pFormat, long nWidth)
+{
+	return (DWORD)(((nWidth + pFormat->group_pixels - 1) / pFormat->group_pixels) * pFormat->group_pixels * 2);
+}
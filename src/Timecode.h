@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// SMPTE ST 12-1 time code label
+struct _smpte_timecode
+{
+	bool	 valid;
+	unsigned char  hours;
+	unsigned char  minutes;
+	unsigned char  seconds;
+	unsigned char  frames;
+	bool	 drop_frame;
+	bool	 field_flag;	// second field of the frame (VITC2 / CDP field flag)
+};
+
+// Combine a BCD tens/units digit pair without branching (tens * 10 + units)
+inline unsigned char DecodeBCD(unsigned int tens, unsigned int units)
+{
+	return (unsigned char)((tens << 3) + (tens << 1) + units);
+}
+
+// Frame count of a time code label at the given nominal (integer) frame rate. A
+// drop frame label (29.97 and 59.94) skips the first 2 frame numbers of every
+// minute, 4 at 60, except in every tenth minute; those numbers are taken back
+// out so consecutive labels are consecutive counts.
+inline LONGLONG TimecodeToFrames(const _smpte_timecode& timecode, long nFrameRate)
+{
+	LONGLONG nMinutes = ((LONGLONG)timecode.hours * 60) + timecode.minutes;
+	LONGLONG nFrames = (((nMinutes * 60) + timecode.seconds) * nFrameRate) + timecode.frames;
+
+	if (timecode.drop_frame && (nFrameRate % 30) == 0)
+		nFrames -= (nFrameRate / 15) * (nMinutes - (nMinutes / 10));
+
+	return nFrames;
+}
@@ -0,0 +1,588 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "VANCAllocator.h"
+
+//
+// CVANCAllocator constructor
+//
+CVANCAllocator::CVANCAllocator(LPCTSTR pName, LPUNKNOWN pUnk, HRESULT* phr) :
+	CBaseAllocator(pName, pUnk, phr),
+	m_lFreeCount(0),
+	m_lWaiters(0),
+	m_hFreeSemaphore(NULL),
+	m_lAlignedSize(0),
+	m_lInitial(1),
+	m_lBudget(VANC_ALLOCATOR_DEFAULT_BUDGET),
+	m_lRequests(0),
+	m_lWindowPeak(0),
+	m_lPeakAllocated(0),
+	m_lGrowths(0),
+	m_lShrinks(0),
+	m_lLargePageBuffers(0),
+	m_lWaits(0),
+	m_llFootprint(0),
+	m_nNumaNode(FRAME_NUMA_NODE_ANY),
+	m_nWorkerNode(FRAME_NUMA_NODE_ANY),
+	m_bPoolPending(FALSE)
+{
+	InitializeSListHead(&m_freeList);
+
+	m_hFreeSemaphore = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+
+	if (m_hFreeSemaphore == NULL && phr != NULL)
+		*phr = E_OUTOFMEMORY;
+}
+
+
+//
+// CVANCAllocator destructor
+//
+CVANCAllocator::~CVANCAllocator()
+{
+	ReleaseAll();
+
+	if (m_hFreeSemaphore != NULL)
+		CloseHandle(m_hFreeSemaphore);
+}
+
+
+//
+// CreateInstance
+//
+// Create an allocator with the given latency budget and NUMA node. The allocator
+// is returned with a reference held for the caller.
+//
+HRESULT CVANCAllocator::CreateInstance(LONG nLatencyBudget, DWORD nNumaNode, CVANCAllocator** ppAllocator)
+{
+	CheckPointer(ppAllocator, E_POINTER);
+
+	HRESULT hr = NOERROR;
+	CVANCAllocator* pAllocator = new CVANCAllocator(NAME("VANC Splitter allocator"), NULL, &hr);
+
+	if (pAllocator == NULL)
+		return E_OUTOFMEMORY;
+
+	if (FAILED(hr))
+	{
+		delete pAllocator;
+		return hr;
+	}
+
+	pAllocator->SetLatencyBudget(nLatencyBudget);
+	pAllocator->SetNumaNode(nNumaNode);
+	pAllocator->AddRef();
+	*ppAllocator = pAllocator;
+
+	return NOERROR;
+} // CreateInstance
+
+
+//
+// SetProperties
+//
+// The requested buffer count is what gets committed up front, the pool grows
+// past it on demand up to the latency budget.
+//
+STDMETHODIMP CVANCAllocator::SetProperties(ALLOCATOR_PROPERTIES* pRequest, ALLOCATOR_PROPERTIES* pActual)
+{
+	CheckPointer(pRequest, E_POINTER);
+	CheckPointer(pActual, E_POINTER);
+
+	CAutoLock cObjectLock(this);
+
+	ALLOCATOR_PROPERTIES request = *pRequest;
+	request.cBuffers = max(request.cBuffers, 1);
+
+	HRESULT hr = CBaseAllocator::SetProperties(&request, pActual);
+
+	if (SUCCEEDED(hr))
+		m_lInitial = pActual->cBuffers;
+
+	return hr;
+} // SetProperties
+
+
+//
+// GetBuffer
+//
+// Pop a sample off the free list. When it is empty and fewer buffers than the
+// budget exist, add one instead of waiting for a sample to come back from
+// downstream.
+//
+STDMETHODIMP CVANCAllocator::GetBuffer(IMediaSample** ppBuffer, REFERENCE_TIME* pStartTime, REFERENCE_TIME* pEndTime, DWORD dwFlags)
+{
+	UNREFERENCED_PARAMETER(pStartTime);
+	UNREFERENCED_PARAMETER(pEndTime);
+	CheckPointer(ppBuffer, E_POINTER);
+
+	CVANCMediaSample* pSample = NULL;
+	*ppBuffer = NULL;
+
+	for (;;)
+	{
+		if (!m_bCommitted)
+			return RejectRequest();
+
+		if ((pSample = PopFree()) != NULL)
+			break;
+
+		{
+			CAutoLock cObjectLock(this);
+
+			if (!m_bCommitted)
+				return RejectRequest();
+
+			// The first request of the streaming thread commits the initial
+			// buffers on its node, as does every buffer added after them
+			if (m_bPoolPending)
+			{
+				m_nWorkerNode = GetCurrentNumaNode();
+				m_bPoolPending = FALSE;
+
+				while (m_lAllocated < m_lInitial)
+				{
+					if (FAILED(AllocSample()))
+						break;
+				}
+
+				if (m_lAllocated == 0)
+					return E_OUTOFMEMORY;
+
+				m_lPeakAllocated = m_lAllocated;
+
+				FilterTrace("CVANCAllocator::GetBuffer() %i x %i bytes committed on node %i (%i on large pages)\n",
+					m_lAllocated, m_lAlignedSize, (int)m_nWorkerNode, m_lLargePageBuffers);
+				continue;
+			}
+
+			if (m_lAllocated < max(m_lBudget, m_lInitial) && SUCCEEDED(AllocSample()))
+			{
+				m_lGrowths++;
+				continue;
+			}
+		}
+
+		if (dwFlags & AM_GBF_NOWAIT)
+			return VFW_E_TIMEOUT;
+
+		// Register as a waiter before the last look at the list so a sample
+		// returned in between always releases the semaphore. Every return
+		// releases it once, so each waiter gets its own wake up; a count left
+		// over by a waiter that found a sample only causes another look.
+		InterlockedIncrement(&m_lWaiters);
+		InterlockedIncrement(&m_lWaits);
+
+		pSample = PopFree();
+
+		if (pSample == NULL && m_bCommitted)
+			WaitForSingleObject(m_hFreeSemaphore, INFINITE);
+
+		InterlockedDecrement(&m_lWaiters);
+
+		if (pSample != NULL)
+			break;
+
+		// Pass a decommit on to any other waiting request
+		if (!m_bCommitted)
+			ReleaseSemaphore(m_hFreeSemaphore, 1, NULL);
+	}
+
+	// A decommit may have started while the sample was taken. The sample goes
+	// back the way ReleaseBuffer returns it, which completes the decommit when it
+	// was the last one out.
+	if (!m_bCommitted)
+	{
+		PushFree(pSample);
+		return RejectRequest();
+	}
+
+	pSample->Acquire();
+	*ppBuffer = pSample;
+
+	// Track how many buffers are held downstream to decide when to shrink
+	LONG lOutstanding = m_lAllocated - m_lFreeCount;
+
+	if (lOutstanding > m_lWindowPeak)
+		m_lWindowPeak = lOutstanding;
+
+	if (InterlockedIncrement(&m_lRequests) >= VANC_ALLOCATOR_TRIM_WINDOW)
+	{
+		CAutoLock cObjectLock(this);
+		Trim();
+	}
+
+	return NOERROR;
+} // GetBuffer
+
+
+//
+// ReleaseBuffer
+//
+// Final release of a sample. Puts it back on the free list and wakes a waiting
+// request, completing a pending decommit with the last buffer.
+//
+STDMETHODIMP CVANCAllocator::ReleaseBuffer(IMediaSample* pSample)
+{
+	CheckPointer(pSample, E_POINTER);
+
+	PushFree((CVANCMediaSample*)(CMediaSample*)pSample);
+
+	if (m_lWaiters > 0)
+		ReleaseSemaphore(m_hFreeSemaphore, 1, NULL);
+
+	BOOL bRelease = CompleteDecommit();
+
+	if (m_pNotify)
+		m_pNotify->NotifyRelease();
+
+	// For each commit there is one AddRef, released with the last buffer of a
+	// pending decommit. This may delete the allocator.
+	if (bRelease)
+		Release();
+
+	return NOERROR;
+} // ReleaseBuffer
+
+
+//
+// Decommit
+//
+// Same as CBaseAllocator::Decommit but counts the lock-free list. The decommit
+// flag is raised before the free count is read, and ReleaseBuffer counts its
+// sample before reading the flag, so the last buffer is never missed.
+//
+STDMETHODIMP CVANCAllocator::Decommit()
+{
+	BOOL bRelease = FALSE;
+
+	{
+		CAutoLock cObjectLock(this);
+
+		if (m_bCommitted == FALSE && m_bDecommitInProgress == FALSE)
+			return NOERROR;
+
+		// No more GetBuffer calls will succeed
+		m_bCommitted = FALSE;
+		InterlockedExchange((volatile LONG*)&m_bDecommitInProgress, TRUE);
+
+		// Complete the decommit here if no buffers are outstanding
+		if (m_lFreeCount == m_lAllocated)
+		{
+			m_bDecommitInProgress = FALSE;
+			Free();
+			bRelease = TRUE;
+		}
+
+		// Tell anyone waiting that they can go now so we can reject their call
+		ReleaseSemaphore(m_hFreeSemaphore, 1, NULL);
+	}
+
+	if (bRelease)
+		Release();
+
+	return NOERROR;
+} // Decommit
+
+
+//
+// SetLatencyBudget
+//
+void CVANCAllocator::SetLatencyBudget(LONG nFrames)
+{
+	CAutoLock cObjectLock(this);
+	m_lBudget = min(max(nFrames, 1), VANC_ALLOCATOR_MAX_BUDGET);
+} // SetLatencyBudget
+
+
+//
+// GetLatencyBudget
+//
+LONG CVANCAllocator::GetLatencyBudget()
+{
+	CAutoLock cObjectLock(this);
+	return m_lBudget;
+} // GetLatencyBudget
+
+
+//
+// SetNumaNode
+//
+// Node the frame buffers are committed on. FRAME_NUMA_NODE_ANY follows the
+// streaming thread. Takes effect for buffers committed after the call.
+//
+void CVANCAllocator::SetNumaNode(DWORD nNode)
+{
+	CAutoLock cObjectLock(this);
+	m_nNumaNode = nNode;
+} // SetNumaNode
+
+
+//
+// GetStats
+//
+void CVANCAllocator::GetStats(_vanc_allocator_stats* pStats)
+{
+	CAutoLock cObjectLock(this);
+
+	pStats->nBuffers = m_lAllocated;
+	pStats->nPeakBuffers = m_lPeakAllocated;
+	pStats->nGrowths = m_lGrowths;
+	pStats->nShrinks = m_lShrinks;
+	pStats->nLargePageBuffers = m_lLargePageBuffers;
+	pStats->nWaits = m_lWaits;
+	pStats->nFootprint = m_llFootprint;
+} // GetStats
+
+
+//
+// Alloc
+//
+// Called from Commit to create the initial buffers
+//
+HRESULT CVANCAllocator::Alloc()
+{
+	CAutoLock cObjectLock(this);
+
+	HRESULT hr = CBaseAllocator::Alloc();
+
+	if (FAILED(hr))
+		return hr;
+
+	// The requirements have not changed and the buffers are still there
+	if (hr == S_FALSE)
+		return NOERROR;
+
+	LARGE_INTEGER start, end, frequency;
+	QueryPerformanceCounter(&start);
+
+	ReleaseAll();
+
+	// Compute the aligned buffer size
+	LONGLONG lAlignedSize = (LONGLONG)m_lSize + m_lPrefix;
+
+	if (m_lAlignment > 1)
+		lAlignedSize = ((lAlignedSize + m_lAlignment - 1) / m_lAlignment) * m_lAlignment;
+
+	if (lAlignedSize > MAXLONG)
+		return E_OUTOFMEMORY;
+
+	m_lAlignedSize = (LONG)lAlignedSize;
+	m_lRequests = 0;
+	m_lWindowPeak = 0;
+	m_bChanged = FALSE;
+
+	// Buffers following the streaming thread wait until it asks for one
+	m_bPoolPending = (m_nNumaNode == FRAME_NUMA_NODE_ANY);
+
+	if (m_bPoolPending)
+	{
+		m_lPeakAllocated = 0;
+		return NOERROR;
+	}
+
+	while (m_lAllocated < m_lInitial)
+	{
+		if (FAILED(hr = AllocSample()))
+		{
+			ReleaseAll();
+			return hr;
+		}
+	}
+
+	m_lPeakAllocated = m_lAllocated;
+
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+
+	FilterTrace("CVANCAllocator::Alloc() %i x %i bytes committed in %.3f ms (budget %i, %i on large pages)\n",
+		m_lAllocated, m_lAlignedSize, (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart, m_lBudget, m_lLargePageBuffers);
+
+	return NOERROR;
+} // Alloc
+
+
+//
+// Free
+//
+// Called once every buffer is back after a Decommit. Unlike CMemAllocator the
+// memory is released right away so a stopped graph holds no frame buffers.
+//
+void CVANCAllocator::Free()
+{
+	ReleaseAll();
+	m_bChanged = TRUE;
+} // Free
+
+
+//
+// AllocSample
+//
+// Add one buffer to the free list (object locked by caller)
+//
+HRESULT CVANCAllocator::AllocSample()
+{
+	HRESULT hr = NOERROR;
+	_frame_buffer_info info;
+	BYTE* pBuffer = AllocFrameBuffer(m_lAlignedSize, m_lAlignment, (m_nNumaNode != FRAME_NUMA_NODE_ANY) ? m_nNumaNode : m_nWorkerNode, &info);
+
+	if (pBuffer == NULL)
+		return E_OUTOFMEMORY;
+
+	CVANCMediaSample* pSample = new CVANCMediaSample(NAME("VANC Splitter media sample"), this, &hr, pBuffer, info, m_lPrefix, m_lSize);
+
+	if (pSample == NULL || FAILED(hr))
+	{
+		delete pSample;
+		FreeFrameBuffer(pBuffer, info);
+		return E_OUTOFMEMORY;
+	}
+
+	PushFree(pSample);
+	m_llFootprint += info.cbCommitted;
+	m_lLargePageBuffers += info.bLargePages ? 1 : 0;
+	m_lAllocated++;
+	m_lCount = m_lAllocated;
+	m_lPeakAllocated = max(m_lPeakAllocated, m_lAllocated);
+
+	return NOERROR;
+} // AllocSample
+
+
+//
+// FreeSample
+//
+// Delete a sample taken off the free list and its buffer (object locked by caller)
+//
+void CVANCAllocator::FreeSample(CVANCMediaSample* pSample)
+{
+	m_llFootprint -= pSample->m_info.cbCommitted;
+	m_lLargePageBuffers -= pSample->m_info.bLargePages ? 1 : 0;
+
+	FreeFrameBuffer(pSample->m_pMemory, pSample->m_info);
+	delete pSample;
+
+	m_lAllocated--;
+	m_lCount = max(m_lAllocated, m_lInitial);
+} // FreeSample
+
+
+//
+// PushFree
+//
+void CVANCAllocator::PushFree(CVANCMediaSample* pSample)
+{
+	InterlockedPushEntrySList(&m_freeList, &pSample->m_entry);
+	InterlockedIncrement(&m_lFreeCount);
+} // PushFree
+
+
+//
+// PopFree
+//
+// The count is taken before the pop and given back when the list was empty, as
+// PushFree counts after the push. The count never exceeds the samples on the
+// list, so Decommit cannot see every buffer back while a request holds one it
+// has just popped.
+//
+CVANCMediaSample* CVANCAllocator::PopFree()
+{
+	InterlockedDecrement(&m_lFreeCount);
+
+	PSLIST_ENTRY pEntry = InterlockedPopEntrySList(&m_freeList);
+
+	if (pEntry == NULL)
+	{
+		InterlockedIncrement(&m_lFreeCount);
+		return NULL;
+	}
+
+	return CONTAINING_RECORD(pEntry, CVANCMediaSample, m_entry);
+} // PopFree
+
+
+//
+// CompleteDecommit
+//
+// Free the pool once every buffer is back after a Decommit. Returns TRUE when
+// the caller is to release the reference held for the commit.
+//
+BOOL CVANCAllocator::CompleteDecommit()
+{
+	if (!m_bDecommitInProgress)
+		return FALSE;
+
+	CAutoLock cObjectLock(this);
+
+	if (!m_bDecommitInProgress || m_lFreeCount != m_lAllocated)
+		return FALSE;
+
+	m_bDecommitInProgress = FALSE;
+	Free();
+	return TRUE;
+} // CompleteDecommit
+
+
+//
+// RejectRequest
+//
+// Fail a buffer request because of a decommit. A request that had a sample or
+// a count in hand when Decommit looked completes the decommit itself.
+//
+HRESULT CVANCAllocator::RejectRequest()
+{
+	// For each commit there is one AddRef, released with the last buffer
+	if (CompleteDecommit())
+		Release();
+
+	return VFW_E_NOT_COMMITTED;
+} // RejectRequest
+
+
+//
+// ReleaseAll
+//
+void CVANCAllocator::ReleaseAll()
+{
+	// Should never be called unless all buffers are back
+	ASSERT(m_lAllocated == m_lFreeCount);
+
+	CVANCMediaSample* pSample;
+
+	while ((pSample = PopFree()) != NULL)
+		FreeSample(pSample);
+
+	m_lCount = m_lInitial;
+} // ReleaseAll
+
+
+//
+// Trim
+//
+// Release buffers that were not needed during the last trim window, keeping one
+// spare above the peak so a steady stream does not grow straight back.
+//
+void CVANCAllocator::Trim()
+{
+	LONG lTarget = max(m_lInitial, m_lWindowPeak + 1);
+
+	while (m_lAllocated > lTarget)
+	{
+		CVANCMediaSample* pSample = PopFree();
+
+		if (pSample == NULL)
+			break;
+
+		FreeSample(pSample);
+		m_lShrinks++;
+	}
+
+	m_lRequests = 0;
+	m_lWindowPeak = 0;
+} // Trim
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+#include "FrameMemory.h"
+
+#define VANC_ALLOCATOR_DEFAULT_BUDGET	8		// frames
+#define VANC_ALLOCATOR_MAX_BUDGET		120		// frames
+#define VANC_ALLOCATOR_TRIM_WINDOW		300		// buffer requests between shrink checks
+
+// Pool usage reported through the splitter statistics
+struct _vanc_allocator_stats
+{
+	LONG nBuffers;			// buffers currently allocated
+	LONG nPeakBuffers;		// largest pool size since commit
+	LONG nGrowths;			// buffers added because the free list ran dry
+	LONG nShrinks;			// idle buffers released
+	LONG nLargePageBuffers;	// buffers backed by large pages
+	LONG nWaits;			// requests that had to wait for a buffer to come back
+	LONGLONG nFootprint;	// bytes currently committed
+};
+
+//
+// CVANCMediaSample
+//
+// Media sample that remembers how its frame buffer was committed and links
+// itself into the allocator's lock-free free list
+//
+class CVANCMediaSample : public CMediaSample
+{
+	public:
+		CVANCMediaSample(LPCTSTR pName, CBaseAllocator* pAllocator, HRESULT* phr, BYTE* pMemory, const _frame_buffer_info& info, LONG lPrefix, LONG lLength) :
+			CMediaSample(pName, pAllocator, phr, pMemory + lPrefix, lLength),
+			m_pMemory(pMemory),
+			m_info(info)
+		{
+		}
+
+		// Hand out the sample with a single reference (as CBaseAllocator::GetBuffer does)
+		void Acquire()
+		{
+			ASSERT(m_cRef == 0);
+			m_cRef = 1;
+		}
+
+		SLIST_ENTRY m_entry;		// free list link
+		BYTE* m_pMemory;			// start of the committed block (before the prefix)
+		_frame_buffer_info m_info;
+};
+
+//
+// CVANCAllocator
+//
+// Media sample allocator that commits only the buffer count requested at connect
+// time and grows on demand while the number of samples held downstream stays
+// within a latency budget (in frames). Buffers that stay idle for a full trim
+// window are released again. Frame sized buffers are placed on large pages
+// where the host enabled the lock memory privilege, on the NUMA node of the streaming thread
+// unless a node is set. Following the streaming thread, the initial buffers are
+// committed by its first GetBuffer call rather than by Commit, which usually
+// runs on the application thread.
+//
+// Free samples are kept on an interlocked singly linked list (whose header
+// carries a sequence number against ABA) instead of the locked CSampleList, so
+// GetBuffer and ReleaseBuffer take no lock while buffers are available. The
+// allocator lock is only taken to grow, shrink, commit or decommit the pool, and
+// a request only waits on a semaphore when the list is empty at the budget.
+//
+class CVANCAllocator : public CBaseAllocator
+{
+	public:
+		CVANCAllocator(LPCTSTR pName, LPUNKNOWN pUnk, HRESULT* phr);
+		~CVANCAllocator();
+
+		static HRESULT CreateInstance(LONG nLatencyBudget, DWORD nNumaNode, CVANCAllocator** ppAllocator);
+
+		STDMETHODIMP SetProperties(ALLOCATOR_PROPERTIES* pRequest, ALLOCATOR_PROPERTIES* pActual);
+		STDMETHODIMP GetBuffer(IMediaSample** ppBuffer, REFERENCE_TIME* pStartTime, REFERENCE_TIME* pEndTime, DWORD dwFlags);
+		STDMETHODIMP ReleaseBuffer(IMediaSample* pSample);
+		STDMETHODIMP Decommit();
+
+		void SetLatencyBudget(LONG nFrames);
+		LONG GetLatencyBudget();
+		void SetNumaNode(DWORD nNode);
+		void GetStats(_vanc_allocator_stats* pStats);
+
+	protected:
+		HRESULT Alloc();
+		void Free();
+
+	private:
+		HRESULT AllocSample();
+		void FreeSample(CVANCMediaSample* pSample);
+		void PushFree(CVANCMediaSample* pSample);
+		CVANCMediaSample* PopFree();
+		BOOL CompleteDecommit();
+		HRESULT RejectRequest();
+		void ReleaseAll();
+		void Trim();
+
+		SLIST_HEADER m_freeList;	// free samples
+		volatile LONG m_lFreeCount;	// samples on the free list, never more than the list holds
+		volatile LONG m_lWaiters;	// requests waiting for a sample
+		HANDLE m_hFreeSemaphore;	// released once per sample returned while a request waits
+
+		LONG m_lAlignedSize;		// buffer size including prefix and alignment padding
+		LONG m_lInitial;			// buffers committed up front
+		LONG m_lBudget;				// most buffers the pool may grow to
+		volatile LONG m_lRequests;	// buffer requests in the current trim window
+		LONG m_lWindowPeak;			// most buffers outstanding in the current trim window
+		LONG m_lPeakAllocated;
+		LONG m_lGrowths;
+		LONG m_lShrinks;
+		LONG m_lLargePageBuffers;
+		volatile LONG m_lWaits;
+		LONGLONG m_llFootprint;		// bytes committed, including large page rounding
+		DWORD m_nNumaNode;			// preferred node (FRAME_NUMA_NODE_ANY = the worker's node)
+		DWORD m_nWorkerNode;		// node of the thread requesting buffers
+		BOOL m_bPoolPending;		// initial buffers wait for the first request to learn its node
+};
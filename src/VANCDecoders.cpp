@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCDecoders.h"
+
+// Caption distribution packet (SMPTE ST 334). Parsing is left to VANCParser, the
+// decoder only records where the packets are. A packet that fails its checksum
+// is counted and left out like any other corrupted ANC packet.
+static void DecodeCDP(const _anc_packet_entry& packet, _vanc_frame_data& frame)
+{
+	if (!packet.checksum_ok)
+		frame.nCDPChecksumErrors++;
+	else if (frame.nCDPCount < VANC_FRAME_MAX_CDP)
+		frame.pCDP[frame.nCDPCount++] = &packet;
+}
+
+// AFD and bar data (SMPTE ST 2016-3)
+static void DecodeAFD(const _anc_packet_entry& packet, _vanc_frame_data& frame)
+{
+	if (!packet.checksum_ok || packet.dc < 8)
+		return;
+
+	const __int16* udw = packet.words + ANC_WORD_UDW;
+
+	frame.afd_present = true;
+	frame.afd_code = (unsigned char)((udw[0] >> 3) & 0x0F);
+	frame.afd_aspect_16_9 = (udw[0] & 0x04) == 0x04;
+	frame.bar_flags = (unsigned char)((udw[3] >> 4) & 0x0F);
+	frame.bar_value_1 = (unsigned short)(((udw[4] & 0xff) << 8) | (udw[5] & 0xff));
+	frame.bar_value_2 = (unsigned short)(((udw[6] & 0xff) << 8) | (udw[7] & 0xff));
+}
+
+// Ancillary time code (SMPTE ST 12-2). Each of the 16 UDWs carries four time code
+// bits in b7-b4 and one distributed binary bit (DBB) in b3.
+static void DecodeATC(const _anc_packet_entry& packet, _vanc_frame_data& frame)
+{
+	if (!packet.checksum_ok || packet.dc < 16)
+		return;
+
+	const __int16* udw = packet.words + ANC_WORD_UDW;
+
+	// DBB1 (UDW1-8) identifies the payload: 0x00 LTC, 0x01 VITC1, 0x02 VITC2
+	unsigned char dbb1 = 0;
+
+	for (int i = 0; i < 8; i++)
+		dbb1 |= (unsigned char)(((udw[i] >> 3) & 1) << i);
+
+	// Keep an LTC once one has been seen in the frame
+	if (dbb1 > 0x02 || (frame.timecode.valid && frame.timecode_dbb1 <= dbb1))
+		return;
+
+	unsigned int frameUnits = (udw[0] >> 4) & 0xF;
+	unsigned int frameTens = (udw[2] >> 4) & 0xF;
+	unsigned int secondUnits = (udw[4] >> 4) & 0xF;
+	unsigned int secondTens = (udw[6] >> 4) & 0xF;
+	unsigned int minuteUnits = (udw[8] >> 4) & 0xF;
+	unsigned int minuteTens = (udw[10] >> 4) & 0xF;
+	unsigned int hourUnits = (udw[12] >> 4) & 0xF;
+	unsigned int hourTens = (udw[14] >> 4) & 0xF;
+
+	frame.timecode.frames = DecodeBCD(frameTens & 0x3, frameUnits);
+	frame.timecode.seconds = DecodeBCD(secondTens & 0x7, secondUnits);
+	frame.timecode.minutes = DecodeBCD(minuteTens & 0x7, minuteUnits);
+	frame.timecode.hours = DecodeBCD(hourTens & 0x3, hourUnits);
+	frame.timecode.drop_frame = ((frameTens >> 2) & 1) != 0;
+	frame.timecode.field_flag = (dbb1 == 0x02);
+	frame.timecode.valid = true;
+	frame.timecode_dbb1 = dbb1;
+}
+
+// SCTE-104 messages (SMPTE ST 2010) are handed to the consumer as-is
+static void DecodeSCTE104(const _anc_packet_entry& packet, _vanc_frame_data& frame)
+{
+	if (packet.checksum_ok && frame.nSCTE104Count < VANC_FRAME_MAX_SCTE104)
+		frame.pSCTE104[frame.nSCTE104Count++] = &packet;
+}
+
+// Decoders registered at compile time. Vendor specific decoders can be added to a
+// build by defining VANC_VENDOR_DECODERS as a list of additional entries.
+static constexpr _vanc_decoder_entry g_vancDecoders[] =
+{
+	{ ANC_DID_CDP,		ANC_SDID_CDP,		DecodeCDP },
+	{ ANC_DID_AFD,		ANC_SDID_AFD,		DecodeAFD },
+	{ ANC_DID_SCTE104,	ANC_SDID_SCTE104,	DecodeSCTE104 },
+	{ ANC_DID_ATC,		ANC_SDID_ATC,		DecodeATC },
+#ifdef VANC_VENDOR_DECODERS
+	VANC_VENDOR_DECODERS
+#endif
+};
+
+static constexpr VANCDispatchTable g_vancDispatch = BuildVANCDispatchTable(g_vancDecoders);
+
+// Clear the decoded content ahead of a new frame
+void ResetVANCFrameData(_vanc_frame_data& frame)
+{
+	frame.nCDPCount = 0;
+	frame.nCDPChecksumErrors = 0;
+	frame.afd_present = false;
+	frame.timecode.valid = false;
+	frame.nSCTE104Count = 0;
+}
+
+// Hand every indexed packet to the decoder registered for its DID/SDID
+void DispatchVANCPackets(const VANCIndex& index, _vanc_frame_data& frame)
+{
+	long nCount = index.GetCount();
+
+	for (long i = 0; i < nCount; i++)
+	{
+		const _anc_packet_entry* pEntry = index.GetEntry(i);
+		unsigned char slot = g_vancDispatch.slot[pEntry->did][pEntry->sdid];
+
+		if (slot != 0)
+			g_vancDecoders[slot - 1].proc(*pEntry, frame);
+	}
+}
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "VANCIndex.h"
+#include "Timecode.h"
+
+#define VANC_FRAME_MAX_CDP		8
+#define VANC_FRAME_MAX_SCTE104	4
+
+// Decoded ANC content of a single frame, filled in by the registered decoders
+struct _vanc_frame_data
+{
+	// Caption distribution packets in sweep order
+	long nCDPCount;
+	const _anc_packet_entry* pCDP[VANC_FRAME_MAX_CDP];
+	long nCDPChecksumErrors;		// CDPs left out because their ANC checksum failed
+
+	// AFD and bar data
+	bool	 afd_present;
+	unsigned char  afd_code;		// 4-bit active format description
+	bool	 afd_aspect_16_9;		// coded frame aspect ratio (false = 4:3)
+	unsigned char  bar_flags;		// top, bottom, left, right bar flags (bits 3-0)
+	unsigned short bar_value_1;
+	unsigned short bar_value_2;
+
+	// Ancillary time code (LTC preferred over VITC)
+	_smpte_timecode timecode;
+	unsigned char  timecode_dbb1;	// ATC payload type of the time code used
+
+	// SCTE-104 messages (passed through undecoded)
+	long nSCTE104Count;
+	const _anc_packet_entry* pSCTE104[VANC_FRAME_MAX_SCTE104];
+};
+
+// Decoder invoked once for every indexed packet registered against its DID/SDID
+typedef void (*VANCDecodeProc)(const _anc_packet_entry& packet, _vanc_frame_data& frame);
+
+struct _vanc_decoder_entry
+{
+	unsigned char did;
+	unsigned char sdid;
+	VANCDecodeProc proc;
+};
+
+// DID/SDID jump table. A slot of zero means no decoder is registered, otherwise
+// the slot is the 1-based position of the decoder in the registration list.
+struct VANCDispatchTable
+{
+	unsigned char slot[256][256];
+};
+
+template <size_t N>
+constexpr VANCDispatchTable BuildVANCDispatchTable(const _vanc_decoder_entry (&decoders)[N])
+{
+	static_assert(N < 256, "too many VANC decoders registered");
+
+	VANCDispatchTable table = {};
+
+	for (size_t i = 0; i < N; i++)
+		table.slot[decoders[i].did][decoders[i].sdid] = (unsigned char)(i + 1);
+
+	return table;
+}
+
+void ResetVANCFrameData(_vanc_frame_data& frame);
+void DispatchVANCPackets(const VANCIndex& index, _vanc_frame_data& frame);
@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCEncoder.h"
+
+// Frame period (100 ns) and cc_count of each cdp_frame_rate (CEA-708 Table 3)
+static const struct
+{
+	REFERENCE_TIME avgTimePerFrame;
+	unsigned char frameRate;
+	long nCCCount;
+} g_cdpFrameRates[] =
+{
+	{ 417083, CDP_FRAME_RATE_23_976, 25 },
+	{ 416667, CDP_FRAME_RATE_24, 25 },
+	{ 400000, CDP_FRAME_RATE_25, 24 },
+	{ 333667, CDP_FRAME_RATE_29_97, 20 },
+	{ 333333, CDP_FRAME_RATE_30, 20 },
+	{ 200000, CDP_FRAME_RATE_50, 12 },
+	{ 166833, CDP_FRAME_RATE_59_94, 10 },
+	{ 166667, CDP_FRAME_RATE_60, 10 }
+};
+
+// 8-bit value as a 10-bit ANC word, b8 is even parity and b9 its inverse
+static inline __int16 AncWord(unsigned char value)
+{
+	unsigned int parity = value;
+	parity ^= parity >> 4;
+	parity ^= parity >> 2;
+	parity ^= parity >> 1;
+	parity &= 1;
+
+	return (__int16)(value | (parity << 8) | ((parity ^ 1) << 9));
+}
+
+// BCD digit pair of a time code field
+static inline unsigned char EncodeBCD(unsigned char value)
+{
+	return (unsigned char)(((value / 10) << 4) | (value % 10));
+}
+
+VANCEncoder::VANCEncoder(void) : m_frameRate(CDP_FRAME_RATE_29_97), m_nCCCount(20), m_nSequence(0)
+{
+}
+
+VANCEncoder::~VANCEncoder(void)
+{
+}
+
+// Restart the CDP sequence counter
+void VANCEncoder::Reset()
+{
+	m_nSequence = 0;
+}
+
+// Pick the cdp_frame_rate closest to the frame period, 29.97 when it is unknown
+void VANCEncoder::SetFrameRate(REFERENCE_TIME avgTimePerFrame)
+{
+	int nBest = 0;
+	REFERENCE_TIME bestDistance = -1;
+
+	if (avgTimePerFrame <= 0)
+		avgTimePerFrame = 333667;
+
+	for (int i = 0; i < (int)(sizeof(g_cdpFrameRates) / sizeof(g_cdpFrameRates[0])); i++)
+	{
+		REFERENCE_TIME distance = g_cdpFrameRates[i].avgTimePerFrame - avgTimePerFrame;
+
+		if (distance < 0)
+			distance = -distance;
+
+		if (bestDistance < 0 || distance < bestDistance)
+		{
+			nBest = i;
+			bestDistance = distance;
+		}
+	}
+
+	m_frameRate = g_cdpFrameRates[nBest].frameRate;
+	m_nCCCount = g_cdpFrameRates[nBest].nCCCount;
+}
+
+// Build a CDP from up to GetCCCount() cc_data triplets. The time code section is
+// added when pTimecode is valid. Returns the CDP length in bytes.
+long VANCEncoder::EncodeCDP(const BYTE (*ccData)[3], long nCCData, const _smpte_timecode* pTimecode, BYTE* pCDP)
+{
+	bool bTimecode = (pTimecode != NULL && pTimecode->valid);
+	long n = 0;
+
+	// cdp_header
+	pCDP[n++] = 0x96;
+	pCDP[n++] = 0x69;
+	pCDP[n++] = 0;										// cdp_length, set below
+	pCDP[n++] = (BYTE)((m_frameRate << 4) | 0x0F);
+	pCDP[n++] = (BYTE)((bTimecode ? 0x80 : 0x00) | 0x40 | 0x02 | 0x01);	// ccdata_present, caption_service_active
+	pCDP[n++] = (BYTE)(m_nSequence >> 8);
+	pCDP[n++] = (BYTE)(m_nSequence & 0xff);
+
+	// time_code_section
+	if (bTimecode)
+	{
+		pCDP[n++] = 0x71;
+		pCDP[n++] = (BYTE)(0xC0 | EncodeBCD(pTimecode->hours));
+		pCDP[n++] = (BYTE)(0x80 | EncodeBCD(pTimecode->minutes));
+		pCDP[n++] = (BYTE)((pTimecode->field_flag ? 0x80 : 0x00) | EncodeBCD(pTimecode->seconds));
+		pCDP[n++] = (BYTE)((pTimecode->drop_frame ? 0x80 : 0x00) | EncodeBCD(pTimecode->frames));
+	}
+
+	// ccdata_section, padded to the cc_count of the frame rate
+	pCDP[n++] = 0x72;
+	pCDP[n++] = (BYTE)(0xE0 | m_nCCCount);
+
+	for (long i = 0; i < m_nCCCount; i++)
+	{
+		if (i < nCCData)
+		{
+			pCDP[n++] = (BYTE)(0xF8 | (ccData[i][0] & 0x07));
+			pCDP[n++] = ccData[i][1];
+			pCDP[n++] = ccData[i][2];
+		}
+		else
+		{
+			pCDP[n++] = 0xFA;
+			pCDP[n++] = 0x00;
+			pCDP[n++] = 0x00;
+		}
+	}
+
+	// cdp_footer, the packet checksum makes the byte sum of the CDP zero
+	pCDP[n++] = 0x74;
+	pCDP[n++] = (BYTE)(m_nSequence >> 8);
+	pCDP[n++] = (BYTE)(m_nSequence & 0xff);
+	pCDP[2] = (BYTE)(n + 1);
+
+	BYTE sum = 0;
+
+	for (long i = 0; i < n; i++)
+		sum = (BYTE)(sum + pCDP[i]);
+
+	pCDP[n++] = (BYTE)(0 - sum);
+
+	m_nSequence++;
+	return n;
+}
+
+// Build the CDP and its ANC packet. pWords holds ANC_MAX_PACKET_WORDS words.
+// Returns the packet length in words.
+long VANCEncoder::Encode(const BYTE (*ccData)[3], long nCCData, const _smpte_timecode* pTimecode, __int16* pWords)
+{
+	BYTE cdp[CDP_MAX_LENGTH];
+	long nLength = EncodeCDP(ccData, nCCData, pTimecode, cdp);
+
+	return EncodeANC(ANC_DID_CDP, ANC_SDID_CDP, cdp, nLength, pWords);
+}
+
+// Wrap user data words in an ST 291 packet: ADF, DID, SDID, DC, UDW and the 9-bit
+// checksum of DID through the last UDW. Returns the packet length in words.
+long VANCEncoder::EncodeANC(unsigned char did, unsigned char sdid, const BYTE* pUDW, long nUDW, __int16* pWords)
+{
+	pWords[ANC_WORD_ADF_1] = 0x000;
+	pWords[ANC_WORD_ADF_2] = 0x3ff;
+	pWords[ANC_WORD_ADF_3] = 0x3ff;
+	pWords[ANC_WORD_DID] = AncWord(did);
+	pWords[ANC_WORD_SDID] = AncWord(sdid);
+	pWords[ANC_WORD_DC] = AncWord((unsigned char)nUDW);
+
+	for (long i = 0; i < nUDW; i++)
+		pWords[ANC_WORD_UDW + i] = AncWord(pUDW[i]);
+
+	unsigned short sum = 0;
+
+	for (long i = ANC_WORD_DID; i < ANC_WORD_UDW + nUDW; i++)
+		sum += (unsigned short)(pWords[i] & 0x1ff);
+
+	// b9 of the checksum word is the inverse of b8
+	sum &= 0x1ff;
+	pWords[ANC_WORD_UDW + nUDW] = (__int16)(sum | ((~sum & 0x100) << 1));
+
+	return ANC_WORD_UDW + nUDW + 1;
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "VANCParser.h"
+#include "VANCIndex.h"
+
+// cdp_frame_rate codes (SMPTE ST 334-2)
+enum cdp_frame_rate
+{
+	CDP_FRAME_RATE_23_976 = 1,
+	CDP_FRAME_RATE_24 = 2,
+	CDP_FRAME_RATE_25 = 3,
+	CDP_FRAME_RATE_29_97 = 4,
+	CDP_FRAME_RATE_30 = 5,
+	CDP_FRAME_RATE_50 = 6,
+	CDP_FRAME_RATE_59_94 = 7,
+	CDP_FRAME_RATE_60 = 8
+};
+
+// Largest CDP: header, time code section, cc_data section and footer
+#define CDP_MAX_LENGTH (7 + 5 + 2 + (CDP_MAX_CC_COUNT * 3) + 4)
+
+// Words of the ANC packet carrying the largest CDP (ADF through checksum)
+#define ANC_MAX_PACKET_WORDS (ANC_WORD_UDW + CDP_MAX_LENGTH + 1)
+
+// Builds ST 334 caption distribution packets and wraps them in ST 291 ANC packets,
+// the reverse of VANCParser. cc_data triplets are given as the cc_valid / cc_type
+// byte followed by the two data bytes; the marker bits are filled in. A CDP always
+// carries the cc_count of its frame rate, unused entries are padding.
+class VANCEncoder
+{
+	public:
+		VANCEncoder(void);
+		~VANCEncoder(void);
+
+	public:
+		void Reset();
+		void SetFrameRate(REFERENCE_TIME avgTimePerFrame);
+		long GetCCCount() const { return m_nCCCount; }
+		long EncodeCDP(const BYTE (*ccData)[3], long nCCData, const _smpte_timecode* pTimecode, BYTE* pCDP);
+		long Encode(const BYTE (*ccData)[3], long nCCData, const _smpte_timecode* pTimecode, __int16* pWords);
+		static long EncodeANC(unsigned char did, unsigned char sdid, const BYTE* pUDW, long nUDW, __int16* pWords);
+
+	private:
+		unsigned char m_frameRate;
+		long m_nCCCount;
+		unsigned short m_nSequence;
+};
@@ -0,0 +1,264 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "VANCFrameExtractor.h"
+
+VANCFrameExtractor::VANCFrameExtractor(void) :
+	m_pFormat(NULL),
+	m_dwWordsPerLine(0),
+	m_pVANCData(NULL),
+	m_pFieldBuffer(NULL),
+	m_nCaptions(0)
+{
+	ZeroMemory(&m_layout, sizeof(m_layout));
+	ZeroMemory(&m_stats, sizeof(m_stats));
+	ResetVANCFrameData(m_frame);
+}
+
+VANCFrameExtractor::~VANCFrameExtractor(void)
+{
+	Free();
+}
+
+// Work out the layout of the frames and allocate the unpacked VANC rows and the
+// field buffer of the picture copy
+HRESULT VANCFrameExtractor::SetFormat(const _pixel_format* pFormat, long nWidth, long nHeight, bool bInterlaced)
+{
+	Free();
+
+	m_pFormat = pFormat;
+	ComputeFrameLayout(pFormat, nWidth, nHeight, bInterlaced, &m_layout);
+
+	// Room for the VANC words of one frame row in any extraction mode
+	m_dwWordsPerLine = PixelFormatWordsPerLine(pFormat, nWidth);
+	m_pVANCData = (__int16*)malloc(((m_dwWordsPerLine * m_layout.nVANCRows) + PIXEL_FORMAT_WORD_SLACK) * sizeof(__int16));
+
+	if (m_pVANCData == NULL)
+		return E_OUTOFMEMORY;
+
+	if (FrameLayoutFieldBufferLength(m_layout) > 0)
+	{
+		m_pFieldBuffer = (BYTE*)malloc(FrameLayoutFieldBufferLength(m_layout));
+
+		if (m_pFieldBuffer == NULL)
+		{
+			Free();
+			return E_OUTOFMEMORY;
+		}
+	}
+
+	return S_OK;
+}
+
+// Release the buffers of SetFormat
+void VANCFrameExtractor::Free()
+{
+	if (m_pVANCData != NULL)
+		free (m_pVANCData);
+
+	if (m_pFieldBuffer != NULL)
+		free (m_pFieldBuffer);
+
+	m_pVANCData = NULL;
+	m_pFieldBuffer = NULL;
+	m_nCaptions = 0;
+	ResetVANCFrameData(m_frame);
+}
+
+// Forget the CDP sequence and the caption services, for a new stream
+void VANCFrameExtractor::Reset()
+{
+	m_continuity.Reset();
+	m_parser.ResetServices();
+	m_nCaptions = 0;
+}
+
+// Sweep the VANC rows of each field, or only nOnlyRow when it is set, index
+// their ANC packets and run the registered decoders. The picture rows are never
+// touched.
+void VANCFrameExtractor::ScanFrame(const BYTE* pFrame, PFN_EXTRACT_LINE pfnExtract, long nScanWidth, DWORD dwScanLeadIn, long nOnlyRow)
+{
+	ASSERT(m_pVANCData != NULL);
+
+	__int16* pLine = m_pVANCData;
+	DWORD dwRowBytes = m_pFormat->pfnStride(nScanWidth);
+	long nRows = 0;
+
+	if (pfnExtract == m_pFormat->pfnExtractMultiplexed)
+		dwRowBytes *= m_pFormat->planes;
+
+	m_index.Reset();
+
+	for (long nField = 0; nField < m_layout.nFields; nField++)
+	{
+		for (long i = 0; i < m_layout.vanc[nField].nRows; i++, pLine += m_dwWordsPerLine)
+		{
+			long nRow = FrameLayoutVANCRow(m_layout, nField, i);
+
+			if (nOnlyRow >= 0 && nRow != nOnlyRow)
+				continue;
+
+			// Convert the row to a word array of VANC data and index its ANC packets
+			DWORD dwWords = pfnExtract(pFrame, m_layout.dwStride, m_layout.nHeight, nRow, nScanWidth, pLine);
+			m_index.IndexLine(pLine, dwWords, (unsigned short)nRow, m_pFormat->checksum_mask, dwScanLeadIn);
+			nRows++;
+		}
+	}
+
+	m_stats.llVANCBytesRead += (LONGLONG)dwRowBytes * nRows;
+
+	ResetVANCFrameData(m_frame);
+	DispatchVANCPackets(m_index, m_frame);
+	m_stats.nCDPChecksumErrors += m_frame.nCDPChecksumErrors;
+	m_nCaptions = 0;
+}
+
+// Copy the picture rows over the VANC rows or to pPicture, returns the bytes copied
+DWORD VANCFrameExtractor::CopyPicture(const BYTE* pFrame, BYTE* pPicture)
+{
+	DWORD dwCopied = FrameLayoutCopyPicture(m_layout, pFrame, pPicture, m_pFieldBuffer);
+
+	m_stats.llBytesCopied += dwCopied;
+	return dwCopied;
+}
+
+// Build the caption records of every CDP of the frame in sweep order, field 1
+// then field 2. A CDP gets an equal share of the time of its field (the whole
+// frame when progressive) and each of its pairs an equal share of the CDP time.
+// Without bDeliver only the CDP continuity is tracked. Returns the record count.
+long VANCFrameExtractor::ParseCaptions(REFERENCE_TIME tStart, REFERENCE_TIME tEnd, REFERENCE_TIME rtStart, REFERENCE_TIME rtEnd,
+	cc_packet_type packetType, LONG nPaddingMode, long nTimecodeRate, bool bDeliver)
+{
+	BYTE line21Pairs[CDP_MAX_CC_COUNT][2];
+	long nCDPField[VANC_FRAME_MAX_CDP];
+	long nFieldCDPs[FRAME_LAYOUT_MAX_FIELDS] = { 0 };
+	long nFieldPos[FRAME_LAYOUT_MAX_FIELDS] = { 0 };
+	long nParsed = 0;
+	long nPadding = 0;
+
+	m_nCaptions = 0;
+
+	for (long i = 0; i < m_frame.nCDPCount; i++)
+	{
+		nCDPField[i] = FrameLayoutFieldOfRow(m_layout, m_frame.pCDP[i]->line);
+		nFieldCDPs[nCDPField[i]]++;
+	}
+
+	REFERENCE_TIME tField = (tEnd - tStart) / m_layout.nFields;
+	REFERENCE_TIME rtField = (rtEnd - rtStart) / m_layout.nFields;
+
+	for (long i = 0; i < m_frame.nCDPCount; i++)
+	{
+		const _anc_packet_entry* pCDP = m_frame.pCDP[i];
+		long nField = nCDPField[i];
+		long nPos = nFieldPos[nField]++;
+
+		// A CDP whose sections overrun its data count is dropped, before its
+		// sequence counter can reach the continuity check
+		if (!m_parser.Validate(pCDP->words, ANC_WORD_UDW + pCDP->dc + 1, true))
+		{
+			m_stats.nCDPMalformed++;
+			continue;
+		}
+
+		// As is one whose bytes do not add up to its packet_checksum
+		if (!VANCParser::IsChecksumValid(pCDP->words))
+		{
+			m_stats.nCDPChecksumErrors++;
+			continue;
+		}
+
+		// Drop CDPs repeated by an upstream frame sync or carried on two lines
+		if (m_continuity.Check(*pCDP) == CDP_REPEAT || !bDeliver)
+			continue;
+
+		long nPairs = 0;
+
+		// Stamp the captions with the time code of the CDP, or the ancillary time code of
+		// the frame when the CDP carries none, whether it is padding or parsed
+		_smpte_timecode timecode = m_frame.timecode;
+		VANCParser::DecodeTimecode(pCDP->words, &timecode);
+
+		bool bPadding = (nPaddingMode != VANC_PADDING_PARSE && VANCParser::IsPadding(pCDP->words, packetType, &nPairs));
+
+		if (bPadding)
+		{
+			// Nothing to parse but the service information. A null pair for each pair of
+			// the selected service keeps the caption cadence (2 or 3 per CDP below 30 fps).
+			m_parser.ParseServiceInfo(pCDP->words);
+			nPadding++;
+
+			if (nPaddingMode == VANC_PADDING_SKIP)
+				continue;
+
+			for (long j = 0; j < nPairs; j++)
+			{
+				line21Pairs[j][0] = 0x80;
+				line21Pairs[j][1] = 0x80;
+			}
+		}
+		else
+		{
+			nParsed++;
+
+			try
+			{
+				// Parse the VANC data
+				m_parser.ParseUnchecked(pCDP->words, true);
+
+				// Get the 608 byte pairs of the selected service from the VANC packet
+				nPairs = m_parser.Get608Packets(line21Pairs, CDP_MAX_CC_COUNT, packetType);
+			}
+			catch (...)
+			{
+				FilterTrace("VANCFrameExtractor::ParseCaptions() - **CRITICAL** failure while parsing packet\n");
+				continue;
+			}
+		}
+
+		// Time span of the CDP within the frame
+		REFERENCE_TIME tCDPStart = tStart + (tField * nField) + ((tField * nPos) / nFieldCDPs[nField]);
+		REFERENCE_TIME tCDPLength = tField / nFieldCDPs[nField];
+		REFERENCE_TIME rtCDPStart = rtStart + (rtField * nField) + ((rtField * nPos) / nFieldCDPs[nField]);
+		REFERENCE_TIME rtCDPLength = rtField / nFieldCDPs[nField];
+
+		for (long j = 0; j < nPairs; j++)
+		{
+			_vanc_frame_caption& caption = m_captions[m_nCaptions++];
+			VANC_CAPTION_RECORD& record = caption.record;
+
+			ZeroMemory(&record, sizeof(record));
+			record.tStart = tCDPStart + ((tCDPLength * j) / nPairs);
+			record.tStop = tCDPStart + ((tCDPLength * (j + 1)) / nPairs);
+			record.pair[0] = line21Pairs[j][0];
+			record.pair[1] = line21Pairs[j][1];
+
+			// The media time of a time coded caption is the frame count of its time code label
+			if (timecode.valid)
+			{
+				record.tMediaStart = TimecodeToFrames(timecode, nTimecodeRate);
+				record.tMediaStop = record.tMediaStart + 1;
+			}
+			else
+			{
+				record.tMediaStart = rtCDPStart + ((rtCDPLength * j) / nPairs);
+				record.tMediaStop = rtCDPStart + ((rtCDPLength * (j + 1)) / nPairs);
+			}
+
+			caption.timecode = timecode;
+			caption.bPadding = bPadding;
+			m_stats.llBytesCopied += sizeof(record);
+		}
+	}
+
+	if (nPadding > 0 && nParsed == 0)
+		m_stats.nPaddingFrames++;
+
+	return m_nCaptions;
+}
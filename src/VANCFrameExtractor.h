@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+#include "VANCParser.h"
+#include "VANCIndex.h"
+#include "VANCDecoders.h"
+#include "CDPContinuity.h"
+#include "PixelFormat.h"
+#include "FrameLayout.h"
+#include "VANCSplitterTypes.h"
+
+// Most caption pairs a frame can carry
+#define VANC_FRAME_MAX_CAPTIONS		(VANC_FRAME_MAX_CDP * CDP_MAX_CC_COUNT)
+
+// A caption pair of the frame with what the trace needs to render it
+struct _vanc_frame_caption
+{
+	VANC_CAPTION_RECORD record;
+	_smpte_timecode timecode;		// time code the record was stamped from
+	bool bPadding;					// null pair standing in for a padding CDP
+};
+
+// Extraction counters
+struct _vanc_extractor_stats
+{
+	LONG nCDPMalformed;				// CDPs that failed Validate
+	LONG nCDPChecksumErrors;		// CDPs dropped for their ANC checksum or packet_checksum
+	LONG nPaddingFrames;			// frames whose CDPs were all padding
+	LONGLONG llVANCBytesRead;		// frame bytes unpacked from the VANC rows
+	LONGLONG llBytesCopied;			// picture, field and caption record bytes copied
+};
+
+//
+// VANCFrameExtractor
+//
+// The per-frame work of the input pin, kept apart from DirectShow so the
+// benchmark and the test programs run exactly what the pin runs: the sweep of
+// the VANC rows into ANC words, the packet index and decoder dispatch, the
+// picture copy over the VANC rows and the caption records of the CDPs. All
+// buffers are allocated by SetFormat, a frame never allocates.
+//
+class VANCFrameExtractor
+{
+	public:
+		VANCFrameExtractor(void);
+		~VANCFrameExtractor(void);
+
+	public:
+		// Connection
+		HRESULT SetFormat(const _pixel_format* pFormat, long nWidth, long nHeight, bool bInterlaced);
+		void Free();
+		void Reset();
+		const _frame_layout& GetLayout() const { return m_layout; }
+		DWORD GetWordsPerLine() const { return m_dwWordsPerLine; }
+
+		// Per frame, in this order
+		void ScanFrame(const BYTE* pFrame, PFN_EXTRACT_LINE pfnExtract, long nScanWidth, DWORD dwScanLeadIn, long nOnlyRow = -1);
+		DWORD CopyPicture(const BYTE* pFrame, BYTE* pPicture);
+		long ParseCaptions(REFERENCE_TIME tStart, REFERENCE_TIME tEnd, REFERENCE_TIME rtStart, REFERENCE_TIME rtEnd,
+			cc_packet_type packetType, LONG nPaddingMode, long nTimecodeRate, bool bDeliver = true);
+
+		// Results of the last frame
+		const _vanc_frame_data& GetFrameData() const { return m_frame; }
+		const __int16* GetVANCData() const { return m_pVANCData; }
+		long GetCaptionCount() const { return m_nCaptions; }
+		const _vanc_frame_caption& GetCaption(long n) const { return m_captions[n]; }
+
+		VANCParser& GetParser() { return m_parser; }
+		void GetStats(_vanc_extractor_stats* pStats) const { *pStats = m_stats; }
+		void GetIndexStats(_vanc_index_stats* pStats) const { m_index.GetStats(pStats); }
+		void GetContinuityStats(_cdp_continuity_stats* pStats) const { m_continuity.GetStats(pStats); }
+
+	private:
+		const _pixel_format* m_pFormat;
+		_frame_layout m_layout;
+		DWORD m_dwWordsPerLine;
+		__int16* m_pVANCData;			// unpacked VANC rows of the frame
+		BYTE* m_pFieldBuffer;			// field set aside while an interlaced raster is woven in place
+		VANCIndex m_index;
+		_vanc_frame_data m_frame;
+		VANCParser m_parser;
+		CDPContinuity m_continuity;
+		_vanc_frame_caption m_captions[VANC_FRAME_MAX_CAPTIONS];
+		long m_nCaptions;
+		_vanc_extractor_stats m_stats;
+};
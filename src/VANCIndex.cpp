@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCIndex.h"
+
+VANCIndex::VANCIndex(void) : m_nCount(0)
+{
+	memset(m_entries, 0, sizeof(m_entries));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+VANCIndex::~VANCIndex(void)
+{
+}
+
+// Clear the index at the start of a frame
+void VANCIndex::Reset()
+{
+	m_nCount = 0;
+}
+
+// Walk an unpacked VANC line and add every ANC packet found to the index. Returns
+// the number of packets added for the line. 8-bit ANC carries an 8-bit checksum.
+//
+// ST 291 packets follow each other without a gap from the start of the ANC space,
+// so the walk ends at the first word after a packet that is not an ADF. The first
+// ADF is searched for within leadIn words (0 = the whole line).
+long VANCIndex::IndexLine(const __int16* pLine, DWORD length, unsigned short line, unsigned short checksumMask, DWORD leadIn)
+{
+	long nAdded = 0;
+	DWORD i = 0;
+	DWORD searchEnd = (leadIn != 0 && leadIn < length) ? leadIn : length;
+
+	while (i + ANC_WORD_UDW < length && m_nCount < VANC_INDEX_MAX_PACKETS)
+	{
+		if (pLine[i + ANC_WORD_ADF_1] != 0x00 || pLine[i + ANC_WORD_ADF_2] != 0x3ff || pLine[i + ANC_WORD_ADF_3] != 0x3ff)
+		{
+			// End of the packet chain, or nothing within the lead in
+			if (nAdded > 0 || ++i >= searchEnd)
+				break;
+
+			continue;
+		}
+
+		const __int16* packet = pLine + i;
+		unsigned char dc = (unsigned char)(packet[ANC_WORD_DC] & 0xff);
+
+		// The checksum word must lie inside the line or the packet is truncated
+		DWORD checksumPos = i + ANC_WORD_UDW + dc;
+
+		if (checksumPos >= length)
+			break;
+
+		// The checksum is the 9-bit sum of DID through the last UDW
+		unsigned short sum = 0;
+
+		for (int j = ANC_WORD_DID; j < ANC_WORD_UDW + dc; j++)
+			sum += (unsigned short)(packet[j] & 0x1ff);
+
+		_anc_packet_entry& entry = m_entries[m_nCount++];
+		entry.line = line;
+		entry.offset = (unsigned short)i;
+		entry.did = (unsigned char)(packet[ANC_WORD_DID] & 0xff);
+		entry.sdid = (unsigned char)(packet[ANC_WORD_SDID] & 0xff);
+		entry.dc = dc;
+		entry.checksum_ok = ((sum & checksumMask) == (packet[ANC_WORD_UDW + dc] & checksumMask));
+		entry.words = packet;
+		nAdded++;
+
+		// Continue with the next packet in the chain
+		i = checksumPos + 1;
+	}
+
+	m_stats.nLines++;
+	// Words up to the last ADF compared
+	m_stats.nWordsScanned += (i + ANC_WORD_ADF_3 < length) ? i + ANC_WORD_ADF_3 + 1 : length;
+
+	return nAdded;
+}
+
+// Get the n-th packet of the frame in sweep order
+const _anc_packet_entry* VANCIndex::GetEntry(long n) const
+{
+	if (n < 0 || n >= m_nCount)
+		return NULL;
+
+	return &m_entries[n];
+}
+
+// Find the next packet matching DID/SDID starting at index position nStart
+const _anc_packet_entry* VANCIndex::Find(unsigned char did, unsigned char sdid, long nStart) const
+{
+	for (long i = (nStart < 0 ? 0 : nStart); i < m_nCount; i++)
+	{
+		if (m_entries[i].did == did && m_entries[i].sdid == sdid)
+			return &m_entries[i];
+	}
+
+	return NULL;
+}
+
+// Find the first packet matching DID/SDID on a specific frame row
+const _anc_packet_entry* VANCIndex::FindOnLine(unsigned char did, unsigned char sdid, unsigned short line) const
+{
+	for (long i = 0; i < m_nCount; i++)
+	{
+		if (m_entries[i].line == line && m_entries[i].did == did && m_entries[i].sdid == sdid)
+			return &m_entries[i];
+	}
+
+	return NULL;
+}
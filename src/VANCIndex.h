@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#define VANC_INDEX_MAX_PACKETS 64
+
+// SMPTE ST 291 packet header word positions (relative to the ADF)
+#define ANC_WORD_ADF_1	0
+#define ANC_WORD_ADF_2	1
+#define ANC_WORD_ADF_3	2
+#define ANC_WORD_DID	3
+#define ANC_WORD_SDID	4
+#define ANC_WORD_DC		5
+#define ANC_WORD_UDW	6
+
+// Well known DID/SDID pairs carried in the VANC space
+#define ANC_DID_CDP			0x61	// SMPTE ST 334 caption distribution packet
+#define ANC_SDID_CDP		0x01
+#define ANC_DID_AFD			0x41	// SMPTE ST 2016-3 AFD and bar data
+#define ANC_SDID_AFD		0x05
+#define ANC_DID_SCTE104		0x41	// SMPTE ST 2010 SCTE-104 messages
+#define ANC_SDID_SCTE104	0x07
+#define ANC_DID_ATC			0x60	// SMPTE ST 12-2 ancillary time code
+#define ANC_SDID_ATC		0x60
+
+// Words searched and rows walked since the index was created
+struct _vanc_index_stats
+{
+	LONG nLines;
+	LONGLONG nWordsScanned;
+};
+
+// A single ANC packet located during the frame sweep. The words pointer is a
+// view into the unpacked VANC frame buffer and is only valid until the next frame.
+struct _anc_packet_entry
+{
+	unsigned short line;		// frame row holding the packet
+	unsigned short offset;		// word offset of the ADF within the row
+	unsigned char  did;			// data id (parity bits removed)
+	unsigned char  sdid;		// secondary data id (parity bits removed)
+	unsigned char  dc;			// user data word count
+	bool		   checksum_ok;	// checksum word matches the packet sum
+	const __int16* words;		// packet words starting at the ADF
+};
+
+class VANCIndex
+{
+	public:
+		VANCIndex(void);
+		~VANCIndex(void);
+
+	public:
+		void Reset();
+		long IndexLine(const __int16* pLine, DWORD length, unsigned short line, unsigned short checksumMask = 0x1ff, DWORD leadIn = 0);
+		long GetCount() const { return m_nCount; }
+		const _anc_packet_entry* GetEntry(long n) const;
+		const _anc_packet_entry* Find(unsigned char did, unsigned char sdid, long nStart = 0) const;
+		const _anc_packet_entry* FindOnLine(unsigned char did, unsigned char sdid, unsigned short line) const;
+		void GetStats(_vanc_index_stats* pStats) const { *pStats = m_stats; }
+
+	private:
+		_anc_packet_entry m_entries[VANC_INDEX_MAX_PACKETS];
+		long m_nCount;
+		_vanc_index_stats m_stats;
+};
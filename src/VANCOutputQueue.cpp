@@ -0,0 +1,775 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "VANCOutputQueue.h"
+
+//
+// CVANCDeliveryThread constructor
+//
+CVANCDeliveryThread::CVANCDeliveryThread(HRESULT* phr) :
+	m_nThreads(0),
+	m_hExitEvent(NULL),
+	m_lExit(0),
+	m_lWakeups(0),
+	m_lGeneration(0),
+	m_nQueues(0)
+{
+	memset(m_threads, 0, sizeof(m_threads));
+	memset(m_pQueues, 0, sizeof(m_pQueues));
+
+	if ((m_hExitEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL)
+	{
+		*phr = AmHresultFromWin32(GetLastError());
+		return;
+	}
+
+	CAutoLock lock_it(&m_csQueues);
+	HRESULT hr = StartThread();
+
+	if (FAILED(hr))
+		*phr = hr;
+}
+
+
+//
+// CVANCDeliveryThread destructor
+//
+CVANCDeliveryThread::~CVANCDeliveryThread()
+{
+	{
+		CAutoLock lock_it(&m_csQueues);
+		InterlockedExchange(&m_lExit, 1);
+	}
+
+	if (m_hExitEvent != NULL)
+		SetEvent(m_hExitEvent);
+
+	for (LONG i = 0; i < m_nThreads; i++)
+	{
+		WaitForSingleObject(m_threads[i].hThread, INFINITE);
+		CloseHandle(m_threads[i].hThread);
+		CloseHandle(m_threads[i].hWakeEvent);
+	}
+
+	if (m_hExitEvent != NULL)
+		CloseHandle(m_hExitEvent);
+}
+
+
+//
+// StartThread
+//
+// Called with m_csQueues held
+//
+HRESULT CVANCDeliveryThread::StartThread()
+{
+	if (m_lExit != 0 || m_nThreads >= VANC_DELIVERY_MAX_QUEUES)
+		return E_FAIL;
+
+	_delivery_thread& thread = m_threads[m_nThreads];
+	thread.pOwner = this;
+	thread.lSleeping = 0;
+	thread.lBlocking = 0;
+
+	if ((thread.hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+		return AmHresultFromWin32(GetLastError());
+
+	if ((thread.hThread = CreateThread(NULL, 0, ThreadProc, &thread, 0, NULL)) == NULL)
+	{
+		HRESULT hr = AmHresultFromWin32(GetLastError());
+		CloseHandle(thread.hWakeEvent);
+		thread.hWakeEvent = NULL;
+		return hr;
+	}
+
+	// Wake only looks at threads below the count, publish the slot first
+	InterlockedIncrement(&m_nThreads);
+	FilterTrace("CVANCDeliveryThread::StartThread() %i threads for %i queues\n", m_nThreads, m_nQueues);
+	return S_OK;
+} // StartThread
+
+
+//
+// IsStalled
+//
+// True when every thread has been in the Receive of a peer that may block for
+// VANC_DELIVERY_STALL_TIMEOUT ms or longer
+//
+bool CVANCDeliveryThread::IsStalled(DWORD dwNow)
+{
+	LONG nThreads = m_nThreads;
+
+	for (LONG i = 0; i < nThreads; i++)
+	{
+		if (m_threads[i].lBlocking == 0 || dwNow - m_threads[i].dwBlockingStart < VANC_DELIVERY_STALL_TIMEOUT)
+			return false;
+	}
+
+	return true;
+} // IsStalled
+
+
+//
+// Register
+//
+HRESULT CVANCDeliveryThread::Register(CVANCOutputQueue* pQueue)
+{
+	CAutoLock lock_it(&m_csQueues);
+
+	if (m_nQueues >= VANC_DELIVERY_MAX_QUEUES)
+		return E_OUTOFMEMORY;
+
+	m_pQueues[m_nQueues++] = pQueue;
+	InterlockedIncrement(&m_lGeneration);
+	return S_OK;
+} // Register
+
+
+//
+// Unregister
+//
+// Returns once no thread is servicing the queue. Threads only claim a queue
+// with m_csQueues held, so none can claim it once it is off the list.
+//
+void CVANCDeliveryThread::Unregister(CVANCOutputQueue* pQueue)
+{
+	{
+		CAutoLock lock_it(&m_csQueues);
+
+		for (LONG i = 0; i < m_nQueues; i++)
+		{
+			if (m_pQueues[i] == pQueue)
+			{
+				m_pQueues[i] = m_pQueues[--m_nQueues];
+				m_pQueues[m_nQueues] = NULL;
+				InterlockedIncrement(&m_lGeneration);
+				break;
+			}
+		}
+	}
+
+	while (pQueue->m_lServicing != 0)
+		Sleep(1);
+} // Unregister
+
+
+//
+// Wake
+//
+// Called by producers after queuing a packet. The event of a thread is only
+// set when it announced that it is going to sleep, and only one is woken. With
+// every thread stuck in a blocking Receive another one is started.
+//
+void CVANCDeliveryThread::Wake()
+{
+	LONG nThreads = m_nThreads;
+
+	for (LONG i = 0; i < nThreads; i++)
+	{
+		if (InterlockedCompareExchange(&m_threads[i].lSleeping, 0, 1) == 1)
+		{
+			SetEvent(m_threads[i].hWakeEvent);
+			return;
+		}
+	}
+
+	if (nThreads < m_nQueues && IsStalled(timeGetTime()))
+	{
+		CAutoLock lock_it(&m_csQueues);
+
+		// Another producer may have started one in between
+		if (m_nThreads < m_nQueues && IsStalled(timeGetTime()))
+			StartThread();
+	}
+} // Wake
+
+
+DWORD WINAPI CVANCDeliveryThread::ThreadProc(LPVOID pParam)
+{
+	_delivery_thread* pThread = (_delivery_thread*)pParam;
+	pThread->pOwner->Run(*pThread);
+	return 0;
+}
+
+
+//
+// HasWork
+//
+// Queues claimed by another thread are that thread's to look at
+//
+bool CVANCDeliveryThread::HasWork()
+{
+	CAutoLock lock_it(&m_csQueues);
+
+	for (LONG i = 0; i < m_nQueues; i++)
+	{
+		if (m_pQueues[i]->m_lServicing == 0 && m_pQueues[i]->HasWork())
+			return true;
+	}
+
+	return false;
+}
+
+
+//
+// Run
+//
+// Each pass claims the queues one at a time and services the ones no other
+// thread is in, then sleeps until a producer wakes the thread or a partial
+// batch it saw is due
+//
+void CVANCDeliveryThread::Run(_delivery_thread& thread)
+{
+	HANDLE handles[2] = { thread.hWakeEvent, m_hExitEvent };
+
+	while (m_lExit == 0)
+	{
+		DWORD dwWait = INFINITE;
+		LONG lGeneration = m_lGeneration;
+
+		for (LONG i = 0; m_lExit == 0; i++)
+		{
+			CVANCOutputQueue* pQueue = NULL;
+
+			{
+				CAutoLock lock_it(&m_csQueues);
+
+				if (i >= m_nQueues)
+					break;
+
+				if (InterlockedCompareExchange(&m_pQueues[i]->m_lServicing, 1, 0) != 0)
+					continue;
+
+				pQueue = m_pQueues[i];
+			}
+
+			DWORD dwNow = timeGetTime();
+
+			if (pQueue->m_bCanBlock)
+			{
+				thread.dwBlockingStart = dwNow;
+				InterlockedExchange(&thread.lBlocking, 1);
+			}
+
+			DWORD dwQueueWait = pQueue->Service(dwNow);
+			dwWait = min(dwWait, dwQueueWait);
+
+			InterlockedExchange(&thread.lBlocking, 0);
+			InterlockedExchange(&pQueue->m_lServicing, 0);
+		}
+
+		// Queues moved on the list during the pass, some may have been skipped
+		if (lGeneration != m_lGeneration)
+			continue;
+
+		// Announce the wait before the last look at the queues, a producer that
+		// queues in between sees the flag and sets the event
+		InterlockedExchange(&thread.lSleeping, 1);
+
+		if (m_lExit == 0 && !HasWork())
+		{
+			if (WaitForMultipleObjects(2, handles, FALSE, dwWait) == WAIT_OBJECT_0)
+				InterlockedIncrement(&m_lWakeups);
+		}
+
+		InterlockedExchange(&thread.lSleeping, 0);
+	}
+} // Run
+
+
+//
+// CVANCOutputQueue constructor
+//
+CVANCOutputQueue::CVANCOutputQueue(IPin* pInputPin, HRESULT* phr, CVANCDeliveryThread* pSharedThread, LONG nBatch, DWORD dwBatchTimeout) :
+	m_pPin(pInputPin),
+	m_pInputPin(NULL),
+	m_bCanBlock(false),
+	m_lServicing(0),
+	m_pThread(NULL),
+	m_pOwnThread(NULL),
+	m_nBatch(min(max(nBatch, 1), VANC_OUTPUT_MAX_BATCH)),
+	m_dwBatchTimeout(dwBatchTimeout),
+	m_lEnqueuePos(0),
+	m_lDequeuePos(0),
+	m_nBatched(0),
+	m_dwBatchStart(0),
+	m_lFlushing(FLUSH_NONE),
+	m_lFlushCount(0),
+	m_hFlushed(NULL),
+	m_hSpace(NULL),
+	m_lSpaceWaiters(0),
+	m_hr(S_OK),
+	m_lSamples(0),
+	m_lBatches(0)
+{
+	for (LONG i = 0; i < VANC_OUTPUT_QUEUE_SIZE; i++)
+		m_cells[i].sequence = i;
+
+	HRESULT hr = pInputPin->QueryInterface(IID_IMemInputPin, (void**)&m_pInputPin);
+
+	if (FAILED(hr))
+	{
+		*phr = hr;
+		return;
+	}
+
+	// Deliver on the calling thread when the peer never blocks and nothing is batched
+	m_bCanBlock = (m_pInputPin->ReceiveCanBlock() == S_OK);
+
+	if (m_nBatch == 1 && !m_bCanBlock)
+		return;
+
+	if ((m_hFlushed = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL ||
+		(m_hSpace = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+	{
+		*phr = AmHresultFromWin32(GetLastError());
+		return;
+	}
+
+	if (pSharedThread == NULL)
+	{
+		hr = S_OK;
+		m_pOwnThread = new CVANCDeliveryThread(&hr);
+
+		if (m_pOwnThread == NULL)
+		{
+			*phr = E_OUTOFMEMORY;
+			return;
+		}
+
+		if (FAILED(hr))
+		{
+			delete m_pOwnThread;
+			m_pOwnThread = NULL;
+			*phr = hr;
+			return;
+		}
+
+		pSharedThread = m_pOwnThread;
+	}
+
+	if (FAILED(hr = pSharedThread->Register(this)))
+	{
+		*phr = hr;
+		return;
+	}
+
+	m_pThread = pSharedThread;
+}
+
+
+//
+// CVANCOutputQueue destructor
+//
+CVANCOutputQueue::~CVANCOutputQueue()
+{
+	if (m_pThread != NULL)
+		m_pThread->Unregister(this);
+
+	if (m_pOwnThread != NULL)
+		delete m_pOwnThread;
+
+	// Release whatever was not delivered
+	Discard();
+
+	if (m_hFlushed != NULL)
+		CloseHandle(m_hFlushed);
+
+	if (m_hSpace != NULL)
+		CloseHandle(m_hSpace);
+
+	if (m_pInputPin != NULL)
+		m_pInputPin->Release();
+}
+
+
+//
+// Receive
+//
+HRESULT CVANCOutputQueue::Receive(IMediaSample* pSample)
+{
+	if (!IsQueued())
+	{
+		HRESULT hr = m_pInputPin->Receive(pSample);
+		pSample->Release();
+
+		m_lSamples++;
+		m_lBatches++;
+		return hr;
+	}
+
+	// Refuse samples while flushing or once the peer failed
+	if (m_lFlushing != FLUSH_NONE)
+	{
+		pSample->Release();
+		return S_FALSE;
+	}
+
+	if (m_hr != S_OK)
+	{
+		pSample->Release();
+		return m_hr;
+	}
+
+	_output_packet packet;
+	packet.type = PACKET_SAMPLE;
+	packet.pSample = pSample;
+
+	HRESULT hr = Queue(packet);
+
+	if (hr != S_OK)
+		pSample->Release();
+
+	return hr;
+} // Receive
+
+
+//
+// EOS
+//
+void CVANCOutputQueue::EOS()
+{
+	if (!IsQueued())
+	{
+		m_pPin->EndOfStream();
+		return;
+	}
+
+	_output_packet packet;
+	packet.type = PACKET_EOS;
+	packet.pSample = NULL;
+	Queue(packet);
+} // EOS
+
+
+//
+// NewSegment
+//
+void CVANCOutputQueue::NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate)
+{
+	if (!IsQueued())
+	{
+		m_pPin->NewSegment(tStart, tStop, dRate);
+		return;
+	}
+
+	_output_packet packet;
+	packet.type = PACKET_NEWSEGMENT;
+	packet.pSample = NULL;
+	packet.tStart = tStart;
+	packet.tStop = tStop;
+	packet.dRate = dRate;
+	Queue(packet);
+} // NewSegment
+
+
+//
+// BeginFlush
+//
+// Stop taking samples and have the delivery thread drop the queued ones. The
+// peer is flushed right away so a blocked Receive returns. Packets stamped
+// with an older flush count are dropped too, in case a producer checked the
+// flag just before it was raised and queues after EndFlush.
+//
+void CVANCOutputQueue::BeginFlush()
+{
+	if (IsQueued())
+	{
+		ResetEvent(m_hFlushed);
+		InterlockedExchange(&m_lFlushing, FLUSH_BEGIN);
+		InterlockedIncrement(&m_lFlushCount);
+		m_pThread->Wake();
+
+		// Release a producer waiting for room
+		SetEvent(m_hSpace);
+	}
+
+	m_pPin->BeginFlush();
+} // BeginFlush
+
+
+//
+// EndFlush
+//
+// Wait for the thread to drop the samples queued while flushing, including
+// any that arrived after its first pass, before samples flow again
+//
+void CVANCOutputQueue::EndFlush()
+{
+	if (IsQueued() && m_lFlushing != FLUSH_NONE)
+	{
+		WaitForSingleObject(m_hFlushed, INFINITE);
+
+		ResetEvent(m_hFlushed);
+		InterlockedExchange(&m_lFlushing, FLUSH_END);
+		m_pThread->Wake();
+		WaitForSingleObject(m_hFlushed, INFINITE);
+
+		m_hr = S_OK;
+		InterlockedExchange(&m_lFlushing, FLUSH_NONE);
+	}
+
+	m_pPin->EndFlush();
+} // EndFlush
+
+
+//
+// GetStats
+//
+void CVANCOutputQueue::GetStats(_output_queue_stats* pStats)
+{
+	pStats->nSamples = m_lSamples;
+	pStats->nBatches = m_lBatches;
+	pStats->nWakeups = (m_pOwnThread != NULL) ? m_pOwnThread->GetWakeups() : 0;
+} // GetStats
+
+
+//
+// Push
+//
+// Claim the next ring cell with a compare and swap on the enqueue position and
+// publish the packet by advancing the cell sequence. Returns false when full.
+//
+bool CVANCOutputQueue::Push(const _output_packet& packet)
+{
+	LONG pos = m_lEnqueuePos;
+
+	for (;;)
+	{
+		_output_cell& cell = m_cells[pos & (VANC_OUTPUT_QUEUE_SIZE - 1)];
+		LONG diff = cell.sequence - pos;
+
+		if (diff == 0)
+		{
+			LONG prev = InterlockedCompareExchange(&m_lEnqueuePos, pos + 1, pos);
+
+			if (prev == pos)
+			{
+				cell.packet = packet;
+				InterlockedExchange(&cell.sequence, pos + 1);
+				return true;
+			}
+
+			pos = prev;
+		}
+		else if (diff < 0)
+			return false;
+		else
+			pos = m_lEnqueuePos;
+	}
+} // Push
+
+
+//
+// Pop
+//
+// Take the oldest published packet (delivery thread only)
+//
+bool CVANCOutputQueue::Pop(_output_packet* pPacket)
+{
+	_output_cell& cell = m_cells[m_lDequeuePos & (VANC_OUTPUT_QUEUE_SIZE - 1)];
+
+	if (cell.sequence - (m_lDequeuePos + 1) < 0)
+		return false;
+
+	*pPacket = cell.packet;
+	InterlockedExchange(&cell.sequence, m_lDequeuePos + VANC_OUTPUT_QUEUE_SIZE);
+	m_lDequeuePos++;
+
+	if (m_lSpaceWaiters > 0)
+		SetEvent(m_hSpace);
+
+	return true;
+} // Pop
+
+
+//
+// Queue
+//
+// The ring only fills when the peer stalls. The producer then registers as a
+// waiter before its last attempt, so a packet taken off the ring in between
+// always sets the event, and waits for the thread to make room.
+//
+HRESULT CVANCOutputQueue::Queue(_output_packet& packet)
+{
+	packet.lFlushCount = m_lFlushCount;
+
+	while (!Push(packet))
+	{
+		if (m_lFlushing != FLUSH_NONE)
+			return S_FALSE;
+
+		InterlockedIncrement(&m_lSpaceWaiters);
+		m_pThread->Wake();
+
+		bool bQueued = Push(packet);
+
+		if (!bQueued && m_lFlushing == FLUSH_NONE)
+			WaitForSingleObject(m_hSpace, INFINITE);
+
+		InterlockedDecrement(&m_lSpaceWaiters);
+
+		if (bQueued)
+			break;
+
+		// Pass a flush on to any other waiting producer
+		if (m_lFlushing != FLUSH_NONE)
+		{
+			SetEvent(m_hSpace);
+			return S_FALSE;
+		}
+	}
+
+	m_pThread->Wake();
+	return S_OK;
+} // Queue
+
+
+//
+// HasWork
+//
+bool CVANCOutputQueue::HasWork()
+{
+	if (m_lFlushing == FLUSH_BEGIN || m_lFlushing == FLUSH_END)
+		return true;
+
+	const _output_cell& cell = m_cells[m_lDequeuePos & (VANC_OUTPUT_QUEUE_SIZE - 1)];
+	return (cell.sequence - (m_lDequeuePos + 1)) >= 0;
+} // HasWork
+
+
+//
+// Service
+//
+// Deliver what is queued and return how long the thread may sleep before a
+// partial batch is due
+//
+DWORD CVANCOutputQueue::Service(DWORD dwNow)
+{
+	// Keep dropping until EndFlush, a producer may still queue after the first pass
+	LONG lFlushing = m_lFlushing;
+
+	if (lFlushing != FLUSH_NONE)
+	{
+		Discard();
+
+		if (lFlushing == FLUSH_BEGIN || lFlushing == FLUSH_END)
+		{
+			if (lFlushing == FLUSH_BEGIN)
+				InterlockedCompareExchange(&m_lFlushing, FLUSH_DISCARDING, FLUSH_BEGIN);
+
+			SetEvent(m_hFlushed);
+		}
+
+		return INFINITE;
+	}
+
+	_output_packet packet;
+
+	while (Pop(&packet))
+	{
+		// Queued before a flush it was not dropped by
+		if (packet.lFlushCount != m_lFlushCount)
+		{
+			if (packet.type == PACKET_SAMPLE)
+				packet.pSample->Release();
+
+			continue;
+		}
+
+		switch (packet.type)
+		{
+			case PACKET_SAMPLE:
+				if (m_nBatched == 0)
+					m_dwBatchStart = dwNow;
+
+				m_ppBatch[m_nBatched++] = packet.pSample;
+
+				if (m_nBatched >= m_nBatch)
+					DeliverBatch();
+				break;
+
+			case PACKET_EOS:
+				DeliverBatch();
+				m_pPin->EndOfStream();
+				break;
+
+			case PACKET_NEWSEGMENT:
+				DeliverBatch();
+				m_pPin->NewSegment(packet.tStart, packet.tStop, packet.dRate);
+				break;
+		}
+	}
+
+	if (m_nBatched == 0)
+		return INFINITE;
+
+	DWORD dwElapsed = dwNow - m_dwBatchStart;
+
+	if (dwElapsed >= m_dwBatchTimeout)
+	{
+		DeliverBatch();
+		return INFINITE;
+	}
+
+	return m_dwBatchTimeout - dwElapsed;
+} // Service
+
+
+//
+// DeliverBatch
+//
+void CVANCOutputQueue::DeliverBatch()
+{
+	if (m_nBatched == 0)
+		return;
+
+	HRESULT hr;
+
+	if (m_nBatched == 1)
+		hr = m_pInputPin->Receive(m_ppBatch[0]);
+	else
+	{
+		long nProcessed = 0;
+		hr = m_pInputPin->ReceiveMultiple(m_ppBatch, m_nBatched, &nProcessed);
+	}
+
+	// Remember the failure so producers stop sending
+	if (hr != S_OK)
+		m_hr = hr;
+
+	for (LONG i = 0; i < m_nBatched; i++)
+		m_ppBatch[i]->Release();
+
+	m_lSamples += m_nBatched;
+	m_lBatches++;
+	m_nBatched = 0;
+} // DeliverBatch
+
+
+//
+// Discard
+//
+// Release the queued samples without delivering them (delivery thread only)
+//
+void CVANCOutputQueue::Discard()
+{
+	_output_packet packet;
+
+	while (Pop(&packet))
+	{
+		if (packet.type == PACKET_SAMPLE)
+			packet.pSample->Release();
+	}
+
+	for (LONG i = 0; i < m_nBatched; i++)
+		m_ppBatch[i]->Release();
+
+	m_nBatched = 0;
+} // Discard
@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+
+#define VANC_OUTPUT_QUEUE_SIZE		256		// packets per queue (power of two)
+#define VANC_OUTPUT_MAX_BATCH		64		// samples per ReceiveMultiple call
+#define VANC_DELIVERY_MAX_QUEUES	8		// queues served by one set of delivery threads
+#define VANC_DELIVERY_DEFAULT_TIMEOUT	40	// ms a partial batch may wait
+#define VANC_DELIVERY_STALL_TIMEOUT	10		// ms in Receive after which a delivery thread counts as blocked
+
+class CVANCOutputQueue;
+
+// Delivery counters of a queue
+struct _output_queue_stats
+{
+	LONG nSamples;			// samples delivered downstream
+	LONG nBatches;			// Receive / ReceiveMultiple calls
+	LONG nWakeups;			// times the delivery thread was woken for the queue
+};
+
+//
+// CVANCDeliveryThread
+//
+// Thread delivering the samples of one or more output queues. Each queue is a
+// sub-queue of its own that a thread claims while delivering to it, the queue
+// list lock is not held across Receive. A producer queuing while every thread
+// has been in the Receive of a peer that may block for VANC_DELIVERY_STALL_TIMEOUT
+// ms, such as a paused renderer holding its preroll sample, starts another
+// thread for the other queues (never more threads than queues). Producers only
+// signal a thread that is about to sleep, so a busy stream does not cost a
+// kernel transition per sample.
+//
+class CVANCDeliveryThread
+{
+	public:
+		CVANCDeliveryThread(HRESULT* phr);
+		~CVANCDeliveryThread();
+
+		HRESULT Register(CVANCOutputQueue* pQueue);
+		void Unregister(CVANCOutputQueue* pQueue);
+		void Wake();
+		LONG GetWakeups() { return m_lWakeups; }
+		LONG GetThreadCount() { return m_nThreads; }
+
+	private:
+		struct _delivery_thread
+		{
+			CVANCDeliveryThread* pOwner;
+			HANDLE hThread;
+			HANDLE hWakeEvent;
+			volatile LONG lSleeping;	// thread is about to wait on hWakeEvent
+			volatile LONG lBlocking;	// thread is delivering to a peer that may block
+			volatile DWORD dwBlockingStart;
+		};
+
+		static DWORD WINAPI ThreadProc(LPVOID pParam);
+		HRESULT StartThread();
+		bool IsStalled(DWORD dwNow);
+		void Run(_delivery_thread& thread);
+		bool HasWork();
+
+		_delivery_thread m_threads[VANC_DELIVERY_MAX_QUEUES];
+		volatile LONG m_nThreads;
+		HANDLE m_hExitEvent;
+		volatile LONG m_lExit;
+		volatile LONG m_lWakeups;
+		volatile LONG m_lGeneration;	// bumped when a queue is added or removed
+		CCritSec m_csQueues;			// guards the queue list, not held while delivering
+		CVANCOutputQueue* m_pQueues[VANC_DELIVERY_MAX_QUEUES];
+		LONG m_nQueues;
+};
+
+//
+// CVANCOutputQueue
+//
+// Replacement for COutputQueue. Samples and stream events are pushed on a
+// bounded lock-free ring (many producers, one consumer) and delivered by a
+// CVANCDeliveryThread, either the pin's own or one shared by every output pin
+// of the filter, which only adds a thread while a peer may be blocked in Receive.
+// Samples are collected into batches of exactly nBatch for ReceiveMultiple; a
+// partial batch goes out once its oldest sample has waited dwBatchTimeout ms or
+// ahead of a stream event. When the downstream pin never blocks and no batching
+// is asked for, samples are delivered on the calling thread without a queue. A
+// producer finding the ring full waits until the thread takes a packet off it.
+//
+class CVANCOutputQueue
+{
+	friend class CVANCDeliveryThread;
+
+	public:
+		CVANCOutputQueue(IPin* pInputPin, HRESULT* phr, CVANCDeliveryThread* pSharedThread, LONG nBatch, DWORD dwBatchTimeout);
+		~CVANCOutputQueue();
+
+		// Producer side, takes over the reference to the sample
+		HRESULT Receive(IMediaSample* pSample);
+		void EOS();
+		void NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate);
+		void BeginFlush();
+		void EndFlush();
+
+		bool IsQueued() { return m_pThread != NULL; }
+		bool HasOwnThread() { return m_pOwnThread != NULL; }
+		void GetStats(_output_queue_stats* pStats);
+
+	private:
+		enum flush_state
+		{
+			FLUSH_NONE,
+			FLUSH_BEGIN,					// thread asked to drop the queued samples
+			FLUSH_DISCARDING,				// dropped, still dropping whatever arrives
+			FLUSH_END						// thread asked for a last drop before samples flow again
+		};
+
+		enum packet_type
+		{
+			PACKET_SAMPLE,
+			PACKET_EOS,
+			PACKET_NEWSEGMENT
+		};
+
+		struct _output_packet
+		{
+			packet_type type;
+			LONG lFlushCount;				// flushes begun before the packet was queued
+			IMediaSample* pSample;
+			REFERENCE_TIME tStart;
+			REFERENCE_TIME tStop;
+			double dRate;
+		};
+
+		// Ring cell, the sequence number tells producers and the consumer whose turn it is
+		struct _output_cell
+		{
+			volatile LONG sequence;
+			_output_packet packet;
+		};
+
+		bool Push(const _output_packet& packet);
+		bool Pop(_output_packet* pPacket);
+		HRESULT Queue(_output_packet& packet);
+
+		// Consumer side, called on the delivery thread
+		DWORD Service(DWORD dwNow);
+		bool HasWork();
+		void DeliverBatch();
+		void Discard();
+
+		IPin* m_pPin;
+		IMemInputPin* m_pInputPin;
+		bool m_bCanBlock;					// ReceiveCanBlock of the peer
+		volatile LONG m_lServicing;			// claimed by a delivery thread
+		CVANCDeliveryThread* m_pThread;		// NULL when delivering directly
+		CVANCDeliveryThread* m_pOwnThread;	// thread created for this queue alone
+		LONG m_nBatch;
+		DWORD m_dwBatchTimeout;
+
+		_output_cell m_cells[VANC_OUTPUT_QUEUE_SIZE];
+		volatile LONG m_lEnqueuePos;
+		LONG m_lDequeuePos;
+
+		IMediaSample* m_ppBatch[VANC_OUTPUT_MAX_BATCH];
+		LONG m_nBatched;
+		DWORD m_dwBatchStart;
+
+		volatile LONG m_lFlushing;			// flush_state
+		volatile LONG m_lFlushCount;
+		HANDLE m_hFlushed;					// set once the thread dropped the queued samples
+		HANDLE m_hSpace;					// set when a packet leaves the ring while a producer waits
+		volatile LONG m_lSpaceWaiters;		// producers waiting for room in the ring
+		volatile HRESULT m_hr;				// last downstream failure
+
+		volatile LONG m_lSamples;
+		volatile LONG m_lBatches;
+};
@@ -8,7 +8,9 @@
 #include "stdafx.h"
 #include "global.h"
 #include "VANCParser.h"
+#include "VANCIndex.h"
 #include <time.h>
+#include <emmintrin.h>
 
 char* printBinary(BYTE character, int bit, char* buffer)
 {
@@ -26,16 +28,19 @@ char* printBinary(BYTE character, char* buffer)
 	return buffer;
 };
 
-VANCParser::VANCParser(void) : m_enableLogging(false)
+// The packet, CDP and service storage is sized for the largest packet so that
+// parsing never allocates
+VANCParser::VANCParser(void) : m_enableLogging(false), m_bServicesPending(false), m_nServiceVersion(0)
 {
 	m_szLogFile[0] = NULL;
-	vanc_data_packet.vanc_userdata = NULL;   
+	ZeroMemory(&vanc_data_packet, sizeof(vanc_data_packet));
+	ZeroMemory(&cdp_data, sizeof(cdp_data));
+	ZeroMemory(&cdp_service_info, sizeof(cdp_service_info));
+	ZeroMemory(&m_services, sizeof(m_services));
 }
 
 VANCParser::~VANCParser(void)
 {
-	if (vanc_data_packet.vanc_userdata != NULL)
-		free (vanc_data_packet.vanc_userdata);
 }
 
 // check if the packet is valid VANC data. scan the entire packet line 
@@ -74,18 +79,323 @@ long VANCParser::GetDTVCCPacketPos(__int16* packet, DWORD length)
 	return -1;
 }
 
-void VANCParser::Parse(__int16* packet, bool bParseSvcData)
+// Offset in the user data words of the section following the header and the
+// time code section, the cc_data section when the CDP carries one
+static inline long CDPSectionOffset(const __int16* udw)
 {
-	if (vanc_data_packet.vanc_userdata != NULL)
-		free (vanc_data_packet.vanc_userdata);
+	return CDP_HEADER_LENGTH + ((udw[4] & 0x80) ? CDP_TIMECODE_LENGTH : 0);
+}
+
+// Words of the cc_data section at offset, none when ccdata_present is clear
+static inline long CDPCCSectionWords(const __int16* udw, long offset)
+{
+	return (udw[4] & 0x40) ? CDP_CC_SECTION_LENGTH + ((udw[offset + 1] & 0x1F) * 3) : 0;
+}
+
+// Check that every offset the decode reads lies within the packet: the user data
+// and checksum within the length words given, and the time code, cc_data,
+// ccsvcinfo and footer sections within the data count. Each section the flags
+// announce must start with its section id (0x71, 0x72, 0x73) and the packet must
+// end with the 0x74 footer.
+bool VANCParser::Validate(const __int16* packet, DWORD length, bool bParseSvcData) const
+{
+	if (length < ANC_WORD_UDW + 1)
+		return false;
+
+	long dc = (unsigned char)packet[ANC_WORD_DC];
+
+	if ((DWORD)(ANC_WORD_UDW + dc + 1) > length || dc < CDP_HEADER_LENGTH + CDP_FOOTER_LENGTH)
+		return false;
+
+	const __int16* udw = packet + ANC_WORD_UDW;
+
+	if ((udw[0] & 0xff) != 0x96 || (udw[1] & 0xff) != 0x69)
+		return false;
+
+	if ((udw[dc - CDP_FOOTER_LENGTH] & 0xff) != 0x74)
+		return false;
+
+	long nFlags = udw[4] & 0xff;
+	long sectionEnd = CDP_HEADER_LENGTH;
+
+	if (nFlags & 0x80)
+	{
+		if (sectionEnd + CDP_TIMECODE_LENGTH + CDP_FOOTER_LENGTH > dc || (udw[sectionEnd] & 0xff) != 0x71)
+			return false;
+
+		sectionEnd += CDP_TIMECODE_LENGTH;
+	}
+
+	if (nFlags & 0x40)
+	{
+		if (sectionEnd + CDP_CC_SECTION_LENGTH + CDP_FOOTER_LENGTH > dc || (udw[sectionEnd] & 0xff) != 0x72)
+			return false;
+
+		sectionEnd += CDPCCSectionWords(udw, sectionEnd);
+	}
+
+	if (bParseSvcData && (nFlags & 0x20))
+	{
+		if (sectionEnd + 2 + CDP_FOOTER_LENGTH > dc || (udw[sectionEnd] & 0xff) != 0x73)
+			return false;
+
+		sectionEnd += 2 + ((udw[sectionEnd + 1] & 0x0F) * CDP_SERVICE_LENGTH);
+	}
+
+	return sectionEnd + CDP_FOOTER_LENGTH <= dc;
+}
+
+// Parse a CDP packet of length words starting at the ADF. A packet that fails
+// Validate is not decoded and leaves no cc_data, time code or services.
+bool VANCParser::Parse(const __int16* packet, DWORD length, bool bParseSvcData)
+{
+	if (!Validate(packet, length, bParseSvcData))
+	{
+		Clear();
+		return false;
+	}
+
+	ParseUnchecked(packet, bParseSvcData);
+	return true;
+}
+
+// True when the packet_checksum of the cdp_footer makes the byte sum of the CDP,
+// cdp_identifier through packet_checksum, zero. Only for packets that passed
+// Validate.
+bool VANCParser::IsChecksumValid(const __int16* packet)
+{
+	const __int16* udw = packet + ANC_WORD_UDW;
+	long dc = (unsigned char)packet[ANC_WORD_DC];
+	BYTE sum = 0;
+
+	for (long i = 0; i < dc; i++)
+		sum = (BYTE)(sum + udw[i]);
+
+	return sum == 0;
+}
+
+// Decode the time_code_section of a CDP: 0x71, hours, minutes, seconds (field
+// flag), frames (drop frame). Returns false, leaving pTimecode alone, when the CDP
+// carries none. Only for packets that passed Validate.
+bool VANCParser::DecodeTimecode(const __int16* packet, _smpte_timecode* pTimecode)
+{
+	const __int16* udw = packet + ANC_WORD_UDW;
+
+	if (!(udw[4] & 0x80) || (udw[CDP_HEADER_LENGTH] & 0xff) != 0x71)
+		return false;
+
+	const __int16* tc = udw + CDP_HEADER_LENGTH + 1;
+
+	pTimecode->hours = DecodeBCD((tc[0] >> 4) & 0x3, tc[0] & 0xF);
+	pTimecode->minutes = DecodeBCD((tc[1] >> 4) & 0x7, tc[1] & 0xF);
+	pTimecode->seconds = DecodeBCD((tc[2] >> 4) & 0x7, tc[2] & 0xF);
+	pTimecode->frames = DecodeBCD((tc[3] >> 4) & 0x3, tc[3] & 0xF);
+	pTimecode->field_flag = (tc[2] & 0x80) == 0x80;
+	pTimecode->drop_frame = (tc[3] & 0x80) == 0x80;
+	pTimecode->valid = true;
+	return true;
+}
+
+// One bit per word of 16 words whose masked bits equal value
+static inline ULONGLONG MatchWords(const __int16* pWords, const __m128i& mask, const __m128i& value)
+{
+	__m128i lo = _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)pWords), mask), value);
+	__m128i hi = _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)(pWords + 8)), mask), value);
+
+	return (ULONGLONG)_mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+}
+
+// Number of bits set
+static inline long CountBits(ULONGLONG bits)
+{
+	long n = 0;
+
+	for (; bits != 0; bits &= bits - 1)
+		n++;
+
+	return n;
+}
+
+// True when no cc_data triplet of the CDP carries data: cc_valid is clear or the
+// triplet is a 608 null pair (0x80 0x80). pnPairs receives the number of triplets
+// of packetType, the pairs a parse would have returned, so padding can be replaced
+// by as many null pairs. Only for packets that passed Validate.
+bool VANCParser::IsPadding(const __int16* packet, cc_packet_type packetType, long* pnPairs)
+{
+	const __int16* udw = packet + ANC_WORD_UDW;
+	long ccOffset = CDPSectionOffset(udw);
+	const __int16* cc = udw + ccOffset + CDP_CC_SECTION_LENGTH;
+	long nWords = max(CDPCCSectionWords(udw, ccOffset) - CDP_CC_SECTION_LENGTH, 0L);
+
+	const __m128i validBit = _mm_set1_epi16(0x04);
+	const __m128i typeBit = _mm_set1_epi16(0x02);
+	const __m128i typeMask = _mm_set1_epi16(0x03);
+	const __m128i typeValue = _mm_set1_epi16((short)packetType);
+	const __m128i byteMask = _mm_set1_epi16(0xff);
+	const __m128i nullByte = _mm_set1_epi16(0x80);
+	long nPairs = 0;
+
+	// Flag the words 16 triplets at a time, one bit per word: cc_valid set, a DTVCC
+	// cc_type, the selected cc_type and a byte other than 0x80
+	for (long n = 0; n < nWords; n += 48)
+	{
+		long nChunk = min(nWords - n, 48L);
+		ULONGLONG valid = 0;
+		ULONGLONG dtvcc = 0;
+		ULONGLONG selected = 0;
+		ULONGLONG nulls = 0;
+		long i = 0;
+
+		for (; i + 16 <= nChunk; i += 16)
+		{
+			valid |= MatchWords(cc + n + i, validBit, validBit) << i;
+			dtvcc |= MatchWords(cc + n + i, typeBit, typeBit) << i;
+			selected |= MatchWords(cc + n + i, typeMask, typeValue) << i;
+			nulls |= MatchWords(cc + n + i, byteMask, nullByte) << i;
+		}
+
+		for (; i < nChunk; i++)
+		{
+			valid |= (ULONGLONG)((cc[n + i] & 0x04) != 0) << i;
+			dtvcc |= (ULONGLONG)((cc[n + i] & 0x02) != 0) << i;
+			selected |= (ULONGLONG)((cc[n + i] & 0x03) == packetType) << i;
+			nulls |= (ULONGLONG)((cc[n + i] & 0xff) == 0x80) << i;
+		}
+
+		ULONGLONG notNull = ~nulls & ((1ULL << nChunk) - 1);
+
+		// A triplet starts every third word, its data bytes are the next two
+		if (valid & 0x249249249249ULL & (dtvcc | (notNull >> 1) | (notNull >> 2)))
+			return false;
+
+		nPairs += CountBits(selected & 0x249249249249ULL);
+	}
+
+	if (pnPairs != NULL)
+		*pnPairs = nPairs;
+
+	return true;
+}
+
+// Decode the ccsvcinfo section of a CDP validated with bParseSvcData. A service
+// set may span several CDPs from the one flagged start to the one flagged
+// complete, which replaces the service table. Encoders repeat the set every few
+// frames; once a set is in the table the repeats are skipped unless flagged as a
+// change, so the table is only decoded again when the services change.
+void VANCParser::ParseServiceInfo(const __int16* packet)
+{
+	const __int16* udw = packet + ANC_WORD_UDW;
+	long nFlags = udw[4] & 0xff;
+
+	if (!(nFlags & 0x20))
+		return;
+
+	long offset = CDPSectionOffset(udw);
+	offset += CDPCCSectionWords(udw, offset);
+
+	if ((udw[offset] & 0xff) != 0x73)
+		return;
 
+	unsigned char info = (unsigned char)udw[offset + 1];
+	bool bStart = (info & 0x40) == 0x40;
+	bool bChange = (info & 0x20) == 0x20;
+	bool bComplete = (info & 0x10) == 0x10;
+
+	// A repeat of the set in the table
+	if (m_nServiceVersion > 0 && !m_bServicesPending && !bChange)
+		return;
+
+	if (bStart)
+	{
+		cdp_service_info.cdp_service_count = 0;
+		m_bServicesPending = true;
+	}
+	else if (!m_bServicesPending)
+	{
+		// Joined in the middle of a set, wait for the next start
+		return;
+	}
+
+	cdp_service_info.cdp_service_info_marker = (unsigned char)udw[offset];
+	cdp_service_info.cdp_service_info_reserved = (info & 0x80) == 0x80;
+	cdp_service_info.cdp_service_info_start = bStart;
+	cdp_service_info.cdp_service_info_change = bChange;
+	cdp_service_info.cdp_service_info_complete = bComplete;
+
+	const __int16* entry = udw + offset + 2;
+
+	for (int i = 0; i < (info & 0x0F) && cdp_service_info.cdp_service_count < CDP_MAX_SERVICES; i++, entry += CDP_SERVICE_LENGTH)
+	{
+		_cdp_service_info_packet& service = cdp_service_info.cdp_packets[cdp_service_info.cdp_service_count++];
+		unsigned char csn = (unsigned char)entry[0];
+
+		service.cdp_cc_reserved1 = (csn & 0x80) == 0x80;	// bit 8
+		service.cdp_csn_size = (csn & 0x40) == 0x40;		// bit 7
+		service.cdp_cc_reserved2 = service.cdp_csn_size && (csn & 0x20) == 0x20;	// bit 6
+		service.cdp_cc_service_number = csn & (service.cdp_csn_size ? 0x1F : 0x3F);	// bit 5-1 or 6-1
+
+		service.cdp_service_data1 = (unsigned char)entry[1];
+		service.cdp_service_data2 = (unsigned char)entry[2];
+		service.cdp_service_data3 = (unsigned char)entry[3];
+		service.cdp_service_data4 = (unsigned char)entry[4];
+		service.cdp_service_data5 = (unsigned char)entry[5];
+		service.cdp_service_data6 = (unsigned char)entry[6];
+
+		// language (3 bytes), digital_cc, reserved, csn or line21_field, easy_reader, wide_aspect_ratio
+		service.cdp_language[0] = (char)service.cdp_service_data1;
+		service.cdp_language[1] = (char)service.cdp_service_data2;
+		service.cdp_language[2] = (char)service.cdp_service_data3;
+		service.cdp_language[3] = 0;
+		service.cdp_digital_cc = (service.cdp_service_data4 & 0x80) == 0x80;
+		service.cdp_line21_field = !service.cdp_digital_cc && (service.cdp_service_data4 & 0x01) == 0x01;
+		service.cdp_easy_reader = (service.cdp_service_data5 & 0x80) == 0x80;
+		service.cdp_wide_aspect_ratio = (service.cdp_service_data5 & 0x40) == 0x40;
+	}
+
+	if (bComplete)
+	{
+		m_services = cdp_service_info;
+		m_bServicesPending = false;
+		m_nServiceVersion++;
+	}
+}
+
+// Copy the services of the last complete set, returns the service count
+long VANCParser::GetServices(_cdp_service_info_packet* pServices, long nMaxServices) const
+{
+	long nServices = min((long)m_services.cdp_service_count, nMaxServices);
+
+	for (long i = 0; i < nServices; i++)
+		pServices[i] = m_services.cdp_packets[i];
+
+	return nServices;
+}
+
+// Forget the service table, for a new stream
+void VANCParser::ResetServices()
+{
+	cdp_service_info.cdp_service_count = 0;
+	m_services.cdp_service_count = 0;
+	m_bServicesPending = false;
+	m_nServiceVersion = 0;
+}
+
+// Forget the last parsed CDP
+void VANCParser::Clear()
+{
+	cdp_data.cc_count = 0;
+	cdp_data.cdp_timecode.valid = false;
+}
+
+// Decode a CDP packet without bounds checks, for packets that passed Validate
+void VANCParser::ParseUnchecked(const __int16* packet, bool bParseSvcData)
+{
 	vanc_data_packet.vanc_marker_1 = packet[0];
 	vanc_data_packet.vanc_marker_2 = packet[1];
 	vanc_data_packet.vanc_marker_3 = packet[2];
 	vanc_data_packet.vanc_did	   = packet[3];
 	vanc_data_packet.vanc_sdid	   = packet[4];
 	vanc_data_packet.vanc_dc  	   = (unsigned char)packet[5];
-	vanc_data_packet.vanc_userdata = (unsigned char*)malloc(vanc_data_packet.vanc_dc * sizeof(char));
 	vanc_data_packet.vanc_checksum = packet[5 + vanc_data_packet.vanc_dc + 1];
  
 	__int16 checkSum = 0;
@@ -108,70 +418,49 @@ void VANCParser::Parse(__int16* packet, bool bParseSvcData)
 	cdp_data.cdp_flags_service_info_complete = (vanc_data_packet.vanc_userdata[4] & 0x4) == 0x4;
 	cdp_data.cdp_flags_caption_service_active = (vanc_data_packet.vanc_userdata[4] & 0x2) == 0x2;
 	cdp_data.cdp_flags_reserved = (vanc_data_packet.vanc_userdata[4] & 1) == 0x1;
-	cdp_data.cdp_sequnce_counter = (((unsigned char)packet[5] << 8) | (unsigned char)packet[6]);
-	cdp_data.cc_section_id = vanc_data_packet.vanc_userdata[7]; 
-	cdp_data.cc_marker = vanc_data_packet.vanc_userdata[8] & 0xE0;
-	cdp_data.cc_count = vanc_data_packet.vanc_userdata[8] & 0x1F;
+	cdp_data.cdp_sequnce_counter = (((unsigned char)vanc_data_packet.vanc_userdata[5] << 8) | (unsigned char)vanc_data_packet.vanc_userdata[6]);
+	cdp_data.cdp_timecode.valid = false;
+
+	// The cc_data section follows the header, or the time code section when present
+	int ccOffset = 7;
+
+	if (cdp_data.cdp_flags_timecode_present)
+	{
+		DecodeTimecode(packet, &cdp_data.cdp_timecode);
+		ccOffset += 5;
+	}
+
+	// A CDP without a cc_data section carries no caption pairs
+	if (cdp_data.cdp_flags_cc_data_present)
+	{
+		cdp_data.cc_section_id = vanc_data_packet.vanc_userdata[ccOffset]; 
+		cdp_data.cc_marker = vanc_data_packet.vanc_userdata[ccOffset + 1] & 0xE0;
+		cdp_data.cc_count = vanc_data_packet.vanc_userdata[ccOffset + 1] & 0x1F;
+	}
+	else
+	{
+		cdp_data.cc_section_id = 0;
+		cdp_data.cc_marker = 0;
+		cdp_data.cc_count = 0;
+	}
 
 	int cdp_block_end = vanc_data_packet.vanc_dc - 4; 
 	cdp_data.cdp_footer_id = vanc_data_packet.vanc_userdata[cdp_block_end]; // 0x74 (marker)
 	cdp_data.cdp_data_sequence_counter = (((unsigned char)vanc_data_packet.vanc_userdata[cdp_block_end + 1] << 8) | (unsigned char)vanc_data_packet.vanc_userdata[cdp_block_end + 2]);
 
-	cdp_data.cdp_packets = new _cdp_cc_packet[cdp_data.cc_count];
-	 
+	unsigned char* cc_data = vanc_data_packet.vanc_userdata + ccOffset + 2;
+
 	for(int i = 0; i < (cdp_data.cc_count); i++)
 	{
-		cdp_data.cdp_packets[i].cc_marker = vanc_data_packet.vanc_userdata[9 + (i * 3)] & 0xF8;
-		cdp_data.cdp_packets[i].cc_packet_valid = (vanc_data_packet.vanc_userdata[9 + (i * 3)] & 4) == 4;
-		cdp_data.cdp_packets[i].cc_packet_type = vanc_data_packet.vanc_userdata[9 + (i * 3)] & 3;
-		cdp_data.cdp_packets[i].cc_data_1 = vanc_data_packet.vanc_userdata[9 + (i * 3) + 1];
-		cdp_data.cdp_packets[i].cc_data_2 = vanc_data_packet.vanc_userdata[9 + (i * 3) + 2];
+		cdp_data.cdp_packets[i].cc_marker = cc_data[i * 3] & 0xF8;
+		cdp_data.cdp_packets[i].cc_packet_valid = (cc_data[i * 3] & 4) == 4;
+		cdp_data.cdp_packets[i].cc_packet_type = cc_data[i * 3] & 3;
+		cdp_data.cdp_packets[i].cc_data_1 = cc_data[(i * 3) + 1];
+		cdp_data.cdp_packets[i].cc_data_2 = cc_data[(i * 3) + 2];
 	}
 	 
-	cdp_service_info.cdp_packets = NULL;
-
 	if (bParseSvcData)
-	{
-		if (cdp_data.cdp_flags_service_info_present)
-		{
-			int footerOffset = 9 + (cdp_data.cc_count * 3);
-			cdp_service_info.cdp_service_info_marker = vanc_data_packet.vanc_userdata[footerOffset];
-			cdp_service_info.cdp_service_info_reserved = (vanc_data_packet.vanc_userdata[footerOffset + 1] & 0x80) == 0x80;
-			cdp_service_info.cdp_service_info_start = (vanc_data_packet.vanc_userdata[footerOffset + 1] & 0x40) == 0x40;
-			cdp_service_info.cdp_service_info_change = (vanc_data_packet.vanc_userdata[footerOffset + 1] & 0x20) == 0x20;
-			cdp_service_info.cdp_service_info_complete = (vanc_data_packet.vanc_userdata[footerOffset + 1] & 0x10) == 0x10;
-			cdp_service_info.cdp_service_count = (vanc_data_packet.vanc_userdata[footerOffset + 1] & 0x8);
-	
-			cdp_service_info.cdp_packets = new _cdp_service_info_packet[cdp_service_info.cdp_service_count];
-	 
-			int serviceBlockOffset = 9 + (cdp_data.cc_count * 3) + 2;
- 
-			for(int i = 0; i < (cdp_service_info.cdp_service_count); i++)
-			{
-				serviceBlockOffset =+ (7 * i);
-
-				cdp_service_info.cdp_packets[i].cdp_cc_reserved1 = (vanc_data_packet.vanc_userdata[serviceBlockOffset] & 0x80) == 0x80; // bit 8
-				cdp_service_info.cdp_packets[i].cdp_csn_size = (vanc_data_packet.vanc_userdata[serviceBlockOffset] & 0x40) == 0x40; // bit 7
-		
-				if (cdp_service_info.cdp_packets[i].cdp_csn_size)
-				{
-					cdp_service_info.cdp_packets[i].cdp_cc_reserved2 = (vanc_data_packet.vanc_userdata[serviceBlockOffset] & 0x20) == 0x20; // bit 6
-					cdp_service_info.cdp_packets[i].cdp_cc_service_number = (vanc_data_packet.vanc_userdata[serviceBlockOffset] & 0x1F) == 0x1F;  // bit 5-1 
-				}
-				else
-				{
-					cdp_service_info.cdp_packets[i].cdp_cc_service_number = (vanc_data_packet.vanc_userdata[serviceBlockOffset] & 0x3F); // bit 6-1
-				}
-
-				cdp_service_info.cdp_packets[i].cdp_service_data1 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 1];
-				cdp_service_info.cdp_packets[i].cdp_service_data2 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 2];
-				cdp_service_info.cdp_packets[i].cdp_service_data3 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 3];
-				cdp_service_info.cdp_packets[i].cdp_service_data4 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 4];
-				cdp_service_info.cdp_packets[i].cdp_service_data5 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 5];
-				cdp_service_info.cdp_packets[i].cdp_service_data6 = vanc_data_packet.vanc_userdata[(serviceBlockOffset) + 6];
-			}
-		}
-	}
+		ParseServiceInfo(packet);
 
 	if (m_enableLogging)
 		LogVANCPacket();
@@ -192,6 +481,35 @@ bool VANCParser::Get608Packet(byte* line21Pair, cc_packet_type packetType)
 	return false;
 }
 
+// Get every byte pair of the packet type in cc_data order. A CDP of a low frame
+// rate stream carries more than one field of 608 data.
+long VANCParser::Get608Packets(byte (*line21Pairs)[2], long nMaxPairs, cc_packet_type packetType)
+{
+	long nPairs = 0;
+
+	for(int i = 0; i < (cdp_data.cc_count) && nPairs < nMaxPairs; i++)
+	{
+		if (cdp_data.cdp_packets[i].cc_packet_type == packetType)
+		{
+			line21Pairs[nPairs][0] = cdp_data.cdp_packets[i].cc_data_1;
+			line21Pairs[nPairs][1] = cdp_data.cdp_packets[i].cc_data_2;
+			nPairs++;
+		}
+	}
+
+	return nPairs;
+}
+
+// Get the time code carried in the time_code_section of the last parsed CDP
+bool VANCParser::GetTimecode(_smpte_timecode* pTimecode)
+{
+	if (!cdp_data.cdp_timecode.valid)
+		return false;
+
+	*pTimecode = cdp_data.cdp_timecode;
+	return true;
+}
+
 void VANCParser::LogVANCPacket()
 {
 	CHAR buffer[100];
@@ -223,6 +541,16 @@ void VANCParser::LogVANCPacket()
 	WriteDebug("%08X (%8i) [FLAG:CC SERVICEC ACTIVE]\n", cdp_data.cdp_flags_caption_service_active, cdp_data.cdp_flags_caption_service_active);
 	WriteDebug("%08X (%8i) [FLAG:RESERVED]\n", cdp_data.cdp_flags_reserved, cdp_data.cdp_flags_reserved);
 	WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
+
+	if (cdp_data.cdp_timecode.valid)
+	{
+		WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
+		WriteDebug("[CDP TIME CODE]\n");
+		WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
+		WriteDebug("%02i:%02i:%02i%c%02i [FIELD %i]\n", cdp_data.cdp_timecode.hours, cdp_data.cdp_timecode.minutes, cdp_data.cdp_timecode.seconds, 
+			cdp_data.cdp_timecode.drop_frame ? ';' : ':', cdp_data.cdp_timecode.frames, cdp_data.cdp_timecode.field_flag ? 2 : 1);
+		WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
+	}
  
 	WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
 	WriteDebug("[CDP FOOTER]\n");
@@ -250,7 +578,7 @@ void VANCParser::LogVANCPacket()
 
 	WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
 
-	if (cdp_data.cdp_flags_cc_data_present)
+	if (cdp_data.cdp_flags_service_info_present)
 	{
 		WriteDebug("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-\n");
 		WriteDebug("[CDP SERVICE INFO]\n");
@@ -266,7 +594,7 @@ void VANCParser::LogVANCPacket()
 
 	if (cdp_data.cdp_flags_service_info_present)
 	{
-		WriteDebug("[RESERVED..........] [CSN SIZE..........] [RESERVED..........] [CSN SERVICE NUMBER] [SERVICE DATA]\n");
+		WriteDebug("[RESERVED..........] [CSN SIZE..........] [RESERVED..........] [CSN SERVICE NUMBER] [SERVICE DATA] [DESCRIPTOR]\n");
 		for(int i = 0; i < (cdp_service_info.cdp_service_count); i++)
 		{
 			WriteDebug("%08X (%8i)  ", cdp_service_info.cdp_packets[i].cdp_cc_reserved1, cdp_service_info.cdp_packets[i].cdp_cc_reserved1);
@@ -279,7 +607,10 @@ void VANCParser::LogVANCPacket()
 			WriteDebug("%08X ", cdp_service_info.cdp_packets[i].cdp_service_data3);
 			WriteDebug("%08X ", cdp_service_info.cdp_packets[i].cdp_service_data4);
 			WriteDebug("%08X ", cdp_service_info.cdp_packets[i].cdp_service_data5);
-			WriteDebug("%08X \n", cdp_service_info.cdp_packets[i].cdp_service_data6);
+			WriteDebug("%08X ", cdp_service_info.cdp_packets[i].cdp_service_data6);
+			WriteDebug("%s %s%s%s\n", cdp_service_info.cdp_packets[i].cdp_language,
+				cdp_service_info.cdp_packets[i].cdp_digital_cc ? "DTVCC" : (cdp_service_info.cdp_packets[i].cdp_line21_field ? "LINE21 F2" : "LINE21 F1"),
+				cdp_service_info.cdp_packets[i].cdp_easy_reader ? " EASY READER" : "", cdp_service_info.cdp_packets[i].cdp_wide_aspect_ratio ? " 16:9" : "");
 		}
 	}
 
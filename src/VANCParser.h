@@ -7,6 +7,25 @@
 
 #pragma once
 
+#include "Timecode.h"
+
+// The data count is an 8 bit field
+#define VANC_MAX_USER_DATA 255
+
+// cc_count is a 5 bit field
+#define CDP_MAX_CC_COUNT 31
+
+// ccsvcinfo svc_count is a 4 bit field
+#define CDP_MAX_SERVICES 15
+
+// Bytes of the cdp_header, the time_code_section, the cc_data section header,
+// a ccsvcinfo entry and the cdp_footer
+#define CDP_HEADER_LENGTH 7
+#define CDP_TIMECODE_LENGTH 5
+#define CDP_CC_SECTION_LENGTH 2
+#define CDP_SERVICE_LENGTH 7
+#define CDP_FOOTER_LENGTH 4
+
 struct _vanc_data_packet
 {
 	__int16  vanc_marker_1; // 0x000;
@@ -15,7 +34,7 @@ struct _vanc_data_packet
 	__int16  vanc_did;		// data packet id
 	__int16  vanc_sdid;		// secondary data id
 	unsigned char   vanc_dc;		// data count
-	unsigned char*  vanc_userdata; // data count
+	unsigned char   vanc_userdata[VANC_MAX_USER_DATA]; // user data words (8 bits)
 	__int16  vanc_checksum;	// data checksum;
 };
 
@@ -43,10 +62,11 @@ struct _cdp_data
 	bool	 cdp_flags_caption_service_active;
 	bool	 cdp_flags_reserved;
 	__int16	 cdp_sequnce_counter;
+	_smpte_timecode cdp_timecode;
 	unsigned char   cc_section_id;
 	unsigned char   cc_marker;
 	unsigned char   cc_count;
-	_cdp_cc_packet* cdp_packets;
+	_cdp_cc_packet  cdp_packets[CDP_MAX_CC_COUNT];
 
 	unsigned char   cdp_footer_id;
 	__int16  cdp_data_sequence_counter;
@@ -64,6 +84,13 @@ struct _cdp_service_info_packet
 	unsigned char   cdp_service_data4;
 	unsigned char   cdp_service_data5;
 	unsigned char   cdp_service_data6;
+
+	// caption_service_descriptor carried in the service data (ATSC A/65)
+	char     cdp_language[4];		// ISO 639.2 code, null terminated
+	bool     cdp_digital_cc;		// DTVCC service, otherwise a line 21 service
+	bool     cdp_line21_field;		// line 21 field 2
+	bool     cdp_easy_reader;
+	bool     cdp_wide_aspect_ratio;
 };
 
 struct _cdp_service_info
@@ -74,7 +101,7 @@ struct _cdp_service_info
 	bool	 cdp_service_info_change;
 	bool	 cdp_service_info_complete;
 	unsigned char   cdp_service_count;
-	_cdp_service_info_packet* cdp_packets;
+	_cdp_service_info_packet cdp_packets[CDP_MAX_SERVICES];
 };
 
 enum cc_packet_type { NTSC_CC1 = 0x00, NTSC_CC2 = 0x01, NTSC_DTVCC = 0x02, NTSC_DTVCC_START = 0x03 };
@@ -87,7 +114,18 @@ class VANCParser
 
 	public:
 		bool Get608Packet(BYTE* line21Pair, cc_packet_type packetType = NTSC_CC1);
-		void Parse(__int16* packet, bool bParseSvcData = false);
+		long Get608Packets(BYTE (*line21Pairs)[2], long nMaxPairs, cc_packet_type packetType = NTSC_CC1);
+		bool GetTimecode(_smpte_timecode* pTimecode);
+		bool Parse(const __int16* packet, DWORD length, bool bParseSvcData = false);
+		bool Validate(const __int16* packet, DWORD length, bool bParseSvcData = false) const;
+		void ParseUnchecked(const __int16* packet, bool bParseSvcData = false);
+		static bool IsChecksumValid(const __int16* packet);
+		static bool DecodeTimecode(const __int16* packet, _smpte_timecode* pTimecode);
+		static bool IsPadding(const __int16* packet, cc_packet_type packetType = NTSC_CC1, long* pnPairs = NULL);
+		void ParseServiceInfo(const __int16* packet);
+		long GetServices(_cdp_service_info_packet* pServices, long nMaxServices) const;
+		LONG GetServiceVersion() const { return m_nServiceVersion; }
+		void ResetServices();
 		void SetTrace(TCHAR* filePath);
 		bool IsValidVANCPacket(__int16* packet, DWORD length);
 		bool IsValidDTVCCPacket(__int16* packet, DWORD length);
@@ -95,6 +133,7 @@ class VANCParser
 		long GetDTVCCPacketPos(__int16* packet, DWORD length);
 
 	private:
+		void Clear();
 		void LogVANCPacket();
 		void WriteDebug(LPCSTR pszFormat, ...);
 
@@ -103,6 +142,9 @@ class VANCParser
 		TCHAR m_szLogFile[MAX_PATH];
 		_vanc_data_packet vanc_data_packet;
 		_cdp_data cdp_data;
-		_cdp_service_info cdp_service_info;
+		_cdp_service_info cdp_service_info;	// ccsvcinfo sections of the set being received
+		_cdp_service_info m_services;		// last complete service set
+		bool m_bServicesPending;			// a set was started and is not complete yet
+		LONG m_nServiceVersion;				// complete sets received
 };
 
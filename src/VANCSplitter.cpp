@@ -63,8 +63,18 @@ CVANCSplitter::CVANCSplitter(TCHAR *pName, LPUNKNOWN pUnk, HRESULT *phr) :
 	m_NumInputPins(0),
     m_NextOutputPinNumber(0),
 	m_NextInputPinNumber(0),
-	m_nVANCLine(8),
-	m_nPacketType(0),
+	m_pConfig(NULL),
+	m_pRetiredConfigs(NULL),
+	m_lConfigEpoch(0),
+	m_lReaderEpoch(MAXLONG),
+	m_nLatencyBudget(VANC_ALLOCATOR_DEFAULT_BUDGET),
+	m_nNumaNode(-1),
+	m_nDeliveryBatch(1),
+	m_dwDeliveryTimeout(VANC_DELIVERY_DEFAULT_TIMEOUT),
+	m_bSharedDelivery(FALSE),
+	m_pDeliveryThread(NULL),
+	m_lDeliveryWakeups(0),
+	m_nOutputMode(VANC_OUTPUT_STRIP),
 	m_pAllocator2(NULL),
 	CBaseFilter(NAME("VANC Splitter"), pUnk, this, CLSID_VANCSplitter)
 {
@@ -72,6 +82,29 @@ CVANCSplitter::CVANCSplitter(TCHAR *pName, LPUNKNOWN pUnk, HRESULT *phr) :
 	m_szLogFilePath[0] = NULL;
 
     ASSERT(phr);
+
+	memset(m_pOutputPins, 0, sizeof(m_pOutputPins));
+
+	// Initial settings
+	m_pConfig = new _vanc_splitter_config;
+
+	if (m_pConfig == NULL)
+	{
+		*phr = E_OUTOFMEMORY;
+		return;
+	}
+
+	m_pConfig->nVANCLine = 8;
+	m_pConfig->nPacketType = 0;
+	m_pConfig->nCaptionBatch = 1;
+	m_pConfig->rtCaptionWindow = 0;
+	m_pConfig->nCaptionOverflowPolicy = CAPTION_DROP_OLDEST;
+	m_pConfig->nExtractionMode = VANC_EXTRACT_AUTO;
+	m_pConfig->nScanWidth = VANC_SCAN_DEFAULT_WIDTH;
+	m_pConfig->nScanLeadIn = 0;
+	m_pConfig->nPaddingMode = VANC_PADDING_NULL_SAMPLE;
+	m_pConfig->lEpoch = 0;
+	m_pConfig->pNextRetired = NULL;
 	 
 	InitInputPinsList();
 
@@ -102,19 +135,13 @@ CVANCSplitter::CVANCSplitter(TCHAR *pName, LPUNKNOWN pUnk, HRESULT *phr) :
     if (pOutputPin2 != NULL )
     {
 		// Set the media type for the second line21 pin
-		CMediaType mediaType;
-		mediaType.SetType(&MEDIATYPE_AUXLine21Data);
-		mediaType.SetSubtype(&MEDIASUBTYPE_Line21_BytePair);
-		mediaType.SetFormatType(&FORMAT_None);
-		mediaType.pbFormat = NULL;
-		mediaType.cbFormat = 0;
-		mediaType.lSampleSize = 2;
-		mediaType.bFixedSizeSamples = TRUE;
-		pOutputPin2->SetMediaType(&mediaType);
+		SetCaptionMediaType(pOutputPin2);
         
 		m_NumOutputPins++;
         m_OutputPinsList.AddTail(pOutputPin2);
     }
+
+	CacheOutputPins();
 }
 
 
@@ -127,6 +154,7 @@ CVANCSplitter::~CVANCSplitter()
 	 
     InitOutputPinsList();
 	InitInputPinsList();
+	DeleteDeliveryThread();
 
 	if (m_pAllocator != NULL)
 		m_pAllocator->Release();
@@ -136,9 +164,380 @@ CVANCSplitter::~CVANCSplitter()
 
 	m_pAllocator = NULL;
 	m_pAllocator2 = NULL;
+
+	FreeRetiredConfigs(MAXLONG);
+	delete m_pConfig;
 }
 
 
+//
+// PublishConfig
+//
+// Replace the settings snapshot with a copy of config and free the replaced
+// snapshots the streaming thread can no longer be reading: those older than
+// the one it entered its current frame with, or all of them between frames.
+// Called with the config lock held.
+//
+HRESULT CVANCSplitter::PublishConfig(const _vanc_splitter_config& config)
+{
+	ASSERT(CritCheckIn(&m_csConfig));
+
+	_vanc_splitter_config* pConfig = new _vanc_splitter_config(config);
+
+	if (pConfig == NULL)
+		return E_OUTOFMEMORY;
+
+	pConfig->lEpoch = m_lConfigEpoch + 1;
+	pConfig->pNextRetired = NULL;
+
+	// The pointer goes first, a reader never sees an epoch newer than the snapshot it loads
+	_vanc_splitter_config* pOldConfig = (_vanc_splitter_config*)InterlockedExchangePointer((PVOID*)&m_pConfig, pConfig);
+	InterlockedExchange(&m_lConfigEpoch, pConfig->lEpoch);
+
+	pOldConfig->pNextRetired = m_pRetiredConfigs;
+	m_pRetiredConfigs = pOldConfig;
+
+	FreeRetiredConfigs(m_lReaderEpoch);
+	return S_OK;
+} // PublishConfig
+
+
+//
+// FreeRetiredConfigs
+//
+// Free the replaced snapshots older than lReaderEpoch, MAXLONG frees them all
+//
+void CVANCSplitter::FreeRetiredConfigs(LONG lReaderEpoch)
+{
+	CAutoLock cConfigLock(&m_csConfig);
+
+	_vanc_splitter_config** ppConfig = &m_pRetiredConfigs;
+
+	while (*ppConfig != NULL)
+	{
+		_vanc_splitter_config* pConfig = *ppConfig;
+
+		if (pConfig->lEpoch < lReaderEpoch)
+		{
+			*ppConfig = pConfig->pNextRetired;
+			delete pConfig;
+		}
+		else
+			ppConfig = &pConfig->pNextRetired;
+	}
+} // FreeRetiredConfigs
+
+
+//
+// EnterConfig
+//
+// Called by the streaming thread before it reads the settings. The epoch is
+// published before the snapshot is loaded, so a setter either sees it and keeps
+// the snapshot or replaced the snapshot before the load. Only the input pin's
+// streaming thread reads this way.
+//
+const _vanc_splitter_config* CVANCSplitter::EnterConfig()
+{
+	InterlockedExchange(&m_lReaderEpoch, m_lConfigEpoch);
+	return m_pConfig;
+} // EnterConfig
+
+
+//
+// LeaveConfig
+//
+// Called by the streaming thread once it no longer holds a snapshot
+//
+void CVANCSplitter::LeaveConfig()
+{
+	InterlockedExchange(&m_lReaderEpoch, MAXLONG);
+} // LeaveConfig
+
+
+//
+// CacheOutputPins
+//
+// Resolve the output pins once so the streaming thread does not walk the pin list
+//
+void CVANCSplitter::CacheOutputPins()
+{
+	for (int i = 0; i < VANC_OUTPUT_PINS; i++)
+		m_pOutputPins[i] = GetPinNFromList(i);
+} // CacheOutputPins
+
+
+//
+// GetVANCLine
+//
+// The line captions were found on while streaming, otherwise the selected line
+//
+STDMETHODIMP CVANCSplitter::GetVANCLine(LONG* nLine)
+{
+	CheckPointer(nLine, E_POINTER);
+
+	CVANCSplitterInputPin* pInputPin = GetPinNFromInList(0);
+
+	if (pInputPin != NULL)
+	{
+		*nLine = pInputPin->GetVANCLine();
+		return S_OK;
+	}
+
+	CAutoLock cConfigLock(&m_csConfig);
+	*nLine = GetConfig()->nVANCLine;
+	return S_OK;
+} // GetVANCLine
+
+
+//
+// SetCaptionMediaType
+//
+// Line21 byte pairs, or batches of time stamped byte pairs when batching is enabled
+//
+void CVANCSplitter::SetCaptionMediaType(CVANCSplitterOutputPin *pPin)
+{
+	CMediaType mediaType;
+	mediaType.SetType(&MEDIATYPE_AUXLine21Data);
+	mediaType.SetFormatType(&FORMAT_None);
+	mediaType.pbFormat = NULL;
+	mediaType.cbFormat = 0;
+
+	CAutoLock cConfigLock(&m_csConfig);
+
+	if (GetConfig()->nCaptionBatch > 1)
+	{
+		mediaType.SetSubtype(&MEDIASUBTYPE_VANCLine21_Batch);
+		mediaType.lSampleSize = 0;
+		mediaType.bFixedSizeSamples = FALSE;
+	}
+	else
+	{
+		mediaType.SetSubtype(&MEDIASUBTYPE_Line21_BytePair);
+		mediaType.lSampleSize = 2;
+		mediaType.bFixedSizeSamples = TRUE;
+	}
+
+	pPin->SetMediaType(&mediaType);
+} // SetCaptionMediaType
+
+
+//
+// ConfigureCaptionAllocator
+//
+// Size the caption allocator buffers for the current batch size
+//
+HRESULT CVANCSplitter::ConfigureCaptionAllocator()
+{
+	if (m_pAllocator2 == NULL)
+		return S_FALSE;
+
+	LONG nCaptionBatch;
+
+	{
+		CAutoLock cConfigLock(&m_csConfig);
+		nCaptionBatch = GetConfig()->nCaptionBatch;
+	}
+
+	ALLOCATOR_PROPERTIES propRequest, propResults;
+	propRequest.cbAlign = 1;
+	propRequest.cbBuffer = (nCaptionBatch > 1) ? (nCaptionBatch * sizeof(VANC_CAPTION_RECORD)) : 2;
+	propRequest.cbPrefix = 0;
+	propRequest.cBuffers = (nCaptionBatch > 1) ? 4 : 100;
+
+	HRESULT hr = NOERROR;
+	m_pAllocator2->Decommit();
+
+	if (FAILED(hr = m_pAllocator2->SetProperties(&propRequest, &propResults)))
+		return hr;
+
+	return m_pAllocator2->Commit();
+} // ConfigureCaptionAllocator
+
+
+//
+// SetCaptionBatch
+//
+// Batching changes the caption media type so it can only be set while the
+// caption pin is not connected.
+//
+STDMETHODIMP CVANCSplitter::SetCaptionBatch(LONG nPairs, REFERENCE_TIME rtWindow)
+{
+	CAutoLock cObjectLock(m_pLock);
+
+	if (nPairs < 1 || nPairs > VANC_CAPTION_MAX_BATCH || rtWindow < 0)
+		return E_INVALIDARG;
+
+	CVANCSplitterOutputPin *pCCPin = GetOutputPin(VANC_CAPTION_PIN);
+
+	if (pCCPin == NULL)
+		return E_UNEXPECTED;
+
+	if (pCCPin->IsConnected())
+		return VFW_E_ALREADY_CONNECTED;
+
+	CAutoLock cConfigLock(&m_csConfig);
+
+	_vanc_splitter_config config = *GetConfig();
+	config.nCaptionBatch = nPairs;
+	config.rtCaptionWindow = rtWindow;
+
+	HRESULT hr = NOERROR;
+
+	if (FAILED(hr = PublishConfig(config)))
+		return hr;
+
+	FilterTrace("CVANCSplitter::SetCaptionBatch() %i pairs, window %I64d\n", nPairs, rtWindow);
+
+	SetCaptionMediaType(pCCPin);
+	ConfigureCaptionAllocator();
+	return S_OK;
+} // SetCaptionBatch
+
+
+//
+// SetDeliveryOptions
+//
+// nBatch samples are handed to the downstream pins per ReceiveMultiple call, a
+// partial batch is sent after nBatchTimeout ms. With bSharedThread the output
+// pins share their delivery threads: one thread, plus another while a peer
+// that may block in Receive (a renderer holding its preroll sample while
+// paused) is being delivered to, so it cannot stop the other pins from
+// completing the pause. The queues are created when streaming starts so the
+// options can only change while stopped.
+//
+STDMETHODIMP CVANCSplitter::SetDeliveryOptions(LONG nBatch, LONG nBatchTimeout, BOOL bSharedThread)
+{
+	CAutoLock cObjectLock(m_pLock);
+
+	if (nBatch < 1 || nBatch > VANC_OUTPUT_MAX_BATCH || nBatchTimeout < 0)
+		return E_INVALIDARG;
+
+	if (m_State != State_Stopped)
+		return VFW_E_NOT_STOPPED;
+
+	m_nDeliveryBatch = nBatch;
+	m_dwDeliveryTimeout = (DWORD)nBatchTimeout;
+	m_bSharedDelivery = bSharedThread;
+	FilterTrace("CVANCSplitter::SetDeliveryOptions() batch %i, timeout %i ms, shared thread %i\n", nBatch, nBatchTimeout, bSharedThread);
+	return S_OK;
+} // SetDeliveryOptions
+
+
+//
+// GetDeliveryThread
+//
+// Delivery thread shared by the output pins, created by the first pin to go active
+//
+CVANCDeliveryThread *CVANCSplitter::GetDeliveryThread()
+{
+	if (m_pDeliveryThread != NULL)
+		return m_pDeliveryThread;
+
+	HRESULT hr = S_OK;
+	m_pDeliveryThread = new CVANCDeliveryThread(&hr);
+
+	if (m_pDeliveryThread != NULL && FAILED(hr))
+	{
+		delete m_pDeliveryThread;
+		m_pDeliveryThread = NULL;
+	}
+
+	// The pins fall back to a thread of their own when this fails
+	return m_pDeliveryThread;
+} // GetDeliveryThread
+
+
+//
+// DeleteDeliveryThread
+//
+void CVANCSplitter::DeleteDeliveryThread()
+{
+	if (m_pDeliveryThread == NULL)
+		return;
+
+	m_lDeliveryWakeups += m_pDeliveryThread->GetWakeups();
+	delete m_pDeliveryThread;
+	m_pDeliveryThread = NULL;
+} // DeleteDeliveryThread
+
+
+//
+// SetOutputMode
+//
+// The output media type depends on the mode, so it is chosen before the input
+// pin connects
+//
+STDMETHODIMP CVANCSplitter::SetOutputMode(LONG nMode)
+{
+	CAutoLock cObjectLock(m_pLock);
+
+	if (nMode < VANC_OUTPUT_STRIP || nMode > VANC_OUTPUT_INSERT)
+		return E_INVALIDARG;
+
+	CVANCSplitterInputPin* pInputPin = GetPinNFromInList(0);
+
+	if (pInputPin != NULL && pInputPin->IsConnected())
+		return VFW_E_ALREADY_CONNECTED;
+
+	m_nOutputMode = nMode;
+	FilterTrace("CVANCSplitter::SetOutputMode() %s\n", (nMode == VANC_OUTPUT_INSERT) ? "insert" : "strip");
+	return S_OK;
+} // SetOutputMode
+
+
+//
+// InsertCaptionData
+//
+// Queue cc_data triplets (cc_valid / cc_type byte, data 1, data 2) for the CDPs
+// written in insert mode. 608 pairs use cc_type 0 (field 1) and 1 (field 2), 708
+// packet data 3 (start) and 2.
+//
+STDMETHODIMP CVANCSplitter::InsertCaptionData(const BYTE* pCCData, LONG nCount)
+{
+	CheckPointer(pCCData, E_POINTER);
+
+	if (nCount < 0)
+		return E_INVALIDARG;
+
+	CVANCSplitterInputPin* pInputPin = GetPinNFromInList(0);
+
+	if (pInputPin == NULL)
+		return E_UNEXPECTED;
+
+	return pInputPin->QueueInsertData(pCCData, nCount);
+} // InsertCaptionData
+
+
+//
+// GetDeliveryStatistics
+//
+void CVANCSplitter::GetDeliveryStatistics(VANC_SPLITTER_STATS *pStats)
+{
+	CAutoLock cObjectLock(m_pLock);
+
+	pStats->nDeliveryWakeups = m_lDeliveryWakeups;
+
+	if (m_pDeliveryThread != NULL)
+	{
+		pStats->nDeliveryThreads += m_pDeliveryThread->GetThreadCount();
+		pStats->nDeliveryWakeups += m_pDeliveryThread->GetWakeups();
+	}
+
+	POSITION pos = m_OutputPinsList.GetHeadPosition();
+
+	while (pos)
+	{
+		CVANCSplitterOutputPin *pOutputPin = m_OutputPinsList.GetNext(pos);
+		_output_queue_stats stats;
+
+		pOutputPin->GetDeliveryStats(&stats, &pStats->nDeliveryThreads);
+		pStats->nDeliverySamples += stats.nSamples;
+		pStats->nDeliveryBatches += stats.nBatches;
+		pStats->nDeliveryWakeups += stats.nWakeups;
+	}
+} // GetDeliveryStatistics
+
+
 //
 // GetPinCount
 //
@@ -358,16 +757,19 @@ STDMETHODIMP CVANCSplitter::Stop()
 
     m_State = State_Stopped;
 
+	// The output queues were deleted by the pins going inactive
+	DeleteDeliveryThread();
+
 	// Trigger end of stream on input pin
 	if (FAILED(hr = GetPin(0)->EndOfStream()))
 		return hr;
 
 	// Force end flush on video pin
-	if (FAILED(hr = this->GetPinNFromList(0)->DeliverEndFlush()))
+	if (FAILED(hr = GetOutputPin(VANC_VIDEO_PIN)->DeliverEndFlush()))
 		return hr;
 
 	// Force end flush on caption pin
-	if (FAILED(hr = this->GetPinNFromList(1)->DeliverEndFlush()))
+	if (FAILED(hr = GetOutputPin(VANC_CAPTION_PIN)->DeliverEndFlush()))
 		return hr;
 
     return NOERROR;
@@ -388,6 +790,13 @@ STDMETHODIMP CVANCSplitter::Pause()
 	HRESULT hr;
 
     CAutoLock cObjectLock(m_pLock);
+
+	// Streaming is about to start, nothing reads the replaced settings anymore
+	if (m_State == State_Stopped)
+	{
+		FreeRetiredConfigs(MAXLONG);
+		CacheOutputPins();
+	}
     
 	if (FAILED(hr = CBaseFilter::Pause()))
 		return hr;
@@ -425,6 +834,8 @@ STDMETHODIMP CVANCSplitter::NonDelegatingQueryInterface(REFIID riid, void** ppv)
 {
 	if (riid == IID_IVANCSplitter) 
 		return GetInterface((IVANCSplitter*) this, ppv);
+	else if (riid == IID_IVANCSplitter2) 
+		return GetInterface((IVANCSplitter2*) this, ppv);
 	else if (riid == IID_ISpecifyPropertyPages) 
 		return GetInterface((ISpecifyPropertyPages *) this, ppv);
 
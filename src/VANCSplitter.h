@@ -11,6 +11,8 @@
 #include "global.h"
 #include "VANCSplitterInputPin.h"
 #include "VANCSplitterOutputPin.h"
+#include "VANCSplitterTypes.h"
+#include "VANCAllocator.h"
 
 
 // {6A7E647E-ADEC-457D-98E4-20E6B8914191}
@@ -19,6 +21,13 @@ DEFINE_GUID(CLSID_VANCSplitter, 0x6a7e647e, 0xadec, 0x457d, 0x98, 0xe4, 0x20, 0x
 // {FA953CE0-EBFD-47E2-AC84-34FA6AA2446D}
 DEFINE_GUID(IID_IVANCSplitter, 0xfa953ce0, 0xebfd, 0x47e2, 0xac, 0x84, 0x34, 0xfa, 0x6a, 0xa2, 0x44, 0x6d);
 
+// {1077C842-B02F-4781-9886-4B3B7D83461D}
+DEFINE_GUID(IID_IVANCSplitter2, 0x1077c842, 0xb02f, 0x4781, 0x98, 0x86, 0x4b, 0x3b, 0x7d, 0x83, 0x46, 0x1d);
+
+// Batched Line21 byte pairs with per-pair time stamps (array of VANC_CAPTION_RECORD)
+// {E5611691-C0EB-42AC-B399-4D8F8835ACCD}
+DEFINE_GUID(MEDIASUBTYPE_VANCLine21_Batch, 0xe5611691, 0xc0eb, 0x42ac, 0xb3, 0x99, 0x4d, 0x8f, 0x88, 0x35, 0xac, 0xcd);
+
 MIDL_INTERFACE("FA953CE0-EBFD-47E2-AC84-34FA6AA2446D")
 IVANCSplitter : public IUnknown
 {
@@ -30,9 +39,61 @@ IVANCSplitter : public IUnknown
 		virtual HRESULT STDMETHODCALLTYPE GetPacketType(__out_opt LONG* nPacketType) = 0;
 };
 
+// Settings and statistics added after IVANCSplitter was published. IVANCSplitter
+// stays as it was so existing clients keep a matching vtable.
+MIDL_INTERFACE("1077C842-B02F-4781-9886-4B3B7D83461D")
+IVANCSplitter2 : public IVANCSplitter
+{
+	public:
+		virtual HRESULT STDMETHODCALLTYPE GetStatistics(__out VANC_SPLITTER_STATS* pStats) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetCaptionBatch(__in LONG nPairs, __in REFERENCE_TIME rtWindow) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetCaptionBatch(__out LONG* nPairs, __out REFERENCE_TIME* rtWindow) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetCaptionOverflowPolicy(__in LONG nPolicy) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetCaptionOverflowPolicy(__out LONG* nPolicy) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetLatencyBudget(__in LONG nFrames) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetLatencyBudget(__out LONG* nFrames) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetNumaNode(__in LONG nNode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetNumaNode(__out LONG* nNode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetDeliveryOptions(__in LONG nBatch, __in LONG nBatchTimeout, __in BOOL bSharedThread) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetDeliveryOptions(__out LONG* nBatch, __out LONG* nBatchTimeout, __out BOOL* bSharedThread) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetExtractionMode(__in LONG nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetExtractionMode(__out LONG* nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetScanBounds(__in LONG nWidth, __in LONG nLeadIn) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetScanBounds(__out LONG* nWidth, __out LONG* nLeadIn) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetOutputMode(__in LONG nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetOutputMode(__out LONG* nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE InsertCaptionData(__in_ecount(nCount * 3) const BYTE* pCCData, __in LONG nCount) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SetPaddingMode(__in LONG nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetPaddingMode(__out LONG* nMode) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetCaptionServices(__out_ecount_part(nMaxServices, *pnServices) VANC_CAPTION_SERVICE* pServices, __in LONG nMaxServices, __out LONG* pnServices) = 0;
+};
+
 void DisplayMediaType(TCHAR *pDescription, const CMediaType *pmt);
 
-class CVANCSplitter: public CCritSec, public CBaseFilter, IVANCSplitter, ISpecifyPropertyPages
+// Output pins fixed at construction
+#define VANC_VIDEO_PIN		0
+#define VANC_CAPTION_PIN	1
+#define VANC_OUTPUT_PINS	2
+
+// Settings read by the streaming thread. A published snapshot is never modified,
+// a setter publishes an updated copy and the streaming thread picks it up at the
+// start of the next frame. Snapshots are numbered by lEpoch in publishing order.
+struct _vanc_splitter_config
+{
+	LONG nVANCLine;
+	LONG nPacketType;
+	LONG nCaptionBatch;				// byte pairs per caption sample (1 = Line21 byte pair samples)
+	REFERENCE_TIME rtCaptionWindow;	// longest time span of a batch (0 = no limit)
+	LONG nCaptionOverflowPolicy;	// caption_overflow_policy
+	LONG nExtractionMode;			// vanc_extraction_mode
+	LONG nScanWidth;				// pixels of a VANC row unpacked (0 = the whole row)
+	LONG nScanLeadIn;				// words searched for the first ADF of a row (0 = the whole row)
+	LONG nPaddingMode;				// vanc_padding_mode
+	LONG lEpoch;
+	_vanc_splitter_config* pNextRetired;
+};
+
+class CVANCSplitter: public CCritSec, public CBaseFilter, IVANCSplitter2, ISpecifyPropertyPages
 {
     // Let the pins access our internal state
     friend class CVANCSplitterInputPin;
@@ -47,10 +108,22 @@ class CVANCSplitter: public CCritSec, public CBaseFilter, IVANCSplitter, ISpecif
     INT m_NextOutputPinNumber;      // Increases monotonically.
 	INT m_NextInputPinNumber;      // Increases monotonically.
     LONG m_lCanSeek;                // Seekable output pin
-    IMemAllocator* m_pAllocator;    // Allocator from our input pin
-	IMemAllocator* m_pAllocator2;
-	LONG m_nVANCLine;
-	LONG m_nPacketType;
+    CVANCAllocator* m_pAllocator;   // Allocator from our input pin
+	CVANCAllocator* m_pAllocator2;	// Allocator for the caption pin
+	_vanc_splitter_config* volatile m_pConfig;	// current settings snapshot
+	_vanc_splitter_config* m_pRetiredConfigs;	// replaced snapshots the streaming thread may still read
+	volatile LONG m_lConfigEpoch;	// epoch of the current snapshot
+	volatile LONG m_lReaderEpoch;	// epoch the streaming thread entered with, MAXLONG between frames
+	CCritSec m_csConfig;			// serializes settings updates, held by readers off the streaming thread
+	CVANCSplitterOutputPin* m_pOutputPins[VANC_OUTPUT_PINS];	// output pins by index, resolved at state changes
+	LONG m_nLatencyBudget;			// most video frames buffered before upstream blocks
+	LONG m_nNumaNode;				// NUMA node of the video buffers (-1 = streaming thread)
+	LONG m_nDeliveryBatch;			// samples per ReceiveMultiple call on the output pins
+	DWORD m_dwDeliveryTimeout;		// longest wait in ms for a delivery batch to fill
+	BOOL m_bSharedDelivery;			// the output pins share their delivery threads
+	CVANCDeliveryThread* m_pDeliveryThread;	// shared delivery threads while streaming
+	LONG m_lDeliveryWakeups;		// wakeups of shared delivery threads already deleted
+	LONG m_nOutputMode;				// vanc_output_mode, fixed while the input is connected
 	bool m_bTrace;
 	TCHAR m_szLogFilePath[MAX_PATH];
 
@@ -89,32 +162,241 @@ public:
 
 	virtual HRESULT STDMETHODCALLTYPE SetVANCLine(LONG nLine)
 	{
-		m_nVANCLine = nLine;
-		FilterTrace("CVANCSplitter::SetVANCLine() Line %i (%i)\n", m_nVANCLine, m_nVANCLine + 1);
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nVANCLine = nLine;
+		FilterTrace("CVANCSplitter::SetVANCLine() Line %i (%i)\n", nLine, nLine + 1);
+		return PublishConfig(config);
+	}
+
+	STDMETHODIMP GetVANCLine(LONG* nLine);
+
+	virtual HRESULT STDMETHODCALLTYPE SetPacketType(LONG nPacketType)
+	{
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nPacketType = nPacketType;
+		return PublishConfig(config);
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetPacketType(LONG* nPacketType)
+	{
+		CAutoLock cConfigLock(&m_csConfig);
+		*nPacketType = GetConfig()->nPacketType;
+		return S_OK;
+	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE GetStatistics(VANC_SPLITTER_STATS* pStats)
+	{
+		CheckPointer(pStats, E_POINTER);
+		ZeroMemory(pStats, sizeof(VANC_SPLITTER_STATS));
+
+		CVANCSplitterInputPin* pInputPin = GetPinNFromInList(0);
+
+		if (pInputPin != NULL)
+			pInputPin->GetStatistics(pStats);
+
+		GetDeliveryStatistics(pStats);
+		return S_OK;
+	}
+	 
+	STDMETHODIMP SetCaptionBatch(LONG nPairs, REFERENCE_TIME rtWindow);
+
+	virtual HRESULT STDMETHODCALLTYPE GetCaptionBatch(LONG* nPairs, REFERENCE_TIME* rtWindow)
+	{
+		CheckPointer(nPairs, E_POINTER);
+		CheckPointer(rtWindow, E_POINTER);
+
+		CAutoLock cConfigLock(&m_csConfig);
+		const _vanc_splitter_config* pConfig = GetConfig();
+		*nPairs = pConfig->nCaptionBatch;
+		*rtWindow = pConfig->rtCaptionWindow;
 		return S_OK;
 	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE SetCaptionOverflowPolicy(LONG nPolicy)
+	{
+		if (nPolicy < CAPTION_DROP_OLDEST || nPolicy > CAPTION_COALESCE_NULL)
+			return E_INVALIDARG;
 
-	virtual HRESULT STDMETHODCALLTYPE GetVANCLine(LONG* nLine)
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nCaptionOverflowPolicy = nPolicy;
+		return PublishConfig(config);
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetCaptionOverflowPolicy(LONG* nPolicy)
 	{
-		*nLine = m_nVANCLine;
+		CheckPointer(nPolicy, E_POINTER);
+
+		CAutoLock cConfigLock(&m_csConfig);
+		*nPolicy = GetConfig()->nCaptionOverflowPolicy;
 		return S_OK;
 	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE SetLatencyBudget(LONG nFrames)
+	{
+		if (nFrames < 1 || nFrames > VANC_ALLOCATOR_MAX_BUDGET)
+			return E_INVALIDARG;
 
-	virtual HRESULT STDMETHODCALLTYPE SetPacketType(LONG nPacketType)
+		m_nLatencyBudget = nFrames;
+
+		if (m_pAllocator != NULL)
+			m_pAllocator->SetLatencyBudget(nFrames);
+
+		return S_OK;
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetLatencyBudget(LONG* nFrames)
 	{
-		m_nPacketType = nPacketType;
+		CheckPointer(nFrames, E_POINTER);
+		*nFrames = m_nLatencyBudget;
 		return S_OK;
 	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE SetNumaNode(LONG nNode)
+	{
+		if (nNode < -1)
+			return E_INVALIDARG;
 
-	virtual HRESULT STDMETHODCALLTYPE GetPacketType(LONG* nPacketType)
+		m_nNumaNode = nNode;
+
+		if (m_pAllocator != NULL)
+			m_pAllocator->SetNumaNode((DWORD)nNode);
+
+		return S_OK;
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetNumaNode(LONG* nNode)
+	{
+		CheckPointer(nNode, E_POINTER);
+		*nNode = m_nNumaNode;
+		return S_OK;
+	}
+	 
+	STDMETHODIMP SetDeliveryOptions(LONG nBatch, LONG nBatchTimeout, BOOL bSharedThread);
+
+	virtual HRESULT STDMETHODCALLTYPE GetDeliveryOptions(LONG* nBatch, LONG* nBatchTimeout, BOOL* bSharedThread)
+	{
+		CheckPointer(nBatch, E_POINTER);
+		CheckPointer(nBatchTimeout, E_POINTER);
+		CheckPointer(bSharedThread, E_POINTER);
+		*nBatch = m_nDeliveryBatch;
+		*nBatchTimeout = (LONG)m_dwDeliveryTimeout;
+		*bSharedThread = m_bSharedDelivery;
+		return S_OK;
+	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE SetExtractionMode(LONG nMode)
+	{
+		if (nMode < VANC_EXTRACT_AUTO || nMode > VANC_EXTRACT_MULTIPLEXED)
+			return E_INVALIDARG;
+
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nExtractionMode = nMode;
+		return PublishConfig(config);
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetExtractionMode(LONG* nMode)
+	{
+		CheckPointer(nMode, E_POINTER);
+
+		CAutoLock cConfigLock(&m_csConfig);
+		*nMode = GetConfig()->nExtractionMode;
+		return S_OK;
+	}
+	 
+	virtual HRESULT STDMETHODCALLTYPE SetScanBounds(LONG nWidth, LONG nLeadIn)
+	{
+		if (nWidth < 0 || nLeadIn < 0)
+			return E_INVALIDARG;
+
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nScanWidth = nWidth;
+		config.nScanLeadIn = nLeadIn;
+		return PublishConfig(config);
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetScanBounds(LONG* nWidth, LONG* nLeadIn)
+	{
+		CheckPointer(nWidth, E_POINTER);
+		CheckPointer(nLeadIn, E_POINTER);
+
+		CAutoLock cConfigLock(&m_csConfig);
+		const _vanc_splitter_config* pConfig = GetConfig();
+		*nWidth = pConfig->nScanWidth;
+		*nLeadIn = pConfig->nScanLeadIn;
+		return S_OK;
+	}
+	 
+	STDMETHODIMP SetOutputMode(LONG nMode);
+
+	virtual HRESULT STDMETHODCALLTYPE GetOutputMode(LONG* nMode)
 	{
-		*nPacketType = m_nPacketType;
+		CheckPointer(nMode, E_POINTER);
+		*nMode = m_nOutputMode;
 		return S_OK;
 	}
+
+	STDMETHODIMP InsertCaptionData(const BYTE* pCCData, LONG nCount);
+
+	virtual HRESULT STDMETHODCALLTYPE SetPaddingMode(LONG nMode)
+	{
+		if (nMode < VANC_PADDING_PARSE || nMode > VANC_PADDING_SKIP)
+			return E_INVALIDARG;
+
+		CAutoLock cConfigLock(&m_csConfig);
+
+		_vanc_splitter_config config = *GetConfig();
+		config.nPaddingMode = nMode;
+		return PublishConfig(config);
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetPaddingMode(LONG* nMode)
+	{
+		CheckPointer(nMode, E_POINTER);
+
+		CAutoLock cConfigLock(&m_csConfig);
+		*nMode = GetConfig()->nPaddingMode;
+		return S_OK;
+	}
+
+	virtual HRESULT STDMETHODCALLTYPE GetCaptionServices(VANC_CAPTION_SERVICE* pServices, LONG nMaxServices, LONG* pnServices)
+	{
+		CheckPointer(pnServices, E_POINTER);
+		*pnServices = 0;
+
+		if (nMaxServices < 0 || (nMaxServices > 0 && pServices == NULL))
+			return E_INVALIDARG;
+
+		CVANCSplitterInputPin* pInputPin = GetPinNFromInList(0);
+
+		if (pInputPin == NULL)
+			return E_UNEXPECTED;
+
+		return pInputPin->GetCaptionServices(pServices, nMaxServices, pnServices);
+	}
 	 
-	cc_packet_type GetPacketType()
+	// Current settings snapshot, read with the config lock held. The streaming
+	// thread uses EnterConfig instead.
+	const _vanc_splitter_config* GetConfig()
+	{
+		return m_pConfig;
+	}
+
+	const _vanc_splitter_config* EnterConfig();
+	void LeaveConfig();
+
+	CVANCSplitterOutputPin* GetOutputPin(int n)
 	{
-		return (cc_packet_type)m_nPacketType;
+		return m_pOutputPins[n];
 	}
 
 	TCHAR* GetLogFileName()
@@ -126,6 +408,14 @@ protected:
 
     // The following manage the list of output pins
     void InitOutputPinsList();
+	void SetCaptionMediaType(CVANCSplitterOutputPin *pPin);
+	HRESULT ConfigureCaptionAllocator();
+	HRESULT PublishConfig(const _vanc_splitter_config& config);
+	void FreeRetiredConfigs(LONG lReaderEpoch);
+	void CacheOutputPins();
+	CVANCDeliveryThread *GetDeliveryThread();
+	void DeleteDeliveryThread();
+	void GetDeliveryStatistics(VANC_SPLITTER_STATS *pStats);
 	void InitInputPinsList();
 	CVANCSplitterInputPin *GetPinNFromInList(int n);
     CVANCSplitterOutputPin *GetPinNFromList(int n);
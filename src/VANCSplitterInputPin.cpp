@@ -12,62 +12,7 @@
 class CVANCSplitter;
 class CVANCSplitterOutputPin;
 
-#define VIDEO_BYTE_PER_PIXEL 4
-#define VIDEO_VANC_LINES 22
-#define VIDEO_VANC_COLUMNS 16
-
-short ReverseShort(short b)
-{
-	short reverse = 0;
-	int bits = (sizeof(short) * 8);
-	for(int i = 0; i < bits; i++)
-	{
-		short bit = ((b >> i) & 1);
-		reverse |= (bit << (bits - (i + 1)));
-	}
-	return reverse;
-}
-
-// Convert v210 frame line to VANC buffer
-void Convert_UYVY_to_VANC(__int16* v210Buffer, DWORD dwTotalBytes, short* pOutputBuffer)
-{
-	bool t = false;
-	int nBlockPos = 0;
-	for(long i = 0; i < (long)(dwTotalBytes / sizeof(__int32)); i++)
-	{ 
-		unsigned short v210Block = v210Buffer[i];
-		unsigned short byte = (v210Block << 8 | v210Block >> 8)  & 0x3ff;  
-		pOutputBuffer[nBlockPos] = byte;
-		nBlockPos++;
-	}
-}
-  
-// Convert v210 frame line to VANC buffer
-void Convert_v210_to_BYTES(__int32* v210Buffer, DWORD dwTotalBytes, short* pOutputBuffer)
-{
-	bool t = false;
-	int nBlockPos = 0;
-
-	for(long i = 0; i < (long)(dwTotalBytes / sizeof(__int32)); i++)
-	{ 
-		__int32 v210Block = v210Buffer[i];
- 
-		for(int j = 0; j < 3; j++)
-		{ 
-			if (t)
-			{
-				__int16 byte = (__int16)(v210Block & 0x3ff);
-				pOutputBuffer[nBlockPos] = byte;
-				nBlockPos++;
-				t = false;
-			}
-			else
-				t = true;
-				 
-			v210Block = v210Block >> 10;
-		}
-	}
-}
+#define VIDEO_SD_MAX_WIDTH 720
 
 //
 // CVANCSplitterInputPin constructor
@@ -81,12 +26,29 @@ CVANCSplitterInputPin::CVANCSplitterInputPin(TCHAR   *pName,
     m_pTee(pTee),
     m_bInsideCheckMediaType(FALSE),
 	m_nPinNumber(PinNumber), 
-	m_pVANCData(NULL),
 	m_hReceiveThread(NULL),
-	m_nPacketStartPos(-1)
+	m_nTimecodeRate(30),
+	m_nFrames(0),
+	m_nCaptionPairs(0),
+	m_nCaptionSamples(0),
+	m_nCaptionDeferred(0),
+	m_nShortSamples(0),
+	m_nServices(0),
+	m_nServiceVersion(0),
+	m_nServiceUpdates(0),
+	m_pConfig(NULL),
+	m_nConfigLine(-1),
+	m_nDetectedLine(-1),
+	m_pPixelFormat(NULL),
+	m_bInsertMode(false),
+	m_nInsertHead(0),
+	m_nInsertTail(0),
+	m_nCDPInserted(0),
+	m_nInsertDropped(0)
 {
     ASSERT(pTee);
 	FilterTrace("CVANCSplitterInputPin::CVANCSplitterInputPin\n");
+
 }
 
 
@@ -97,11 +59,6 @@ CVANCSplitterInputPin::~CVANCSplitterInputPin()
 {
     FilterTrace("CVANCSplitterInputPin::~CVANCSplitterInputPin()\n");
     // ASSERT(m_pTee->m_pAllocator == NULL);
-
-	if (m_pVANCData != NULL)
-		free (m_pVANCData);
-
-	m_pVANCData = NULL;
 }
 
 //
@@ -137,8 +94,28 @@ HRESULT CVANCSplitterInputPin::CheckMediaType(const CMediaType *pmt)
 	m_connectedType.Set(*pmt);
 	m_videoMediaType.Set(*pmt);
 
-	//if (!(pmt->subtype == MEDIASUBTYPE_RGB24 || pmt->subtype == MEDIASUBTYPE_RGB32))
-	//	return VFW_E_TYPE_NOT_ACCEPTED;
+	// Only capture formats the VANC rows can be unpacked from
+	const _pixel_format* pFormat = FindPixelFormat(pmt->subtype);
+
+	if (pmt->majortype != MEDIATYPE_Video || pFormat == NULL ||
+		(pmt->formattype != FORMAT_VideoInfo2 && pmt->formattype != FORMAT_VideoInfo))
+	{
+		m_bInsideCheckMediaType = FALSE;
+		return VFW_E_TYPE_NOT_ACCEPTED;
+	}
+
+	// The frame is read and moved in place, the samples must hold all of it
+	_frame_layout layout;
+	ComputeFrameLayout(pFormat, m_bih.biWidth, m_bih.biHeight, false, &layout);
+
+	if (m_bih.biWidth <= 0 || m_bih.biSizeImage < FrameLayoutFrameLength(layout))
+	{
+		FilterTrace("CVANCSplitterInputPin::CheckMediaType() biSizeImage %u is smaller than the %u byte frame\n",
+			m_bih.biSizeImage, FrameLayoutFrameLength(layout));
+
+		m_bInsideCheckMediaType = FALSE;
+		return VFW_E_TYPE_NOT_ACCEPTED;
+	}
 	 
     // Either all the downstream pins have accepted or there are none.
     m_bInsideCheckMediaType = FALSE;
@@ -160,6 +137,10 @@ HRESULT CVANCSplitterInputPin::SetMediaType(const CMediaType *pmt)
     // Make sure that the base class likes it
     if (FAILED(hr = CBaseInputPin::SetMediaType(pmt)))
         return hr;
+
+	// Select the VANC extraction of the format
+	m_pPixelFormat = FindPixelFormat(pmt->subtype);
+	FilterTrace("CVANCSplitterInputPin::SetMediaType() %s\n", m_pPixelFormat != NULL ? m_pPixelFormat->name : "unsupported format");
   	  
     ASSERT(m_Connected != NULL);
     return NOERROR;
@@ -196,10 +177,41 @@ HRESULT CVANCSplitterInputPin::BreakConnect()
 
 	EndReceiveThread();
 
+	// Release the VANC and field buffers
+	m_extractor.Free();
+
     return NOERROR;
 } // BreakConnect
 
 
+//
+// GetAllocator
+//
+// Offer upstream the growing video pool rather than a fixed CMemAllocator
+//
+STDMETHODIMP
+CVANCSplitterInputPin::GetAllocator(IMemAllocator **ppAllocator)
+{
+	FilterTrace("CVANCSplitterInputPin::GetAllocator()\n");
+	HRESULT hr = NOERROR;
+
+	CheckPointer(ppAllocator, E_POINTER);
+	CAutoLock lock_it(m_pLock);
+
+	if (m_pTee->m_pAllocator == NULL)
+	{
+		if (FAILED(hr = CVANCAllocator::CreateInstance(m_pTee->m_nLatencyBudget, (DWORD)m_pTee->m_nNumaNode, &m_pTee->m_pAllocator)))
+			return hr;
+	}
+
+	*ppAllocator = m_pTee->m_pAllocator;
+	(*ppAllocator)->AddRef();
+
+	return NOERROR;
+
+} // GetAllocator
+
+
 //
 // NotifyAllocator
 //
@@ -212,42 +224,49 @@ CVANCSplitterInputPin::NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly
     CheckPointer(pAllocator,E_FAIL);
     CAutoLock lock_it(m_pLock);
 	 
-    // Free the old allocator if any
-    if (m_pTee->m_pAllocator)
-        m_pTee->m_pAllocator->Release();
-	 
     // Free the old allocator if any
     if (m_pTee->m_pAllocator2)
         m_pTee->m_pAllocator2->Release();
 
-	// Create the primary allocator for video
-	CreateMemoryAllocator(&m_pTee->m_pAllocator);
-	
-	// Create the allocator for captioning
-	CreateMemoryAllocator(&m_pTee->m_pAllocator2);
+	// Create the allocator for captioning. It keeps the configured buffer count
+	// so a slow caption consumer defers captions rather than growing the pool.
+	if (FAILED(hr = CVANCAllocator::CreateInstance(1, FRAME_NUMA_NODE_ANY, &m_pTee->m_pAllocator2)))
+	{
+		m_pTee->m_pAllocator2 = NULL;
+		return hr;
+	}
 
 	// Initialize the properties for the captioning
-	ALLOCATOR_PROPERTIES propRequest, propResults;
-	propRequest.cbAlign = 1;
-	propRequest.cbBuffer = 2;
-	propRequest.cbPrefix = 0;
-	propRequest.cBuffers = 100;
-	m_pTee->m_pAllocator2->SetProperties(&propRequest, &propResults);
-	m_pTee->m_pAllocator2->Commit();
-
-	// Get the current allocator properties for video
-	ALLOCATOR_PROPERTIES props, result;
-	pAllocator->GetProperties(&props);
-	
-	// Allocate 92MB of buffers 
-	long nBuffers = (92160000 / props.cbBuffer);
-	props.cBuffers = nBuffers;
+	m_pTee->ConfigureCaptionAllocator();
 
-	m_pTee->m_pAllocator->SetProperties(&props, &result);
-	m_pTee->m_pAllocator->Commit();
-	 
-	pAllocator->SetProperties(&props, &result);
-	pAllocator->Commit();
+	// When upstream took our pool it has already sized it and commits it itself
+	if (pAllocator != m_pTee->m_pAllocator)
+	{
+		// Free the old allocator if any
+		if (m_pTee->m_pAllocator)
+			m_pTee->m_pAllocator->Release();
+
+		// Create the primary allocator for video
+		if (FAILED(hr = CVANCAllocator::CreateInstance(m_pTee->m_nLatencyBudget, (DWORD)m_pTee->m_nNumaNode, &m_pTee->m_pAllocator)))
+		{
+			m_pTee->m_pAllocator = NULL;
+			return hr;
+		}
+
+		// Get the current allocator properties for video
+		ALLOCATOR_PROPERTIES props, result;
+		pAllocator->GetProperties(&props);
+
+		// Our pool commits the upstream count and grows within the latency budget
+		m_pTee->m_pAllocator->SetProperties(&props, &result);
+		m_pTee->m_pAllocator->Commit();
+
+		// The upstream allocator cannot grow so it gets the budget up front
+		props.cBuffers = max(props.cBuffers, m_pTee->m_nLatencyBudget);
+
+		pAllocator->SetProperties(&props, &result);
+		pAllocator->Commit();
+	}
 
     // Notify the base class about the allocator
     return CBaseInputPin::NotifyAllocator(m_pTee->m_pAllocator,bReadOnly);
@@ -261,6 +280,16 @@ CVANCSplitterInputPin::NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly
 HRESULT CVANCSplitterInputPin::EndOfStream()
 {
 	FilterTrace("CVANCSplitterInputPin::EndOfStream()\n");
+
+	// Deliver any queued captions and partially filled batch
+	if (m_pTee->GetOutputPin(VANC_CAPTION_PIN)->IsConnected())
+	{
+		m_pConfig = m_pTee->EnterConfig();
+		DrainCaptions(true);
+
+		m_pConfig = NULL;
+		m_pTee->LeaveConfig();
+	}
 	
 	EndReceiveThread();
 
@@ -294,12 +323,6 @@ HRESULT CVANCSplitterInputPin::EndFlush()
 
 HRESULT CVANCSplitterInputPin::EndReceiveThread()
 {
-	// Release the VANC buffer 
-	if (m_pVANCData != NULL)
-		free (m_pVANCData);
-	 
-	m_pVANCData = NULL;
-
 	DWORD dwExitCode = 0;
 	m_bRunning = FALSE;
 
@@ -327,7 +350,12 @@ HRESULT CVANCSplitterInputPin::EndReceiveThread()
 	m_hReceiveThread = NULL;
 	_sampleBuffer.empty();
 
-	m_nPacketStartPos = -1;
+	m_captionRing.Reset();
+
+	// The next stream starts its own CDP sequence and announces its own services
+	m_extractor.Reset();
+	m_nServiceVersion = 0;
+
 	return S_OK;
 }
 
@@ -358,6 +386,10 @@ HRESULT CVANCSplitterInputPin::Receive(IMediaSample *pSample)
 		return hr;
   
 	DeliverSample(pSample);  
+
+	// The settings snapshot of the frame may be freed from here on
+	m_pConfig = NULL;
+	m_pTee->LeaveConfig();
   
     return NOERROR;
 
@@ -365,92 +397,79 @@ HRESULT CVANCSplitterInputPin::Receive(IMediaSample *pSample)
  
 HRESULT CVANCSplitterInputPin::DeliverSample(IMediaSample *pSample)
 {
-	BYTE line21Pair[2] = { 0, 0 };
 	BYTE* pBuffer;
-	REFERENCE_TIME timeStart, timeEnd;
 	HRESULT hr = NOERROR;
 	bool bVANCValid = false;
 
+	// Pick up the settings published since the last frame, Receive leaves them
+	m_pConfig = m_pTee->EnterConfig();
+
 	// If the entry does not have a pointer then skip it 
 	if (FAILED(hr = pSample->GetPointer(&pBuffer)))
 		return S_OK;
-     
-	long cbVANCData = m_bih.biWidth * sizeof(__int16);
 
-	// Allocate storage for VANC frame data
-	if (m_pVANCData == NULL)
-		m_pVANCData = (__int16*)malloc(cbVANCData);
+	const _frame_layout& layout = m_extractor.GetLayout();
 
-	m_dwVANCLineOffset = m_dwBytesPerLine * m_pTee->m_nVANCLine;
-
-	// Clear out the buffer
-	memset(m_pVANCData, 0, cbVANCData);
+	// Never read or move past the end of a sample holding less than a frame
+	if ((DWORD)pSample->GetActualDataLength() < FrameLayoutFrameLength(layout))
+	{
+		m_nShortSamples++;
+		return S_OK;
+	}
 
-	// Get a pointer to the v210 VANC data in the frame data
-	__int32* v210Buffer = (__int32*)(pBuffer + m_dwVANCLineOffset);
-  
-	// Get VANC from v210 frame
-	Convert_v210_to_BYTES(v210Buffer, m_dwBytesPerLine, m_pVANCData);
-	 
-	// Test if the vanc line is valid DTVCC line
-	bVANCValid = m_vancParser.IsValidDTVCCPacket(m_pVANCData, cbVANCData / 2);
+	m_nFrames++;
 
-	// If the selected line is not a valid VANC line then find one 
-	if (!bVANCValid)
+	// A newly selected line replaces the detected one
+	if (m_pConfig->nVANCLine != m_nConfigLine)
 	{
-		FilterTrace("CVANCSplitterInputPin::DeliverSample() - **LINE AUTO DETECTION** [ START ] \n");
+		m_nConfigLine = m_pConfig->nVANCLine;
+		m_nDetectedLine = -1;
+	}
 
-		for (int i = 0; i < 30; i++)
-		{ 
-			// Get a pointer to the frame line 
-			v210Buffer = (__int32*)(pBuffer + (m_dwBytesPerLine * i));
-			
-			// Erase the current VANC packet
-			memset(m_pVANCData, 0, m_bih.biWidth * sizeof(__int16));
-
-			// Conver the v210 to a byte array of VANC data 
-			Convert_v210_to_BYTES(v210Buffer, m_dwBytesPerLine, m_pVANCData);
-			
-			if (::IsLogging())
-			{
-				char buffer[1000];
-				memset(buffer, 0, 1000);
+	LONG nVANCLine = (m_nDetectedLine >= 0) ? m_nDetectedLine : m_nConfigLine;
 
-				for(int j = 0; j < 200; j++)
-					sprintf(&buffer[j * 4], "%03x ", m_pVANCData[j]);
+	// Only the start of a row holds the ANC space, wide rows are unpacked up to the scan width
+	long nScanWidth = m_bih.biWidth;
 
-				FilterTrace("LINE %02i > %s \n", i + 1, buffer);
-			}
-			
-			// Test if the vanc line is valid
-			bVANCValid = m_vancParser.IsValidDTVCCPacket(m_pVANCData, cbVANCData / 2);
+	if (m_pConfig->nScanWidth > 0 && m_pConfig->nScanWidth < nScanWidth)
+		nScanWidth = m_pConfig->nScanWidth;
 
-			// If the line contains a VANC marker and contains DTVCC then update the VANC line entry
-			if (bVANCValid)
-			{
-				// Store the VANC line for the next sample and move forward
-				m_pTee->m_nVANCLine = i;
-				FilterTrace("CVANCSplitterInputPin::DeliverSample() - **LINE %i DETECTED** \n", i + 1);
-				break;
-			}
-		}
+	// Sweep the VANC rows of each field and run the registered decoders over their packets
+	m_extractor.ScanFrame(pBuffer, GetExtractFunction(), nScanWidth, (DWORD)m_pConfig->nScanLeadIn);
 
-		FilterTrace("CVANCSplitterInputPin::DeliverSample() - **LINE AUTO DETECTION** [ COMPLETE ] \n");
+	const _vanc_frame_data& frame = m_extractor.GetFrameData();
+
+	// Report the line captions are carried on when the selected line has none
+	const _anc_packet_entry* pCDP = (frame.nCDPCount > 0) ? frame.pCDP[0] : NULL;
+	bool bOnSelectedLine = false;
+
+	for (long i = 0; i < frame.nCDPCount && !bOnSelectedLine; i++)
+		bOnSelectedLine = (frame.pCDP[i]->line == nVANCLine);
+
+	if (pCDP != NULL && !bOnSelectedLine)
+	{
+		// Store the VANC line for the next sample
+		m_nDetectedLine = pCDP->line;
+		FilterTrace("CVANCSplitterInputPin::DeliverSample() - **LINE %i DETECTED** \n", pCDP->line + 1);
 	}
 
+	bVANCValid = (pCDP != NULL);
+
 	if (::IsLogging())
 	{
 		char buffer[1000];
 		memset(buffer, 0, 1000);
-		 
-		for(int i = 0; i < 200; i++)
-			sprintf(&buffer[i * 4], "%03x ", m_pVANCData[i]);
+
+		const __int16* pLine = bVANCValid ? (pCDP->words - pCDP->offset) : m_extractor.GetVANCData();
+
+		for(int i = 0; i < 200 && i < (int)m_extractor.GetWordsPerLine(); i++)
+			sprintf(&buffer[i * 4], "%03x ", pLine[i]);
 
 		FilterTrace("%s \n", buffer);
 	}
 
-	// Get the line21 output pin
-	CVANCSplitterOutputPin *pVidPin = m_pTee->GetPinNFromList(0);
+	// Get the video output pin
+	CVANCSplitterOutputPin *pVidPin = m_pTee->GetOutputPin(VANC_VIDEO_PIN);
  
 	REFERENCE_TIME rtStart;
 	REFERENCE_TIME rtEnd;
@@ -460,80 +479,410 @@ HRESULT CVANCSplitterInputPin::DeliverSample(IMediaSample *pSample)
 	pSample->GetMediaTime(&rtStart, &rtEnd);
 	pSample->GetTime(&tStart, &tEnd);
   
-	pSample->SetMediaType(&m_pTee->GetPinNFromList(0)->m_mt);
+	pSample->SetMediaType(&pVidPin->m_mt);
 
-	BYTE* pNewBuffer;
-	pSample->GetPointer(&pNewBuffer);
-	pSample->SetActualDataLength(pSample->GetActualDataLength() - m_dtvccStart);
+	if (m_bInsertMode)
+	{
+		// The frame goes out whole with the CDP written to the selected row
+		InsertCaptions(pBuffer);
+	}
+	else
+	{
+		BYTE* pNewBuffer;
+		pSample->GetPointer(&pNewBuffer);
+		pSample->SetActualDataLength(FrameLayoutPictureLength(layout));
 
-	memcpy(pNewBuffer, pBuffer + m_dtvccStart, pSample->GetActualDataLength());
+		// Move the picture rows of each plane over the VANC rows, weaving the
+		// fields of a full interlaced raster into an interleaved frame
+		m_extractor.CopyPicture(pBuffer, pNewBuffer);
+	}
     
 	pSample->AddRef();
-	m_pTee->GetPinNFromList(0)->Deliver(pSample);
+	pVidPin->Deliver(pSample);
 
-	// If the VANC pack is valid ....
+	// Parse the caption packets of both fields
 	if (bVANCValid)
-	{   
-		if (m_pTee->GetPinNFromList(1)->IsConnected())
+		DeliverFrameCaptions(tStart, tEnd, rtStart, rtEnd);
+	  
+	pSample->Release();
+	return S_OK;
+}
+
+//
+// DeliverFrameCaptions
+//
+// Deliver the caption records the extractor builds from the CDPs of the frame,
+// see VANCFrameExtractor::ParseCaptions for their timing
+//
+void CVANCSplitterInputPin::DeliverFrameCaptions(REFERENCE_TIME tStart, REFERENCE_TIME tEnd, REFERENCE_TIME rtStart, REFERENCE_TIME rtEnd)
+{
+	bool bDeliver = (m_pTee->GetOutputPin(VANC_CAPTION_PIN)->IsConnected() != FALSE);
+
+	long nCaptions = m_extractor.ParseCaptions(tStart, tEnd, rtStart, rtEnd, (cc_packet_type)m_pConfig->nPacketType,
+		m_pConfig->nPaddingMode, m_nTimecodeRate, bDeliver);
+
+	for (long i = 0; i < nCaptions; i++)
+	{
+		const _vanc_frame_caption& caption = m_extractor.GetCaption(i);
+
+		DeliverCaption(caption.record);
+
+		// Render the caption text to the trace with its time code
+		if (::IsLogging() && !caption.bPadding)
+		{
+			m_608Parser.SetTimecode(caption.timecode);
+			m_608Parser.BufferCB(caption.record.tStart / 10000000.0, (BYTE*)caption.record.pair, 2);
+		}
+	}
+
+	// A ccsvcinfo set completed with a change of services
+	if (m_extractor.GetParser().GetServiceVersion() != m_nServiceVersion)
+		UpdateCaptionServices();
+} // DeliverFrameCaptions
+
+//
+// UpdateCaptionServices
+//
+// Copy the service table of the parser for GetCaptionServices. Only runs when a
+// changed ccsvcinfo set completes, repeats of the set are not decoded.
+//
+void CVANCSplitterInputPin::UpdateCaptionServices()
+{
+	_cdp_service_info_packet services[CDP_MAX_SERVICES];
+	long nServices = m_extractor.GetParser().GetServices(services, CDP_MAX_SERVICES);
+
+	CAutoLock cServicesLock(&m_csServices);
+
+	for (long i = 0; i < nServices; i++)
+	{
+		m_services[i].nServiceNumber = services[i].cdp_cc_service_number;
+		memcpy(m_services[i].szLanguage, services[i].cdp_language, sizeof(m_services[i].szLanguage));
+		m_services[i].bDigitalCC = services[i].cdp_digital_cc;
+		m_services[i].bLine21Field2 = services[i].cdp_line21_field;
+		m_services[i].bEasyReader = services[i].cdp_easy_reader;
+		m_services[i].bWideAspectRatio = services[i].cdp_wide_aspect_ratio;
+	}
+
+	m_nServices = nServices;
+	m_nServiceVersion = m_extractor.GetParser().GetServiceVersion();
+	m_nServiceUpdates++;
+
+	FilterTrace("CVANCSplitterInputPin::UpdateCaptionServices() %i caption services\n", nServices);
+} // UpdateCaptionServices
+
+//
+// GetCaptionServices
+//
+// Called by the application. Copies up to nMaxServices services of the last
+// complete ccsvcinfo set, *pnServices is the number of services in the set.
+// Returns S_FALSE when they did not all fit.
+//
+HRESULT CVANCSplitterInputPin::GetCaptionServices(VANC_CAPTION_SERVICE* pServices, LONG nMaxServices, LONG* pnServices)
+{
+	CAutoLock cServicesLock(&m_csServices);
+
+	LONG nCopied = min(nMaxServices, m_nServices);
+
+	for (LONG i = 0; i < nCopied; i++)
+		pServices[i] = m_services[i];
+
+	*pnServices = m_nServices;
+	return (nCopied == m_nServices) ? S_OK : S_FALSE;
+} // GetCaptionServices
+
+//
+// DeliverCaption
+//
+// Queue a caption byte pair and deliver whatever the Line21 allocator has room for.
+// Delivery never waits for a free sample so a slow caption consumer cannot stall
+// the video path; pairs that do not fit are held in the caption ring.
+//
+HRESULT CVANCSplitterInputPin::DeliverCaption(const VANC_CAPTION_RECORD& record)
+{
+	m_captionRing.Push(record, (caption_overflow_policy)m_pConfig->nCaptionOverflowPolicy);
+	return DrainCaptions(false);
+} // DeliverCaption
+
+//
+// DrainCaptions
+//
+// Deliver queued byte pairs, one per sample or in batches. A flush also sends a
+// partial batch and waits for free samples.
+//
+HRESULT CVANCSplitterInputPin::DrainCaptions(bool bFlush)
+{
+	HRESULT hr = S_OK;
+	long nBatch = max(m_pConfig->nCaptionBatch, 1);
+
+	while (m_captionRing.GetCount() > 0)
+	{
+		long nCount = m_captionRing.GetCount();
+		long nRecords = min(nCount, nBatch);
+
+		// A partial batch is only sent once it spans the configured time window
+		if (nRecords < nBatch && !bFlush)
 		{
-			// if DTVCC packet start is undefined or the existing packet is not a DTVCC packet then find it
-			if (m_nPacketStartPos < 0 || !m_vancParser.IsValidDTVCCPacketPos(m_pVANCData + m_nPacketStartPos))
-				m_nPacketStartPos = m_vancParser.GetDTVCCPacketPos(m_pVANCData, m_dwBytesPerLine);
+			if (m_pConfig->rtCaptionWindow <= 0 ||
+				(m_captionRing.Peek(nCount - 1).tStart - m_captionRing.Peek(0).tStart) < m_pConfig->rtCaptionWindow)
+				break;
+		}
 
-			// If the packet exists then process and deliver
-			if (m_nPacketStartPos > -1)
+		if (FAILED(hr = DeliverCaptionSample(nRecords, bFlush ? 0 : AM_GBF_NOWAIT)))
+		{
+			// No free sample, keep the pairs queued for the next frame
+			if (hr == VFW_E_TIMEOUT)
 			{
-				bool bPacketValid = false;
-
-				try
-				{
-					// Parse the VANC data
-					m_vancParser.Parse(m_pVANCData + m_nPacketStartPos);
-
-					// Get th 608 packet byte-pair from the VANC packet
-					bPacketValid = m_vancParser.Get608Packet(line21Pair, m_pTee->GetPacketType());
-				}
-				catch (...)
-				{
-					FilterTrace("CVANCSplitterInputPin::DeliverSample() - **CRITICAL** failure while parsing packet\n");
-					// critical failure. 
-				}
-
-				// If the default valid packet type is CC1 and no data then try CC2. This is a hack since 
-				// we normally will expect captioning data on CC1 for the primary caption signal. We check
-				// for 0x80 (128) 0x80 (128) which is no data. 
-				//if (bPacketValid && m_pTee->GetPacketType() == NTSC_CC1 && line21Pair[0] == 0x80 && line21Pair[1] == 0x80)
-				//	bPacketValid = m_vancParser.Get608Packet(line21Pair, NTSC_CC2);
-
-				// Get th 608 packet byte-pair from the VANC packet
-				if (bPacketValid)
-				{
-					// Get the line21 output pin
-					CVANCSplitterOutputPin *pCCPin = m_pTee->GetPinNFromList(1);
-
-					// Create a new media sample
-					CComPtr<IMediaSample> pOutSample;
-
-					// Get a new delivery buffer (blocks until one available)
-					hr = pCCPin->GetDeliveryBuffer( &pOutSample, &timeStart, &timeEnd, 0);
-
-					if (SUCCEEDED(hr))
-					{
-						pOutSample->GetPointer(&pBuffer);
-						memcpy(pBuffer, line21Pair, 2);
-						pOutSample->SetActualDataLength(2);
-						pOutSample->SetMediaTime(&rtStart, &rtEnd);
-						pOutSample->SetTime(&tStart, &tEnd);
-						pCCPin->Deliver(pOutSample);
-					}
-				}	
+				m_nCaptionDeferred++;
+				hr = S_OK;
 			}
+
+			break;
 		}
 	}
-	  
-	pSample->Release();
-	return S_OK;
-}
+
+	return hr;
+} // DrainCaptions
+
+//
+// DeliverCaptionSample
+//
+// Deliver the oldest nRecords queued pairs in a single sample
+//
+HRESULT CVANCSplitterInputPin::DeliverCaptionSample(long nRecords, DWORD dwFlags)
+{
+	HRESULT hr = NOERROR;
+	BYTE* pBuffer = NULL;
+
+	// Get the line21 output pin
+	CVANCSplitterOutputPin *pCCPin = m_pTee->GetOutputPin(VANC_CAPTION_PIN);
+
+	REFERENCE_TIME tStart = m_captionRing.Peek(0).tStart;
+	REFERENCE_TIME tEnd = m_captionRing.Peek(nRecords - 1).tStop;
+	REFERENCE_TIME rtStart = m_captionRing.Peek(0).tMediaStart;
+	REFERENCE_TIME rtEnd = m_captionRing.Peek(nRecords - 1).tMediaStop;
+
+	// Create a new media sample
+	CComPtr<IMediaSample> pOutSample;
+
+	// Get a new delivery buffer
+	if (FAILED(hr = pCCPin->GetDeliveryBuffer(&pOutSample, &tStart, &tEnd, dwFlags)))
+		return hr;
+
+	pOutSample->GetPointer(&pBuffer);
+
+	if (m_pConfig->nCaptionBatch > 1)
+	{
+		m_captionRing.CopyTo((VANC_CAPTION_RECORD*)pBuffer, nRecords);
+		pOutSample->SetActualDataLength(nRecords * sizeof(VANC_CAPTION_RECORD));
+	}
+	else
+	{
+		memcpy(pBuffer, m_captionRing.Peek(0).pair, 2);
+		pOutSample->SetActualDataLength(2);
+	}
+
+	pOutSample->SetMediaTime(&rtStart, &rtEnd);
+	pOutSample->SetTime(&tStart, &tEnd);
+	m_captionRing.Pop(nRecords);
+
+	m_nCaptionPairs += nRecords;
+	m_nCaptionSamples++;
+
+	return pCCPin->Deliver(pOutSample);
+} // DeliverCaptionSample
+
+//
+// QueueInsertData
+//
+// Called by the application, the streaming thread takes the triplets for the
+// CDP of each frame. Returns S_FALSE when some triplets did not fit.
+//
+HRESULT CVANCSplitterInputPin::QueueInsertData(const BYTE* pCCData, LONG nCount)
+{
+	CAutoLock cInsertLock(&m_csInsert);
+
+	LONG nQueued = 0;
+
+	for (; nQueued < nCount && (m_nInsertTail - m_nInsertHead) < VANC_INSERT_QUEUE_SIZE; nQueued++)
+	{
+		memcpy(m_insertQueue[m_nInsertTail & (VANC_INSERT_QUEUE_SIZE - 1)], pCCData + (nQueued * 3), 3);
+		m_nInsertTail++;
+	}
+
+	m_nInsertDropped += nCount - nQueued;
+	return (nQueued == nCount) ? S_OK : S_FALSE;
+} // QueueInsertData
+
+//
+// InsertCaptions
+//
+// Build the CDP of the frame from the queued cc_data, padded when nothing is
+// queued, and write it to the selected row in place. Only the pixel groups
+// holding the packet are touched.
+//
+void CVANCSplitterInputPin::InsertCaptions(BYTE* pBuffer)
+{
+	BYTE ccData[CDP_MAX_CC_COUNT][3];
+	long nCCData = 0;
+
+	{
+		CAutoLock cInsertLock(&m_csInsert);
+
+		while (nCCData < m_vancEncoder.GetCCCount() && m_nInsertHead != m_nInsertTail)
+		{
+			memcpy(ccData[nCCData++], m_insertQueue[m_nInsertHead & (VANC_INSERT_QUEUE_SIZE - 1)], 3);
+			m_nInsertHead++;
+		}
+	}
+
+	const _frame_layout& layout = m_extractor.GetLayout();
+	const _vanc_frame_data& frame = m_extractor.GetFrameData();
+	long nRow = m_pConfig->nVANCLine;
+
+	if (nRow < 0 || nRow >= layout.nHeight)
+		return;
+
+	// The multiplexed stream has two words per pixel, luma and chroma one
+	DWORD dwCapacity = PixelFormatWordsPerLine(m_pPixelFormat, m_bih.biWidth);
+
+	if (GetExtractionMode() != VANC_EXTRACT_MULTIPLEXED)
+		dwCapacity /= 2;
+
+	long nWords = m_vancEncoder.Encode(ccData, nCCData, frame.timecode.valid ? &frame.timecode : NULL, m_insertWords);
+
+	if ((DWORD)nWords > dwCapacity)
+	{
+		FilterTrace("CVANCSplitterInputPin::InsertCaptions() - CDP of %i words does not fit line %i\n", nWords, nRow + 1);
+		return;
+	}
+
+	GetInsertFunction()(pBuffer, layout.dwStride, layout.nHeight, nRow, m_insertWords, (DWORD)nWords);
+	m_nCDPInserted++;
+} // InsertCaptions
+
+//
+// GetStatistics
+//
+void CVANCSplitterInputPin::GetStatistics(VANC_SPLITTER_STATS* pStats)
+{
+	_cdp_continuity_stats continuity;
+	m_extractor.GetContinuityStats(&continuity);
+
+	_vanc_extractor_stats extraction;
+	m_extractor.GetStats(&extraction);
+
+	pStats->nFrames = m_nFrames;
+	pStats->nCDPPackets = continuity.nPackets;
+	pStats->nCDPGaps = continuity.nGaps;
+	pStats->nCDPRepeats = continuity.nRepeats;
+	pStats->nCDPCounterMismatches = continuity.nMismatches;
+	pStats->nCDPMalformed = extraction.nCDPMalformed;
+	pStats->nCDPChecksumErrors = extraction.nCDPChecksumErrors;
+	pStats->nPaddingFrames = extraction.nPaddingFrames;
+	pStats->nCaptionServiceUpdates = m_nServiceUpdates;
+	pStats->nShortSamples = m_nShortSamples;
+	pStats->nCaptionPairs = m_nCaptionPairs;
+	pStats->nCaptionSamples = m_nCaptionSamples;
+	pStats->nCaptionQueued = m_captionRing.GetCount();
+	pStats->nCaptionDeferred = m_nCaptionDeferred;
+
+	_caption_ring_stats ring;
+	m_captionRing.GetStats(&ring);
+	pStats->nCaptionDroppedOldest = ring.nDroppedOldest;
+	pStats->nCaptionDroppedNewest = ring.nDroppedNewest;
+	pStats->nCaptionCoalesced = ring.nCoalesced;
+
+	_vanc_index_stats index;
+	m_extractor.GetIndexStats(&index);
+	pStats->nVANCRows = index.nLines;
+	pStats->nVANCBytesRead = extraction.llVANCBytesRead;
+	pStats->nVANCWordsScanned = index.nWordsScanned;
+	pStats->nVANCBytesPerRow = (index.nLines > 0) ? (LONG)((extraction.llVANCBytesRead + (index.nWordsScanned * sizeof(__int16))) / index.nLines) : 0;
+
+	{
+		CAutoLock cInsertLock(&m_csInsert);
+		pStats->nCDPInserted = m_nCDPInserted;
+		pStats->nInsertQueued = (LONG)(m_nInsertTail - m_nInsertHead);
+		pStats->nInsertDropped = m_nInsertDropped;
+	}
+
+	if (m_pTee->m_pAllocator != NULL)
+	{
+		_vanc_allocator_stats pool;
+		m_pTee->m_pAllocator->GetStats(&pool);
+		pStats->nVideoBuffers = pool.nBuffers;
+		pStats->nVideoPeakBuffers = pool.nPeakBuffers;
+		pStats->nVideoPoolGrowths = pool.nGrowths;
+		pStats->nVideoPoolShrinks = pool.nShrinks;
+		pStats->nVideoLargePageBuffers = pool.nLargePageBuffers;
+		pStats->nVideoPoolWaits = pool.nWaits;
+		pStats->nVideoPoolBytes = pool.nFootprint;
+	}
+} // GetStatistics
+
+//
+// GetExtractionMode
+//
+// SD frames multiplex the ANC across all samples, HD carries it in luma unless
+// the chroma stream is selected
+//
+LONG CVANCSplitterInputPin::GetExtractionMode()
+{
+	LONG nMode = m_pConfig->nExtractionMode;
+
+	if (nMode == VANC_EXTRACT_AUTO)
+		nMode = (m_bih.biWidth <= VIDEO_SD_MAX_WIDTH) ? VANC_EXTRACT_MULTIPLEXED : VANC_EXTRACT_LUMA;
+
+	return nMode;
+} // GetExtractionMode
+
+//
+// GetExtractFunction
+//
+PFN_EXTRACT_LINE CVANCSplitterInputPin::GetExtractFunction()
+{
+	switch (GetExtractionMode())
+	{
+		case VANC_EXTRACT_CHROMA:
+			return m_pPixelFormat->pfnExtractChroma;
+		case VANC_EXTRACT_MULTIPLEXED:
+			return m_pPixelFormat->pfnExtractMultiplexed;
+		default:
+			return m_pPixelFormat->pfnExtractLuma;
+	}
+} // GetExtractFunction
+
+//
+// GetInsertFunction
+//
+PFN_INSERT_LINE CVANCSplitterInputPin::GetInsertFunction()
+{
+	switch (GetExtractionMode())
+	{
+		case VANC_EXTRACT_CHROMA:
+			return m_pPixelFormat->pfnInsertChroma;
+		case VANC_EXTRACT_MULTIPLEXED:
+			return m_pPixelFormat->pfnInsertMultiplexed;
+		default:
+			return m_pPixelFormat->pfnInsertLuma;
+	}
+} // GetInsertFunction
+
+//
+// GetVANCLine
+//
+LONG CVANCSplitterInputPin::GetVANCLine()
+{
+	LONG nDetectedLine = m_nDetectedLine;
+
+	CAutoLock cConfigLock(&m_pTee->m_csConfig);
+	LONG nConfigLine = m_pTee->GetConfig()->nVANCLine;
+
+	if (nDetectedLine >= 0 && m_nConfigLine == nConfigLine)
+		return nDetectedLine;
+
+	return nConfigLine;
+} // GetVANCLine
 
 //
 // Completed a connection to a pin
@@ -550,7 +899,7 @@ HRESULT CVANCSplitterInputPin::CompleteConnect(IPin *pReceivePin)
  
 	if (this->IsConnected())
 	{
-		m_vancParser.SetTrace(NULL);
+		m_extractor.GetParser().SetTrace(NULL);
 
 		// Initialize logger (create .packets file)
 		if (m_pTee->GetLogFileName()[0] != NULL)
@@ -559,7 +908,7 @@ HRESULT CVANCSplitterInputPin::CompleteConnect(IPin *pReceivePin)
 			memset(szPath, 0, sizeof(szPath));
 			_tcscpy_s<MAX_PATH>(szPath, m_pTee->GetLogFileName());
 			_tcscat_s<MAX_PATH>(szPath, L".packets");
-			m_vancParser.SetTrace(szPath);
+			m_extractor.GetParser().SetTrace(szPath);
 		}
  
 		// Get the first output pin
@@ -569,36 +918,56 @@ HRESULT CVANCSplitterInputPin::CompleteConnect(IPin *pReceivePin)
 		// m_videoMediaType.Set(m_mt);
 		memcpy(m_videoMediaType.pbFormat, m_mt.pbFormat, m_mt.cbFormat);
 		 
-		// Get the total bytes per line
-		m_dwBytesPerLine = (m_bih.biSizeImage / m_bih.biHeight);  
-		  
-		// Get the VANC offset
-		m_dwVANCLineOffset = m_dwBytesPerLine * m_pTee->m_nVANCLine;
-  
-		// Get the start position of video (after the VANC)
-		m_dtvccStart = (m_dwBytesPerLine * VIDEO_VANC_LINES);
-		
-		// Calc the new length of the video
-		m_dwFrameLength = m_bih.biSizeImage - m_dtvccStart;
-
-		// Remove any existing VANC buffer
-		if (m_pVANCData != NULL)
-			free (m_pVANCData);
+		// Locate the VANC and picture rows of both fields
+		bool bInterlaced = (m_mt.formattype == FORMAT_VideoInfo2) &&
+			((((VIDEOINFOHEADER2*)m_mt.pbFormat)->dwInterlaceFlags & AMINTERLACE_IsInterlaced) != 0);
+
+		// Storage for the unpacked VANC rows of a frame and the field buffer of the
+		// picture copy, kept until the pin disconnects so that streaming never allocates
+		if (FAILED(hr = m_extractor.SetFormat(m_pPixelFormat, m_bih.biWidth, m_bih.biHeight, bInterlaced)))
+			return hr;
+
+		const _frame_layout& layout = m_extractor.GetLayout();
+
+		FilterTrace("CVANCSplitterInputPin::CompleteConnect() %s, %i VANC rows in %i field(s), picture %i rows\n",
+			layout.standard, layout.nVANCRows, layout.nFields, layout.nPictureHeight);
+
+		// Get the nominal time code rate (frame pairs above 30 fps share a label)
+		REFERENCE_TIME avgTimePerFrame = 0;
+
+		if (m_mt.formattype == FORMAT_VideoInfo2)
+			avgTimePerFrame = ((VIDEOINFOHEADER2*)m_mt.pbFormat)->AvgTimePerFrame;
+		else if (m_mt.formattype == FORMAT_VideoInfo)
+			avgTimePerFrame = ((VIDEOINFOHEADER*)m_mt.pbFormat)->AvgTimePerFrame;
+
+		m_nTimecodeRate = (avgTimePerFrame > 0) ? (long)((10000000 + (avgTimePerFrame / 2)) / avgTimePerFrame) : 30;
+		m_nTimecodeRate = min(m_nTimecodeRate, 30);
+
+		// CDPs written in insert mode carry the frame rate of the stream
+		m_bInsertMode = (m_pTee->m_nOutputMode == VANC_OUTPUT_INSERT);
+		m_vancEncoder.SetFrameRate(avgTimePerFrame);
+		m_vancEncoder.Reset();
 		 
-		if (m_videoMediaType.formattype == FORMAT_VideoInfo2)
+		// In insert mode the output keeps the size of the captured frame
+		if (m_bInsertMode)
+		{
+			CAutoLock cConfigLock(&m_pTee->m_csConfig);
+			FilterTrace("CVANCSplitterInputPin::CompleteConnect() inserting captions on line %i\n", m_pTee->GetConfig()->nVANCLine + 1);
+		}
+		else if (m_videoMediaType.formattype == FORMAT_VideoInfo2)
 		{ 
 			// Adjust the target output video size to exclude the VANC content
 			VIDEOINFOHEADER2* pVIH = (VIDEOINFOHEADER2*)m_videoMediaType.pbFormat;
-			pVIH->bmiHeader.biHeight = m_bih.biHeight - VIDEO_VANC_LINES;
-			pVIH->bmiHeader.biSizeImage = m_dwBytesPerLine * (m_bih.biHeight - VIDEO_VANC_LINES);
+			pVIH->bmiHeader.biHeight = layout.nPictureHeight;
+			pVIH->bmiHeader.biSizeImage = FrameLayoutPictureLength(layout);
 				
 		}
 		else if (m_videoMediaType.formattype == FORMAT_VideoInfo)
 		{
 			// Adjust the target output video size to exclude the VANC content
 			VIDEOINFOHEADER* pVIH = (VIDEOINFOHEADER*)m_videoMediaType.pbFormat;
-			pVIH->bmiHeader.biHeight = m_bih.biHeight - VIDEO_VANC_LINES;
-			pVIH->bmiHeader.biSizeImage = m_dwBytesPerLine * (m_bih.biHeight - VIDEO_VANC_LINES);
+			pVIH->bmiHeader.biHeight = layout.nPictureHeight;
+			pVIH->bmiHeader.biSizeImage = FrameLayoutPictureLength(layout);
 		}
 
 		pOutputPin->SetMediaType(&m_videoMediaType);
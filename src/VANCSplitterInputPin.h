@@ -11,13 +11,20 @@
 #include "global.h"
 #include <stdio.h>
 #include "VANCParser.h"
+#include "VANCEncoder.h"
+#include "VANCFrameExtractor.h"
+#include "CaptionRing.h"
 #include "608CaptionParser.h"
 #include <vector>
 #include <queue>
 #include "MediaSampleX.h"
+#include "VANCSplitterTypes.h"
+#include "PixelFormat.h"
+#include "FrameLayout.h"
 
 class CVANCSplitter;
 class CVANCSplitterOutputPin;
+struct _vanc_splitter_config;
  
 class CVANCSplitterInputPin : public CBaseInputPin
 {
@@ -27,18 +34,37 @@ class CVANCSplitterInputPin : public CBaseInputPin
     BOOL m_bInsideCheckMediaType;  // Re-entrancy control
 	BITMAPINFOHEADER m_bih;
 	CMediaType m_connectedType;
-	VANCParser m_vancParser;
+	VANCFrameExtractor m_extractor;	// VANC sweep, picture copy and caption records of a frame
 	CMediaType m_videoMediaType;
 	C608CaptionParser m_608Parser;
-	__int16* m_pVANCData;
-	DWORD m_dwBytesPerLine;
-	DWORD m_dwVANCLineOffset;
-	__int32 m_dtvccStart;
-	DWORD m_dwFrameLength;
 	HANDLE m_hReceiveThread;
 	queue<CMediaSampleX*> _sampleBuffer;
 	BOOL m_bRunning;
-	long m_nPacketStartPos;
+	long m_nTimecodeRate;
+	LONG m_nFrames;
+	CCaptionRing m_captionRing;
+	LONG m_nCaptionPairs;
+	LONG m_nCaptionSamples;
+	LONG m_nCaptionDeferred;
+	LONG m_nShortSamples;			// samples smaller than the connected frame size
+	CCritSec m_csServices;			// guards the caption service table
+	VANC_CAPTION_SERVICE m_services[CDP_MAX_SERVICES];	// services of the last complete ccsvcinfo set
+	LONG m_nServices;
+	LONG m_nServiceVersion;			// parser service version of m_services
+	LONG m_nServiceUpdates;
+	const _vanc_splitter_config* m_pConfig;	// settings of the frame being processed
+	LONG m_nConfigLine;				// selected line of m_pConfig
+	volatile LONG m_nDetectedLine;	// line captions were found on (-1 = selected line)
+	const _pixel_format* m_pPixelFormat;	// format of the connected media type
+	VANCEncoder m_vancEncoder;
+	bool m_bInsertMode;				// deliver the full frame with a CDP inserted
+	CCritSec m_csInsert;			// guards the insert queue
+	BYTE m_insertQueue[VANC_INSERT_QUEUE_SIZE][3];	// cc_data triplets to insert
+	unsigned long m_nInsertHead;
+	unsigned long m_nInsertTail;
+	LONG m_nCDPInserted;
+	LONG m_nInsertDropped;
+	__int16 m_insertWords[ANC_MAX_PACKET_WORDS + PIXEL_FORMAT_WORD_SLACK];
 
 public:
 
@@ -59,6 +85,7 @@ public:
     // Reconnect outputs if necessary at end of completion
     virtual HRESULT CompleteConnect(IPin *pReceivePin);
 
+    STDMETHODIMP GetAllocator(IMemAllocator **ppAllocator);
     STDMETHODIMP NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly);
 
     // Pass through calls downstream
@@ -76,4 +103,27 @@ public:
 	// Handles receive background operations
 	HRESULT DeliverSample(IMediaSample *pSample);
 	HRESULT EndReceiveThread();
+
+	// Caption delivery
+	void DeliverFrameCaptions(REFERENCE_TIME tStart, REFERENCE_TIME tEnd, REFERENCE_TIME rtStart, REFERENCE_TIME rtEnd);
+	HRESULT DeliverCaption(const VANC_CAPTION_RECORD& record);
+	void UpdateCaptionServices();
+	HRESULT DrainCaptions(bool bFlush);
+	HRESULT DeliverCaptionSample(long nRecords, DWORD dwFlags);
+
+	// Streaming statistics
+	void GetStatistics(VANC_SPLITTER_STATS* pStats);
+
+	// Line the captions are read from
+	LONG GetVANCLine();
+
+	// Caption insertion
+	HRESULT QueueInsertData(const BYTE* pCCData, LONG nCount);
+	HRESULT GetCaptionServices(VANC_CAPTION_SERVICE* pServices, LONG nMaxServices, LONG* pnServices);
+	void InsertCaptions(BYTE* pBuffer);
+
+	// Row extraction and insertion for the format and selected mode
+	LONG GetExtractionMode();
+	PFN_EXTRACT_LINE GetExtractFunction();
+	PFN_INSERT_LINE GetInsertFunction();
 };
@@ -78,7 +78,7 @@ CVANCSplitterOutputPin::CVANCSplitterOutputPin(TCHAR *pName,
     m_cOurRef(0),
     m_bInsideCheckMediaType(FALSE)
 {
-	  
+	ZeroMemory(&m_deliveryStats, sizeof(m_deliveryStats));
     ASSERT(pTee);
 }
 
@@ -418,7 +418,10 @@ HRESULT CVANCSplitterOutputPin::Active()
     // Create the output queue if we have to
     if(m_pOutputQueue == NULL)
     {
-        m_pOutputQueue = new COutputQueue(m_Connected, &hr, TRUE, FALSE);
+        m_pOutputQueue = new CVANCOutputQueue(m_Connected, &hr,
+                                              m_pTee->m_bSharedDelivery ? m_pTee->GetDeliveryThread() : NULL,
+                                              m_pTee->m_nDeliveryBatch,
+                                              m_pTee->m_dwDeliveryTimeout);
         if(m_pOutputQueue == NULL)
             return E_OUTOFMEMORY;
 
@@ -453,6 +456,12 @@ HRESULT CVANCSplitterOutputPin::Inactive()
     // Delete the output queus associated with the pin.
     if(m_pOutputQueue)
     {
+        _output_queue_stats stats;
+        m_pOutputQueue->GetStats(&stats);
+        m_deliveryStats.nSamples += stats.nSamples;
+        m_deliveryStats.nBatches += stats.nBatches;
+        m_deliveryStats.nWakeups += stats.nWakeups;
+
         delete m_pOutputQueue;
         m_pOutputQueue = NULL;
     }
@@ -463,6 +472,33 @@ HRESULT CVANCSplitterOutputPin::Inactive()
 } // Inactive
 
 
+//
+// GetDeliveryStats
+//
+// Adds the counters of the current queue to those of the queues deleted at
+// earlier stops. pThreads is incremented when the queue runs its own thread.
+//
+void CVANCSplitterOutputPin::GetDeliveryStats(_output_queue_stats *pStats, LONG *pThreads)
+{
+    CAutoLock lock_it(m_pLock);
+
+    *pStats = m_deliveryStats;
+
+    if(m_pOutputQueue == NULL)
+        return;
+
+    _output_queue_stats stats;
+    m_pOutputQueue->GetStats(&stats);
+    pStats->nSamples += stats.nSamples;
+    pStats->nBatches += stats.nBatches;
+    pStats->nWakeups += stats.nWakeups;
+
+    if(m_pOutputQueue->HasOwnThread())
+        (*pThreads)++;
+
+} // GetDeliveryStats
+
+
 //
 // Deliver
 //
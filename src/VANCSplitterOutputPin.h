@@ -9,6 +9,7 @@
 
 #include "stdafx.h"
 #include "global.h"
+#include "VANCOutputQueue.h"
 
 class CVANCSplitter;
 class CVANCSplitterInputPin;
@@ -23,7 +24,8 @@ class CVANCSplitterOutputPin : public CBaseOutputPin
     IUnknown *m_pPosition;      // Pass seek calls upstream
     BOOL m_bHoldsSeek;             // Is this the one seekable stream
 
-    COutputQueue *m_pOutputQueue;  // Streams data to the peer pin
+    CVANCOutputQueue *m_pOutputQueue;  // Streams data to the peer pin
+    _output_queue_stats m_deliveryStats;  // Counters of queues already deleted
     BOOL m_bInsideCheckMediaType;  // Re-entrancy control
     LONG m_cOurRef;                // We maintain reference counting
  
@@ -81,4 +83,7 @@ public:
     // Overriden to handle quality messages
     STDMETHODIMP Notify(IBaseFilter *pSender, Quality q);
 	HRESULT GetMediaType(int iPosition, CMediaType *pMediaType);
+
+	// Delivery counters since the filter was created
+	void GetDeliveryStats(_output_queue_stats *pStats, LONG *pThreads);
 };
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Largest number of byte pairs packed into one batched caption sample
+#define VANC_CAPTION_MAX_BATCH 1024
+
+// One 608 byte pair of a batched caption sample (MEDIASUBTYPE_VANCLine21_Batch).
+// A batched sample is an array of these records.
+typedef struct _VANC_CAPTION_RECORD
+{
+	REFERENCE_TIME tStart;			// stream time of the frame carrying the pair
+	REFERENCE_TIME tStop;
+	REFERENCE_TIME tMediaStart;		// media time (time code frame count when time coded)
+	REFERENCE_TIME tMediaStop;
+	BYTE pair[2];
+	BYTE reserved[6];
+} VANC_CAPTION_RECORD;
+
+// What to do with caption byte pairs when the Line21 consumer falls behind and the
+// pending caption ring is full
+enum caption_overflow_policy
+{
+	CAPTION_DROP_OLDEST = 0,		// discard the oldest queued pair
+	CAPTION_DROP_NEWEST = 1,		// discard the incoming pair
+	CAPTION_COALESCE_NULL = 2		// merge away null pairs first, then drop the oldest
+};
+
+// Which samples of a VANC row carry the ANC packets
+enum vanc_extraction_mode
+{
+	VANC_EXTRACT_AUTO = 0,			// multiplexed for SD frames, luma otherwise
+	VANC_EXTRACT_LUMA = 1,			// HD ANC in the Y stream (ST 292 / ST 334)
+	VANC_EXTRACT_CHROMA = 2,		// HD ANC in the C stream
+	VANC_EXTRACT_MULTIPLEXED = 3	// SD ANC across Cb Y Cr Y (ST 125 / ST 259)
+};
+
+// What the video output pin delivers
+enum vanc_output_mode
+{
+	VANC_OUTPUT_STRIP = 0,			// the picture, VANC rows removed
+	VANC_OUTPUT_INSERT = 1			// the full frame with a CDP written to the selected line
+};
+
+// A caption service announced by the ccsvcinfo section of the CDPs
+// (caption_service_descriptor, ATSC A/65), reported by IVANCSplitter2::GetCaptionServices
+typedef struct _VANC_CAPTION_SERVICE
+{
+	LONG nServiceNumber;			// caption_service_number
+	char szLanguage[4];				// ISO 639.2 code, null terminated
+	BOOL bDigitalCC;				// DTVCC service, otherwise a line 21 service
+	BOOL bLine21Field2;				// line 21 service on field 2
+	BOOL bEasyReader;
+	BOOL bWideAspectRatio;			// formatted for 16:9
+} VANC_CAPTION_SERVICE;
+
+// What the input pin does with CDPs whose cc_data is all padding
+enum vanc_padding_mode
+{
+	VANC_PADDING_PARSE = 0,			// parse them like any CDP and deliver their 608 pairs
+	VANC_PADDING_NULL_SAMPLE = 1,	// skip the parse, deliver a null pair per pair of the service to keep the caption cadence
+	VANC_PADDING_SKIP = 2			// skip the parse and deliver nothing
+};
+
+// cc_data triplets waiting to be inserted (power of two)
+#define VANC_INSERT_QUEUE_SIZE 1024
+
+// Pixels of a VANC row unpacked by default. The ANC space starts each row, so
+// UHD rows are scanned no further than an HD row.
+#define VANC_SCAN_DEFAULT_WIDTH 1920
+
+// Streaming statistics reported by IVANCSplitter2::GetStatistics
+typedef struct _VANC_SPLITTER_STATS
+{
+	LONG nFrames;					// video frames received
+	LONG nCDPPackets;				// caption packets checked for continuity
+	LONG nCDPGaps;					// CDP sequence counter gaps
+	LONG nCDPRepeats;				// repeated CDPs dropped
+	LONG nCDPCounterMismatches;		// CDPs whose header and footer counters differ
+	LONG nCaptionPairs;				// 608 byte pairs delivered
+	LONG nCaptionSamples;			// caption media samples delivered
+	LONG nCaptionQueued;			// byte pairs waiting for a free caption sample
+	LONG nCaptionDeferred;			// deliveries deferred because no sample was free
+	LONG nCaptionDroppedOldest;		// queued pairs dropped on overflow
+	LONG nCaptionDroppedNewest;		// incoming pairs dropped on overflow
+	LONG nCaptionCoalesced;			// null pairs merged away on overflow
+	LONG nVideoBuffers;				// video pool buffers currently allocated
+	LONG nVideoPeakBuffers;			// largest video pool size since commit
+	LONG nVideoPoolGrowths;			// buffers added to the video pool on demand
+	LONG nVideoPoolShrinks;			// idle video pool buffers released
+	LONG nVideoLargePageBuffers;	// video pool buffers backed by large pages
+	LONG nVideoPoolWaits;			// video buffer requests that waited for a free buffer
+	LONGLONG nVideoPoolBytes;		// memory committed by the video pool
+	LONG nDeliveryThreads;			// threads delivering to the output pins
+	LONG nDeliveryWakeups;			// times a delivery thread was signalled
+	LONG nDeliveryBatches;			// Receive / ReceiveMultiple calls downstream
+	LONG nDeliverySamples;			// samples delivered downstream
+	LONG nVANCRows;					// VANC rows scanned
+	LONGLONG nVANCBytesRead;		// frame bytes unpacked from the VANC rows
+	LONGLONG nVANCWordsScanned;		// unpacked words searched for ANC packets
+	LONG nVANCBytesPerRow;			// average bytes touched per VANC row
+	LONG nCDPInserted;				// CDPs written to the video frames
+	LONG nInsertQueued;				// cc_data triplets waiting to be inserted
+	LONG nInsertDropped;			// cc_data triplets rejected because the queue was full
+	LONG nCDPMalformed;				// CDPs dropped because their sections overrun the data count or lack their ids
+	LONG nPaddingFrames;			// frames whose CDPs were all padding and skipped the parse
+	LONG nCaptionServiceUpdates;	// caption service tables decoded from the ccsvcinfo sections
+	LONG nShortSamples;				// input samples dropped because they hold less than a whole frame
+	LONG nCDPChecksumErrors;		// CDPs dropped because their ANC checksum or CDP packet_checksum failed
+} VANC_SPLITTER_STATS;
@@ -0,0 +1,44 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Forced include (/FI) of VANCAllocationTest. Every memcpy and memmove the
+// extraction core compiles, including those of the FrameLayout copy helpers and
+// CopyMemory, goes through a counting wrapper instead of the CRT or the compiler
+// intrinsic, so the bytes a frame copies are measured rather than reported by
+// the code under test. Copies the compiler generates for structure assignments
+// are not seen.
+
+#include <string.h>
+#include <memory.h>
+#include <wchar.h>
+
+#ifdef __cplusplus
+#include <cstring>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void* __cdecl CountedMemcpy(void* pDest, const void* pSource, size_t nBytes);
+void* __cdecl CountedMemmove(void* pDest, const void* pSource, size_t nBytes);
+
+#ifdef __cplusplus
+}
+
+namespace std
+{
+	using ::CountedMemcpy;
+	using ::CountedMemmove;
+}
+#endif
+
+// The wrappers call the CRT as (memcpy)(...), which the macros leave alone
+#define memcpy(pDest, pSource, nBytes) CountedMemcpy(pDest, pSource, nBytes)
+#define memmove(pDest, pSource, nBytes) CountedMemmove(pDest, pSource, nBytes)
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+// perf_event_open type and config of each counter
+static const struct
+{
+	__u32 type;
+	__u64 config;
+} g_perfEvents[PERF_COUNTER_COUNT] =
+{
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+#endif
+
+PerfCounters::PerfCounters(void)
+	: m_nOpen(0)
+{
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		m_nSlot[i] = -1;
+#ifdef __linux__
+		m_fds[i] = -1;
+#endif
+	}
+}
+
+PerfCounters::~PerfCounters(void)
+{
+	Close();
+}
+
+// Open the counters the machine offers, the first one opened leads the group
+void PerfCounters::Open()
+{
+	Close();
+
+#ifdef __linux__
+	int nLeader = -1;
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = g_perfEvents[i].type;
+		attr.config = g_perfEvents[i].config;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = (nLeader < 0) ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		m_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, nLeader, 0);
+
+		if (m_fds[i] < 0)
+			continue;
+
+		if (nLeader < 0)
+			nLeader = m_fds[i];
+
+		m_nSlot[i] = m_nOpen++;
+	}
+
+	if (nLeader >= 0)
+	{
+		ioctl(nLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(nLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+#else
+	ULONG64 ullCycles = 0;
+
+	if (QueryThreadCycleTime(GetCurrentThread(), &ullCycles))
+		m_nSlot[PERF_COUNTER_CYCLES] = m_nOpen++;
+#endif
+
+	FilterTrace("PerfCounters::Open() %d counters from %s\n", m_nOpen, GetSource());
+}
+
+void PerfCounters::Close()
+{
+#ifdef __linux__
+	// Members before the leader
+	for (int i = PERF_COUNTER_COUNT - 1; i >= 0; i--)
+	{
+		if (m_fds[i] >= 0)
+			close(m_fds[i]);
+
+		m_fds[i] = -1;
+	}
+#endif
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+		m_nSlot[i] = -1;
+
+	m_nOpen = 0;
+}
+
+// Current count of each counter, -1 when it is not available. When the kernel
+// had to multiplex the group with other events the counts are scaled up to the
+// time the group was enabled.
+void PerfCounters::Read(LONGLONG values[PERF_COUNTER_COUNT])
+{
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+		values[i] = -1;
+
+	if (m_nOpen == 0)
+		return;
+
+#ifdef __linux__
+	// nr, time_enabled, time_running, then a value per group member
+	__u64 buffer[3 + PERF_COUNTER_COUNT];
+	int nLeader = -1;
+
+	for (int i = 0; i < PERF_COUNTER_COUNT && nLeader < 0; i++)
+		nLeader = m_fds[i];
+
+	if (read(nLeader, buffer, sizeof(buffer)) < (ssize_t)((3 + m_nOpen) * sizeof(__u64)) || buffer[2] == 0)
+		return;
+
+	double scale = (double)buffer[1] / buffer[2];
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		if (m_nSlot[i] >= 0)
+			values[i] = (LONGLONG)(buffer[3 + m_nSlot[i]] * scale);
+	}
+#else
+	ULONG64 ullCycles = 0;
+
+	if (QueryThreadCycleTime(GetCurrentThread(), &ullCycles))
+		values[PERF_COUNTER_CYCLES] = (LONGLONG)ullCycles;
+#endif
+}
+
+const char* PerfCounters::GetSource() const
+{
+	if (m_nOpen == 0)
+		return "none";
+
+#ifdef __linux__
+	return "perf_event_open";
+#else
+	return "thread_cycle_time";
+#endif
+}
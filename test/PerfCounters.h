@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+
+// Hardware events counted for the calling thread
+enum perf_counter
+{
+	PERF_COUNTER_CYCLES = 0,
+	PERF_COUNTER_INSTRUCTIONS = 1,	// instructions retired
+	PERF_COUNTER_L1D_MISSES = 2,	// L1 data cache read misses
+	PERF_COUNTER_LLC_MISSES = 3,	// last level cache misses
+	PERF_COUNTER_BRANCH_MISSES = 4,	// mispredicted branches
+	PERF_COUNTER_COUNT = 5
+};
+
+// Counts hardware events of the calling thread in user mode. On Linux the
+// counters are a perf_event_open group, read together so they cover the same
+// instructions; a counter the PMU or the kernel does not offer is left out of
+// the group. On Windows the performance counters are not readable from user
+// mode, only the cycles come from QueryThreadCycleTime. Read returns -1 for a
+// counter that is not available.
+class PerfCounters
+{
+	public:
+		PerfCounters(void);
+		~PerfCounters(void);
+
+	public:
+		void Open();
+		void Close();
+		bool IsAvailable(perf_counter counter) const { return m_nSlot[counter] >= 0; }
+		void Read(LONGLONG values[PERF_COUNTER_COUNT]);
+		const char* GetSource() const;
+
+	private:
+		int m_nSlot[PERF_COUNTER_COUNT];	// place of the counter in a group read, -1 when not available
+		int m_nOpen;
+#ifdef __linux__
+		int m_fds[PERF_COUNTER_COUNT];
+#endif
+};
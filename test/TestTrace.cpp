@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+
+// The trace functions of the filter (global.cpp) for the console programs, which
+// link the extraction core without the DirectShow registration. The trace goes
+// to the console.
+
+bool IsLogging()
+{
+	return false;
+}
+
+void FilterTrace(LPCSTR pszFormat, ...)
+{
+	va_list ptr;
+	va_start(ptr, pszFormat);
+	vprintf(pszFormat, ptr);
+	va_end(ptr);
+}
+
+void SetTraceFile(LPCTSTR szFilePath)
+{
+}
+
+void WriteToFile(FILE* pF, LPCSTR pszFormat, ...)
+{
+	va_list ptr;
+	va_start(ptr, pszFormat);
+
+	if (pF != NULL)
+		vfprintf(pF, pszFormat, ptr);
+
+	va_end(ptr);
+}
@@ -0,0 +1,210 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCGenerator.h"
+#include "VANCFrameExtractor.h"
+#include "CaptionRing.h"
+#include <crtdbg.h>
+
+// VANCAllocationTest runs generated frames of every raster and pixel format
+// through the VANCFrameExtractor of the input pin and the caption ring, and
+// counts the heap allocations and the bytes copied per frame. The exit code is
+// 0 when every frame stays within the budgets, 1 when one goes over and 2 on a
+// failure. The project runs it after every build, so going over fails the build.
+//
+// Allocations are counted by the CRT allocation hook, which sees malloc and
+// operator new alike. The hook only exists in the debug CRT, so the project has
+// a Debug and a Counting configuration, the latter compiling the extraction core
+// with full optimization against the debug CRT. Copies are counted by the
+// memcpy and memmove wrappers of CopyCounter.h, which the project force
+// includes in every file.
+#ifndef _DEBUG
+#error VANCAllocationTest counts allocations through the debug CRT (/MDd)
+#endif
+
+// Frames of each raster and pixel format, counted after the warm up frames
+#define ALLOCATION_TEST_FRAMES 1000
+
+// Frames that bring the continuity, the caption ring and the decoders to their steady state
+#define ALLOCATION_TEST_WARM_UP_FRAMES 8
+
+// Heap allocations a frame may make once streaming
+#define ALLOCATION_TEST_ALLOCATION_BUDGET 0
+
+// Bytes a frame may copy besides the picture: each caption record taken from
+// the caption ring by the caption sink
+#define ALLOCATION_TEST_CAPTION_COPY_BUDGET (CDP_MAX_CC_COUNT * 3 * sizeof(VANC_CAPTION_RECORD))
+
+// Error rate per 1000 frames, the error paths must not allocate either
+#define ALLOCATION_TEST_ERROR_RATE 40
+
+// Frame period of the caption times (29.97 fps)
+#define ALLOCATION_TEST_FRAME_PERIOD 333667
+
+// Heap allocations seen by the CRT hook while a frame is counted
+static volatile bool g_bCounting = false;
+static volatile LONG g_nAllocations = 0;
+static volatile LONGLONG g_llAllocatedBytes = 0;
+
+// Bytes passed to memcpy and memmove while a frame is counted
+static volatile LONGLONG g_llCopiedBytes = 0;
+
+void* __cdecl CountedMemcpy(void* pDest, const void* pSource, size_t nBytes)
+{
+	if (g_bCounting)
+		g_llCopiedBytes += nBytes;
+
+	return (memcpy)(pDest, pSource, nBytes);
+}
+
+void* __cdecl CountedMemmove(void* pDest, const void* pSource, size_t nBytes)
+{
+	if (g_bCounting)
+		g_llCopiedBytes += nBytes;
+
+	return (memmove)(pDest, pSource, nBytes);
+}
+
+static int __cdecl CountAllocation(int nAllocType, void* pvData, size_t nSize, int nBlockUse, long lRequest, const unsigned char* szFileName, int nLine)
+{
+	if (g_bCounting && (nAllocType == _HOOK_ALLOC || nAllocType == _HOOK_REALLOC))
+	{
+		g_nAllocations++;
+		g_llAllocatedBytes += nSize;
+	}
+
+	return TRUE;
+}
+
+static const char* g_rasterNames[] =
+{
+	"525i", "1080i", "1080p", "720p", "2160p"
+};
+
+static const DWORD g_formats[] =
+{
+	MAKEFOURCC('v', '2', '1', '0'), MAKEFOURCC('U', 'Y', 'V', 'Y'), MAKEFOURCC('P', '2', '1', '0'), MAKEFOURCC('Y', '2', '1', '0')
+};
+
+// Run the frames of a raster and pixel format, returns the exit code
+static int RunFrames(vanc_generator_raster raster, DWORD fourcc)
+{
+	VANCGenerator generator;
+	HRESULT hr = generator.SetRaster(raster, fourcc);
+
+	if (SUCCEEDED(hr))
+		hr = generator.AddCaption(0, CAPTION_POP_ON, "ALLOCATION TEST|SECOND ROW");
+
+	if (SUCCEEDED(hr))
+		hr = generator.AddCaption(120, CAPTION_ROLL_UP_3, "ROLLING UP THREE ROWS");
+
+	if (SUCCEEDED(hr))
+		hr = generator.AddCaption(300, CAPTION_PAINT_ON, "PAINTED ON");
+
+	const _pixel_format* pFormat = generator.GetPixelFormat();
+	const _frame_layout& layout = generator.GetLayout();
+	long nWidth = generator.GetWidth();
+
+	// Connection time work of the input pin, the frames must not add to it
+	VANCFrameExtractor* pExtractor = new VANCFrameExtractor;
+	CCaptionRing captionRing;
+
+	if (SUCCEEDED(hr))
+		hr = pExtractor->SetFormat(pFormat, nWidth, layout.nHeight, layout.bInterlaced);
+
+	if (FAILED(hr))
+	{
+		printf("VANCAllocationTest: cannot set up %s\n", g_rasterNames[raster]);
+		delete pExtractor;
+		return 2;
+	}
+
+	_vanc_generator_errors errors;
+	errors.nBadChecksum = errors.nParityFlip = errors.nLineMove = ALLOCATION_TEST_ERROR_RATE;
+	errors.nDropCDP = errors.nRepeatCDP = errors.nGarbageANC = ALLOCATION_TEST_ERROR_RATE;
+	errors.dwSeed = fourcc;
+	generator.SetErrors(errors);
+
+	PFN_EXTRACT_LINE pfnExtract = (nWidth <= 720) ? pFormat->pfnExtractMultiplexed : pFormat->pfnExtractLuma;
+	long nScanWidth = min(nWidth, (long)VANC_SCAN_DEFAULT_WIDTH);
+	std::vector<BYTE> frame(generator.GetFrameSize());
+	std::vector<BYTE> picture(FrameLayoutPictureLength(layout));
+	VANC_CAPTION_RECORD captionSink;
+	_vanc_extractor_stats before, after;
+
+	g_nAllocations = 0;
+	g_llAllocatedBytes = 0;
+	g_llCopiedBytes = 0;
+
+	for (long i = 0; i < ALLOCATION_TEST_WARM_UP_FRAMES + ALLOCATION_TEST_FRAMES; i++)
+	{
+		REFERENCE_TIME tStart = i * ALLOCATION_TEST_FRAME_PERIOD;
+
+		// The generator allocates, only the work of the input pin is counted
+		generator.GenerateFrame(&frame[0], NULL, 0);
+
+		if (i == ALLOCATION_TEST_WARM_UP_FRAMES)
+			pExtractor->GetStats(&before);
+
+		g_bCounting = (i >= ALLOCATION_TEST_WARM_UP_FRAMES);
+
+		pExtractor->ScanFrame(&frame[0], pfnExtract, nScanWidth, 0);
+		pExtractor->CopyPicture(&frame[0], &picture[0]);
+
+		long nCaptions = pExtractor->ParseCaptions(tStart, tStart + ALLOCATION_TEST_FRAME_PERIOD, tStart, tStart + ALLOCATION_TEST_FRAME_PERIOD,
+			NTSC_CC1, VANC_PADDING_NULL_SAMPLE, 30);
+
+		for (long n = 0; n < nCaptions; n++)
+		{
+			captionRing.Push(pExtractor->GetCaption(n).record, CAPTION_DROP_OLDEST);
+
+			while (captionRing.GetCount() > 0)
+			{
+				captionRing.CopyTo(&captionSink, 1);
+				captionRing.Pop(1);
+			}
+		}
+
+		g_bCounting = false;
+	}
+
+	pExtractor->GetStats(&after);
+	delete pExtractor;
+
+	double allocations = (double)g_nAllocations / ALLOCATION_TEST_FRAMES;
+	double allocatedBytes = (double)g_llAllocatedBytes / ALLOCATION_TEST_FRAMES;
+	double copiedBytes = (double)g_llCopiedBytes / ALLOCATION_TEST_FRAMES;
+	double reportedBytes = (double)(after.llBytesCopied - before.llBytesCopied) / ALLOCATION_TEST_FRAMES;
+	bool bOverBudget = (allocations > ALLOCATION_TEST_ALLOCATION_BUDGET) ||
+		(copiedBytes > FrameLayoutPictureLength(layout) + ALLOCATION_TEST_CAPTION_COPY_BUDGET);
+
+	printf("VANCAllocationTest: %s %s %.3f allocations (%.1f bytes), %.1f bytes copied per frame (picture %lu, extractor reports %.1f)%s\n",
+		g_rasterNames[raster], pFormat->name, allocations, allocatedBytes, copiedBytes, FrameLayoutPictureLength(layout),
+		reportedBytes, bOverBudget ? " **OVER BUDGET**" : "");
+
+	return bOverBudget ? 1 : 0;
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	int nResult = 0;
+
+	_CRT_ALLOC_HOOK pfnPreviousHook = _CrtSetAllocHook(CountAllocation);
+
+	for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && nResult != 2; raster++)
+	{
+		for (int format = 0; format < (int)(sizeof(g_formats) / sizeof(g_formats[0])) && nResult != 2; format++)
+		{
+			int nFrames = RunFrames((vanc_generator_raster)raster, g_formats[format]);
+			nResult = max(nResult, nFrames);
+		}
+	}
+
+	_CrtSetAllocHook(pfnPreviousHook);
+	return nResult;
+}
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCBenchmark.h"
+#include "VANCGenerator.h"
+
+// VANCBench runs the benchmark suites of the extraction core and writes the
+// generated caption corpus of the regression runs.
+//
+//   VANCBench [-suites <mask>] [-iterations <n>] [-out <results.json>]
+//   VANCBench -generate <frames> [-raster 525i|1080i|1080p|720p|2160p] [-count <n>]
+//             [-script <script>] [-errors <rate per 1000 frames>] [-seed <n>]
+//
+// The suite mask is a vanc_benchmark_suite mask, all suites by default. The
+// exit code is 0 on success and 2 on a failure. The allocation and copy budgets
+// of a frame are checked by VANCAllocationTest.
+
+static const LPCTSTR g_rasterNames[] =
+{
+	L"525i", L"1080i", L"1080p", L"720p", L"2160p"
+};
+
+// Write the frames and their .golden file
+static int Generate(LPCTSTR szPath, vanc_generator_raster raster, long nFrames, LPCTSTR szScript, LONG nErrorRate, DWORD dwSeed)
+{
+	VANCGenerator generator;
+	HRESULT hr = generator.SetRaster(raster);
+
+	if (SUCCEEDED(hr) && szScript != NULL)
+		hr = generator.LoadScript(szScript);
+	else if (SUCCEEDED(hr))
+		hr = generator.AddCaption(0, CAPTION_POP_ON, "VANCSPLITTER TEST CAPTION|SECOND ROW");
+
+	if (FAILED(hr))
+	{
+		_tprintf(L"VANCBench: cannot set up the generator, hr 0x%08x\n", hr);
+		return 2;
+	}
+
+	_vanc_generator_errors errors;
+	errors.nBadChecksum = errors.nParityFlip = errors.nLineMove = nErrorRate;
+	errors.nDropCDP = errors.nRepeatCDP = errors.nGarbageANC = nErrorRate;
+	errors.dwSeed = dwSeed;
+	generator.SetErrors(errors);
+
+	if (FAILED(hr = generator.WriteFrames(szPath, nFrames)))
+	{
+		_tprintf(L"VANCBench: cannot write %s, hr 0x%08x\n", szPath, hr);
+		return 2;
+	}
+
+	_vanc_generator_stats stats;
+	generator.GetStats(&stats);
+
+	_tprintf(L"VANCBench: %ld frames, %ld CDPs, %ld pairs, %ld dropped, %ld repeated, %ld bad checksums, %ld parity flips, %ld line moves, %ld garbage packets\n",
+		stats.nFrames, stats.nCDPs, stats.nPairs, stats.nDropped, stats.nRepeated, stats.nBadChecksums, stats.nParityFlips, stats.nLineMoves, stats.nGarbage);
+	return 0;
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	LPCTSTR szGenerate = NULL;
+	LPCTSTR szScript = NULL;
+	LPCTSTR szResults = L"VANCBench.json";
+	vanc_generator_raster raster = VANC_GEN_1080I;
+	LONG nSuites = VANC_BENCH_KERNELS | VANC_BENCH_PIPELINE | VANC_BENCH_LATENCY | VANC_BENCH_STAGES | VANC_BENCH_STARTUP | VANC_BENCH_MEMORY | VANC_BENCH_DELIVERY;
+	long nIterations = 0;
+	long nFrames = 1000;
+	LONG nErrorRate = 0;
+	DWORD dwSeed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bValue = (i + 1 < argc);
+
+		if (_tcscmp(argv[i], L"-generate") == 0 && bValue)
+			szGenerate = argv[++i];
+		else if (_tcscmp(argv[i], L"-script") == 0 && bValue)
+			szScript = argv[++i];
+		else if (_tcscmp(argv[i], L"-out") == 0 && bValue)
+			szResults = argv[++i];
+		else if (_tcscmp(argv[i], L"-suites") == 0 && bValue)
+			nSuites = _tcstol(argv[++i], NULL, 0);
+		else if (_tcscmp(argv[i], L"-iterations") == 0 && bValue)
+			nIterations = _tcstol(argv[++i], NULL, 0);
+		else if (_tcscmp(argv[i], L"-count") == 0 && bValue)
+			nFrames = _tcstol(argv[++i], NULL, 0);
+		else if (_tcscmp(argv[i], L"-errors") == 0 && bValue)
+			nErrorRate = _tcstol(argv[++i], NULL, 0);
+		else if (_tcscmp(argv[i], L"-seed") == 0 && bValue)
+			dwSeed = _tcstoul(argv[++i], NULL, 0);
+		else if (_tcscmp(argv[i], L"-raster") == 0 && bValue)
+		{
+			int n = 0;
+			i++;
+
+			while (n < (int)(sizeof(g_rasterNames) / sizeof(g_rasterNames[0])) && _tcscmp(argv[i], g_rasterNames[n]) != 0)
+				n++;
+
+			if (n == (int)(sizeof(g_rasterNames) / sizeof(g_rasterNames[0])))
+			{
+				_tprintf(L"VANCBench: unknown raster %s\n", argv[i]);
+				return 2;
+			}
+
+			raster = (vanc_generator_raster)n;
+		}
+		else
+		{
+			_tprintf(L"usage: VANCBench [-suites <mask>] [-iterations <n>] [-out <results.json>]\n");
+			_tprintf(L"       VANCBench -generate <frames> [-raster 525i|1080i|1080p|720p|2160p] [-count <n>]\n");
+			_tprintf(L"                 [-script <script>] [-errors <rate per 1000 frames>] [-seed <n>]\n");
+			return 2;
+		}
+	}
+
+	if (szGenerate != NULL)
+		return Generate(szGenerate, raster, nFrames, szScript, nErrorRate, dwSeed);
+
+	VANCBenchmark benchmark;
+	HRESULT hr = benchmark.Run(nSuites, nIterations);
+
+	if (SUCCEEDED(hr) && FAILED(benchmark.WriteJSON(szResults)))
+	{
+		_tprintf(L"VANCBench: cannot write %s\n", szResults);
+		return 2;
+	}
+
+	_tprintf(L"VANCBench: %ld results, hr 0x%08x\n", benchmark.GetResultCount(), hr);
+
+	return FAILED(hr) ? 2 : 0;
+}
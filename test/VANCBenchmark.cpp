@@ -0,0 +1,1097 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "global.h"
+#include "VANCBenchmark.h"
+#include "VANCSplitterTypes.h"
+#include <time.h>
+#include <algorithm>
+
+static const char* g_benchmarkKernels[VANC_KERNEL_COUNT] =
+{
+	"unpack", "validate", "index", "parse", "get608", "decode608", "frame_scan", "parse_unchecked"
+};
+
+static const char* g_benchmarkStages[VANC_STAGE_COUNT] =
+{
+	"unpack", "scan", "parse", "decode608"
+};
+
+static const char* g_benchmarkRasters[] =
+{
+	"525i", "1080i", "1080p", "720p", "2160p"
+};
+
+// Pixel formats of the pipeline suites
+static const struct
+{
+	DWORD fourcc;
+	const char* pszName;
+} g_benchmarkFormats[] =
+{
+	{ MAKEFOURCC('v', '2', '1', '0'), "v210" },
+	{ MAKEFOURCC('U', 'Y', 'V', 'Y'), "UYVY" },
+	{ MAKEFOURCC('P', '2', '1', '0'), "P210" },
+	{ MAKEFOURCC('Y', '2', '1', '0'), "Y210" }
+};
+
+// Caption script of the generated frames, one caption every 40 frames
+static const struct
+{
+	long nStartFrame;
+	caption_script_style style;
+	const char* pszText;
+} g_benchmarkCaptions[] =
+{
+	{ 0, CAPTION_POP_ON, "BENCHMARK CAPTION|SECOND ROW" },
+	{ 40, CAPTION_ROLL_UP_3, "ROLLING UP THREE ROWS" },
+	{ 80, CAPTION_PAINT_ON, "PAINTED ON" }
+};
+
+VANCBenchmark::VANCBenchmark(void) :
+	m_pszRaster(NULL),
+	m_pFormat(NULL),
+	m_pfnExtract(NULL),
+	m_nWidth(0),
+	m_nScanWidth(0),
+	m_dwRowBytes(0),
+	m_dwWordsPerLine(0),
+	m_nCDPRow(0),
+	m_pParsers(NULL),
+	m_dwSink(0)
+{
+	ZeroMemory(&m_layout, sizeof(m_layout));
+}
+
+VANCBenchmark::~VANCBenchmark(void)
+{
+	if (m_pParsers != NULL)
+		delete [] m_pParsers;
+}
+
+const _vanc_benchmark_result* VANCBenchmark::GetResult(long n) const
+{
+	if (n < 0 || n >= (long)m_results.size())
+		return NULL;
+
+	return &m_results[n];
+}
+
+// Run the selected suites over every generated raster
+HRESULT VANCBenchmark::Run(LONG nSuites, long nIterations)
+{
+	if ((nSuites & (VANC_BENCH_KERNELS | VANC_BENCH_PIPELINE | VANC_BENCH_LATENCY | VANC_BENCH_STAGES | VANC_BENCH_STARTUP | VANC_BENCH_MEMORY | VANC_BENCH_DELIVERY)) == 0)
+		return E_INVALIDARG;
+
+	HRESULT hr = S_OK;
+	m_results.clear();
+
+	if (nSuites & VANC_BENCH_KERNELS)
+	{
+		long nKernelIterations = (nIterations > 0) ? nIterations : VANC_BENCH_DEFAULT_ITERATIONS;
+		m_evict.assign(VANC_BENCH_EVICT_BYTES, 0);
+
+		for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && SUCCEEDED(hr); raster++)
+		{
+			hr = LoadRaster((vanc_generator_raster)raster, MAKEFOURCC('v', '2', '1', '0'), VANC_BENCH_CDP_FRAMES);
+
+			for (int kernel = 0; kernel < VANC_KERNEL_COUNT && SUCCEEDED(hr); kernel++)
+			{
+				RunKernel((vanc_benchmark_kernel)kernel, nKernelIterations, false);
+				RunKernel((vanc_benchmark_kernel)kernel, min(nKernelIterations, (long)VANC_BENCH_COLD_ITERATIONS), true);
+			}
+		}
+
+		m_evict.clear();
+	}
+
+	if (nSuites & (VANC_BENCH_PIPELINE | VANC_BENCH_LATENCY))
+	{
+		long nPacedFrames = (nIterations > 0) ? nIterations : VANC_BENCH_PACED_FRAMES;
+
+		for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && SUCCEEDED(hr); raster++)
+		{
+			for (int format = 0; format < (int)(sizeof(g_benchmarkFormats) / sizeof(g_benchmarkFormats[0])) && SUCCEEDED(hr); format++)
+			{
+				hr = LoadRaster((vanc_generator_raster)raster, g_benchmarkFormats[format].fourcc, VANC_BENCH_FULL_FRAMES);
+
+				for (int nDetect = 1; nDetect >= 0 && SUCCEEDED(hr); nDetect--)
+				{
+					if (nSuites & VANC_BENCH_PIPELINE)
+						RunPipeline(g_benchmarkFormats[format].pszName, nDetect != 0);
+
+					if (nSuites & VANC_BENCH_LATENCY)
+						RunLatency(g_benchmarkFormats[format].pszName, nDetect != 0, nPacedFrames);
+				}
+			}
+		}
+	}
+
+	if (nSuites & VANC_BENCH_STAGES)
+	{
+		for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && SUCCEEDED(hr); raster++)
+		{
+			hr = LoadRaster((vanc_generator_raster)raster, MAKEFOURCC('v', '2', '1', '0'), VANC_BENCH_FULL_FRAMES);
+
+			if (SUCCEEDED(hr))
+				RunStages();
+		}
+	}
+
+	if (nSuites & VANC_BENCH_STARTUP)
+	{
+		for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && SUCCEEDED(hr); raster++)
+		{
+			hr = m_generator.SetRaster((vanc_generator_raster)raster);
+			m_pszRaster = g_benchmarkRasters[raster];
+			m_nWidth = m_generator.GetWidth();
+
+			if (SUCCEEDED(hr))
+				RunStartup();
+		}
+	}
+
+	if (nSuites & VANC_BENCH_MEMORY)
+	{
+		for (int raster = VANC_GEN_525I; raster <= VANC_GEN_2160P && SUCCEEDED(hr); raster++)
+		{
+			hr = LoadRaster((vanc_generator_raster)raster, MAKEFOURCC('v', '2', '1', '0'), VANC_BENCH_FULL_FRAMES);
+
+			if (SUCCEEDED(hr))
+			{
+				RunMemory(false);
+				RunMemory(true);
+			}
+		}
+	}
+
+	if (nSuites & VANC_BENCH_DELIVERY)
+	{
+		RunDelivery("own_threads", false, 1);
+		RunDelivery("shared_threads", true, 1);
+		RunDelivery("own_threads_batched", false, VANC_BENCH_DELIVERY_BATCH);
+		RunDelivery("shared_threads_batched", true, VANC_BENCH_DELIVERY_BATCH);
+	}
+
+	// Release the frames
+	for (int i = 0; i < VANC_BENCH_FULL_FRAMES; i++)
+		std::vector<BYTE>().swap(m_frames[i]);
+
+	std::vector<BYTE>().swap(m_picture);
+
+	return hr;
+}
+
+// Generate nFrames frames of a raster, keep the first VANC_BENCH_FULL_FRAMES
+// whole and the unpacked CDP row of each
+HRESULT VANCBenchmark::LoadRaster(vanc_generator_raster raster, DWORD fourcc, long nFrames)
+{
+	m_generator = VANCGenerator();
+
+	HRESULT hr = m_generator.SetRaster(raster, fourcc);
+
+	for (int i = 0; i < (int)(sizeof(g_benchmarkCaptions) / sizeof(g_benchmarkCaptions[0])) && SUCCEEDED(hr); i++)
+		hr = m_generator.AddCaption(g_benchmarkCaptions[i].nStartFrame, g_benchmarkCaptions[i].style, g_benchmarkCaptions[i].pszText);
+
+	if (FAILED(hr))
+		return hr;
+
+	m_pszRaster = g_benchmarkRasters[raster];
+	m_pFormat = m_generator.GetPixelFormat();
+	m_layout = m_generator.GetLayout();
+	m_nWidth = m_generator.GetWidth();
+	m_nCDPRow = m_generator.GetVANCRow();
+
+	// Rows are unpacked the way the input pin does with its default settings
+	bool bMultiplexed = (m_nWidth <= 720);
+	m_pfnExtract = bMultiplexed ? m_pFormat->pfnExtractMultiplexed : m_pFormat->pfnExtractLuma;
+	m_nScanWidth = min(m_nWidth, (long)VANC_SCAN_DEFAULT_WIDTH);
+	m_dwRowBytes = m_pFormat->pfnStride(m_nScanWidth) * (bMultiplexed ? m_pFormat->planes : 1);
+	m_dwWordsPerLine = PixelFormatWordsPerLine(m_pFormat, m_nWidth);
+	m_vancData.assign((m_dwWordsPerLine * m_layout.nVANCRows) + PIXEL_FORMAT_WORD_SLACK, 0);
+	m_picture.resize(FrameLayoutPictureLength(m_layout));
+
+	if (FAILED(hr = m_extractor.SetFormat(m_pFormat, m_nWidth, m_layout.nHeight, m_layout.bInterlaced)))
+		return hr;
+
+	if (m_pParsers != NULL)
+		delete [] m_pParsers;
+
+	m_pParsers = new VANCParser[nFrames];
+	m_cdpFrames.resize(nFrames);
+
+	std::vector<BYTE> frame(m_generator.GetFrameSize());
+
+	for (long i = 0; i < nFrames; i++)
+	{
+		_cdp_frame& cdp = m_cdpFrames[i];
+
+		m_generator.GenerateFrame(&frame[0], NULL, 0);
+
+		if (i < VANC_BENCH_FULL_FRAMES)
+			m_frames[i] = frame;
+
+		cdp.words.assign(m_dwWordsPerLine + PIXEL_FORMAT_WORD_SLACK, 0);
+		cdp.dwWords = m_pfnExtract(&frame[0], m_layout.dwStride, m_layout.nHeight, m_nCDPRow, m_nScanWidth, &cdp.words[0]);
+
+		m_index.Reset();
+		m_index.IndexLine(&cdp.words[0], cdp.dwWords, (unsigned short)m_nCDPRow, m_pFormat->checksum_mask);
+
+		const _anc_packet_entry* pCDP = m_index.Find(ANC_DID_CDP, ANC_SDID_CDP);
+
+		if (pCDP == NULL)
+			return E_UNEXPECTED;
+
+		cdp.nPacket = pCDP->offset;
+		cdp.nPacketWords = ANC_WORD_UDW + pCDP->dc + 1;
+		if (!m_pParsers[i].Parse(&cdp.words[cdp.nPacket], cdp.nPacketWords))
+			return E_UNEXPECTED;
+	}
+
+	m_608Parser = C608CaptionParser();
+	m_extractor.Reset();
+	m_captionRing.Reset();
+	return S_OK;
+}
+
+// Time nIterations calls of a kernel. Hot runs time the whole loop, cold runs
+// evict the caches before each call and time the calls one by one.
+void VANCBenchmark::RunKernel(vanc_benchmark_kernel kernel, long nIterations, bool bColdCache)
+{
+	LARGE_INTEGER start, end, frequency;
+	LONGLONG llTicks = 0;
+	LONGLONG llBytes = 0;
+
+	QueryPerformanceFrequency(&frequency);
+
+	if (!bColdCache)
+	{
+		// One untimed pass over the inputs loads them into the caches
+		for (long i = 0; i < VANC_BENCH_CDP_FRAMES; i++)
+			RunIteration(kernel, i);
+
+		QueryPerformanceCounter(&start);
+
+		for (long i = 0; i < nIterations; i++)
+			llBytes += RunIteration(kernel, i);
+
+		QueryPerformanceCounter(&end);
+		llTicks = end.QuadPart - start.QuadPart;
+	}
+	else
+	{
+		for (long i = 0; i < nIterations; i++)
+		{
+			EvictCaches();
+
+			QueryPerformanceCounter(&start);
+			llBytes += RunIteration(kernel, i);
+			QueryPerformanceCounter(&end);
+
+			llTicks += end.QuadPart - start.QuadPart;
+		}
+	}
+
+	double seconds = (double)llTicks / frequency.QuadPart;
+
+	_vanc_benchmark_result result;
+	ZeroMemory(&result, sizeof(result));
+	sprintf_s(result.name, sizeof(result.name), "%s/%s/%s", g_benchmarkKernels[kernel], m_pszRaster, bColdCache ? "cold" : "hot");
+	result.nWidth = m_nWidth;
+	result.nIterations = nIterations;
+	result.nsPerFrame = (seconds * 1e9) / nIterations;
+	result.bytesPerSecond = (seconds > 0) ? (llBytes / seconds) : 0;
+	m_results.push_back(result);
+
+	FilterTrace("VANCBenchmark::RunKernel() %s %.1f ns/frame %.1f MB/s\n", result.name, result.nsPerFrame, result.bytesPerSecond / 1e6);
+}
+
+// Run a kernel once on the i-th input, returns the input bytes it consumed
+DWORD VANCBenchmark::RunIteration(vanc_benchmark_kernel kernel, long i)
+{
+	_cdp_frame& cdp = m_cdpFrames[i % VANC_BENCH_CDP_FRAMES];
+	BYTE* pFrame = &m_frames[i % VANC_BENCH_FULL_FRAMES][0];
+
+	switch (kernel)
+	{
+		case VANC_KERNEL_UNPACK:
+			m_dwSink += m_pfnExtract(pFrame, m_layout.dwStride, m_layout.nHeight, m_nCDPRow, m_nScanWidth, &m_vancData[0]);
+			return m_dwRowBytes;
+
+		case VANC_KERNEL_VALIDATE:
+			// Both searches stop at the CDP header
+			if (m_parser.IsValidVANCPacket(&cdp.words[0], cdp.dwWords))
+				m_dwSink += m_parser.GetDTVCCPacketPos(&cdp.words[0], cdp.dwWords);
+			return (cdp.nPacket + ANC_WORD_DC) * sizeof(__int16);
+
+		case VANC_KERNEL_INDEX:
+		{
+			_vanc_index_stats before, after;
+
+			// The scan stops after the packet chain, count the words it searched
+			m_index.GetStats(&before);
+			m_index.Reset();
+			m_dwSink += m_index.IndexLine(&cdp.words[0], cdp.dwWords, (unsigned short)m_nCDPRow, m_pFormat->checksum_mask);
+			m_index.GetStats(&after);
+
+			return (DWORD)(after.nWordsScanned - before.nWordsScanned) * sizeof(__int16);
+		}
+
+		case VANC_KERNEL_PARSE:
+			m_dwSink += m_parser.Parse(&cdp.words[cdp.nPacket], cdp.nPacketWords);
+			return cdp.nPacketWords * sizeof(__int16);
+
+		case VANC_KERNEL_PARSE_UNCHECKED:
+			m_parser.ParseUnchecked(&cdp.words[cdp.nPacket]);
+			return cdp.nPacketWords * sizeof(__int16);
+
+		case VANC_KERNEL_GET608:
+		{
+			BYTE pair[2];
+
+			if (m_pParsers[i % VANC_BENCH_CDP_FRAMES].Get608Packet(pair))
+				m_dwSink += pair[0];
+
+			return cdp.nPacketWords * sizeof(__int16);
+		}
+
+		case VANC_KERNEL_DECODE608:
+		{
+			BYTE pair[2];
+
+			// Pairs in caption order, the decoder keeps state between them
+			if (m_pParsers[i % VANC_BENCH_CDP_FRAMES].Get608Packet(pair))
+				m_608Parser.BufferCB(i / 29.97, pair, 2);
+
+			return 2;
+		}
+
+		case VANC_KERNEL_FRAME_SCAN:
+			m_extractor.ScanFrame(pFrame, m_pfnExtract, m_nScanWidth, 0);
+			m_dwSink += m_extractor.GetFrameData().nCDPCount;
+			return m_dwRowBytes * m_layout.nVANCRows;
+
+		default:
+			return 0;
+	}
+}
+
+// Run frames back to back for VANC_BENCH_SATURATION_MS, one thread
+void VANCBenchmark::RunPipeline(const char* pszFormat, bool bDetect)
+{
+	LARGE_INTEGER start, now, frequency;
+	long nFrames = 0;
+
+	QueryPerformanceFrequency(&frequency);
+
+	LONGLONG llDuration = (frequency.QuadPart * VANC_BENCH_SATURATION_MS) / 1000;
+
+	// The first frame settles the caches and the caption decoder
+	RunPipelineFrame(&m_frames[0][0], bDetect, 0);
+
+	QueryPerformanceCounter(&start);
+
+	do
+	{
+		RunPipelineFrame(&m_frames[nFrames % VANC_BENCH_FULL_FRAMES][0], bDetect, nFrames * VANC_BENCH_PACED_PERIOD);
+		nFrames++;
+		QueryPerformanceCounter(&now);
+	}
+	while (now.QuadPart - start.QuadPart < llDuration);
+
+	double seconds = (double)(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+	_vanc_benchmark_result result;
+	ZeroMemory(&result, sizeof(result));
+	sprintf_s(result.name, sizeof(result.name), "pipeline/%s/%s/%s", m_pszRaster, pszFormat, bDetect ? "detect" : "fixed");
+	result.nWidth = m_nWidth;
+	result.nIterations = nFrames;
+	result.nsPerFrame = (seconds * 1e9) / nFrames;
+	result.framesPerSecond = nFrames / seconds;
+	result.bytesPerSecond = result.framesPerSecond * m_generator.GetFrameSize();
+	m_results.push_back(result);
+
+	FilterTrace("VANCBenchmark::RunPipeline() %s %.1f frames/s %.1f us/frame\n", result.name, result.framesPerSecond, result.nsPerFrame / 1000);
+}
+
+// Run nFrames frames arriving at 59.94 fps and record the time from the arrival
+// of each frame to the end of its processing. A frame that overruns delays the
+// next one, which then counts its wait.
+void VANCBenchmark::RunLatency(const char* pszFormat, bool bDetect, long nFrames)
+{
+	LARGE_INTEGER start, now, frequency;
+	std::vector<double> latency(nFrames);
+	double total = 0;
+
+	QueryPerformanceFrequency(&frequency);
+
+	RunPipelineFrame(&m_frames[0][0], bDetect, 0);
+
+	QueryPerformanceCounter(&start);
+
+	for (long i = 0; i < nFrames; i++)
+	{
+		LONGLONG llArrival = start.QuadPart + ((i * VANC_BENCH_PACED_PERIOD * frequency.QuadPart) / 10000000);
+
+		// Sleep through most of the wait and spin the rest
+		for (QueryPerformanceCounter(&now); now.QuadPart < llArrival; QueryPerformanceCounter(&now))
+		{
+			LONGLONG llWaitMs = ((llArrival - now.QuadPart) * 1000) / frequency.QuadPart;
+
+			if (llWaitMs > 2)
+				Sleep((DWORD)(llWaitMs - 2));
+		}
+
+		RunPipelineFrame(&m_frames[i % VANC_BENCH_FULL_FRAMES][0], bDetect, i * VANC_BENCH_PACED_PERIOD);
+
+		QueryPerformanceCounter(&now);
+		latency[i] = ((now.QuadPart - llArrival) * 1e9) / frequency.QuadPart;
+		total += latency[i];
+	}
+
+	std::sort(latency.begin(), latency.end());
+
+	_vanc_benchmark_result result;
+	ZeroMemory(&result, sizeof(result));
+	sprintf_s(result.name, sizeof(result.name), "latency/%s/%s/%s", m_pszRaster, pszFormat, bDetect ? "detect" : "fixed");
+	result.nWidth = m_nWidth;
+	result.nIterations = nFrames;
+	result.nsPerFrame = total / nFrames;
+	result.latencyP50 = latency[(nFrames * 50) / 100];
+	result.latencyP99 = latency[min(nFrames - 1, (nFrames * 99) / 100)];
+	result.latencyP999 = latency[min(nFrames - 1, (nFrames * 999) / 1000)];
+	m_results.push_back(result);
+
+	FilterTrace("VANCBenchmark::RunLatency() %s p50 %.1f us p99 %.1f us p99.9 %.1f us\n", result.name,
+		result.latencyP50 / 1000, result.latencyP99 / 1000, result.latencyP999 / 1000);
+}
+
+// Count of a stage per frame, -1 when the counter is not available
+static double StageCounter(const PerfCounters& counters, const LONGLONG llCounts[PERF_COUNTER_COUNT], perf_counter counter)
+{
+	if (!counters.IsAvailable(counter))
+		return -1;
+
+	return (double)llCounts[counter] / VANC_BENCH_STAGE_FRAMES;
+}
+
+// Run VANC_BENCH_STAGE_FRAMES frames split into their stages and add up the
+// time and hardware counters of each stage. The counters cover only the
+// benchmark thread, so they are not skewed by other work on the core.
+void VANCBenchmark::RunStages()
+{
+	LARGE_INTEGER frequency;
+	LONGLONG llTicks[VANC_STAGE_COUNT] = { 0 };
+	LONGLONG llCounts[VANC_STAGE_COUNT][PERF_COUNTER_COUNT] = { { 0 } };
+	LONGLONG llCountStart[PERF_COUNTER_COUNT], llCountEnd[PERF_COUNTER_COUNT];
+	BYTE line21Pairs[CDP_MAX_CC_COUNT][2];
+	DWORD dwWords[FRAME_LAYOUT_MAX_VANC_ROWS];
+	PerfCounters counters;
+
+	QueryPerformanceFrequency(&frequency);
+	counters.Open();
+
+	m_608Parser = C608CaptionParser();
+
+	for (long i = 0; i < VANC_BENCH_STAGE_FRAMES; i++)
+	{
+		const BYTE* pFrame = &m_frames[i % VANC_BENCH_FULL_FRAMES][0];
+		LARGE_INTEGER start, end;
+		long nPairs = 0;
+
+		for (int stage = 0; stage < VANC_STAGE_COUNT; stage++)
+		{
+			counters.Read(llCountStart);
+			QueryPerformanceCounter(&start);
+
+			switch (stage)
+			{
+				case VANC_STAGE_UNPACK:
+				{
+					__int16* pLine = &m_vancData[0];
+					long nRows = 0;
+
+					for (long nField = 0; nField < m_layout.nFields; nField++)
+					{
+						for (long n = 0; n < m_layout.vanc[nField].nRows; n++, pLine += m_dwWordsPerLine)
+							dwWords[nRows++] = m_pfnExtract(pFrame, m_layout.dwStride, m_layout.nHeight, FrameLayoutVANCRow(m_layout, nField, n), m_nScanWidth, pLine);
+					}
+
+					break;
+				}
+
+				case VANC_STAGE_SCAN:
+				{
+					__int16* pLine = &m_vancData[0];
+					long nRows = 0;
+
+					m_index.Reset();
+
+					for (long nField = 0; nField < m_layout.nFields; nField++)
+					{
+						for (long n = 0; n < m_layout.vanc[nField].nRows; n++, pLine += m_dwWordsPerLine)
+							m_index.IndexLine(pLine, dwWords[nRows++], (unsigned short)FrameLayoutVANCRow(m_layout, nField, n), m_pFormat->checksum_mask);
+					}
+
+					ResetVANCFrameData(m_frameData);
+					DispatchVANCPackets(m_index, m_frameData);
+					break;
+				}
+
+				case VANC_STAGE_PARSE:
+					for (long n = 0; n < m_frameData.nCDPCount; n++)
+					{
+						m_parser.Parse(m_frameData.pCDP[n]->words, ANC_WORD_UDW + m_frameData.pCDP[n]->dc + 1);
+						nPairs = m_parser.Get608Packets(line21Pairs, CDP_MAX_CC_COUNT, NTSC_CC1);
+					}
+
+					break;
+
+				case VANC_STAGE_DECODE608:
+					for (long n = 0; n < nPairs; n++)
+						m_608Parser.BufferCB((i + ((double)n / nPairs)) / 29.97, line21Pairs[n], 2);
+
+					break;
+			}
+
+			QueryPerformanceCounter(&end);
+			llTicks[stage] += end.QuadPart - start.QuadPart;
+
+			counters.Read(llCountEnd);
+
+			for (int n = 0; n < PERF_COUNTER_COUNT; n++)
+			{
+				if (llCountStart[n] >= 0 && llCountEnd[n] >= 0)
+					llCounts[stage][n] += llCountEnd[n] - llCountStart[n];
+			}
+		}
+	}
+
+	for (int stage = 0; stage < VANC_STAGE_COUNT; stage++)
+	{
+		_vanc_benchmark_result result;
+		ZeroMemory(&result, sizeof(result));
+		sprintf_s(result.name, sizeof(result.name), "stages/%s/%s", m_pszRaster, g_benchmarkStages[stage]);
+		result.nWidth = m_nWidth;
+		result.nIterations = VANC_BENCH_STAGE_FRAMES;
+		result.nsPerFrame = (llTicks[stage] * 1e9) / frequency.QuadPart / VANC_BENCH_STAGE_FRAMES;
+		result.cyclesPerFrame = StageCounter(counters, llCounts[stage], PERF_COUNTER_CYCLES);
+		result.instructionsPerFrame = StageCounter(counters, llCounts[stage], PERF_COUNTER_INSTRUCTIONS);
+		result.l1dMissesPerFrame = StageCounter(counters, llCounts[stage], PERF_COUNTER_L1D_MISSES);
+		result.llcMissesPerFrame = StageCounter(counters, llCounts[stage], PERF_COUNTER_LLC_MISSES);
+		result.branchMissesPerFrame = StageCounter(counters, llCounts[stage], PERF_COUNTER_BRANCH_MISSES);
+		strcpy_s(result.label, sizeof(result.label), counters.GetSource());
+		m_results.push_back(result);
+
+		FilterTrace("VANCBenchmark::RunStages() %s %.1f ns/frame %.0f cycles/frame %.0f instructions/frame\n",
+			result.name, result.nsPerFrame, result.cyclesPerFrame, result.instructionsPerFrame);
+	}
+}
+
+// Time VANC_BENCH_STARTUP_RUNS commits of a video allocator for frames of the
+// raster, each up to its first buffer: a CMemAllocator with the buffer count
+// NotifyAllocator used to commit (92160000 / cbBuffer) and CVANCAllocator with
+// the count upstream asks for, which it commits on the first GetBuffer. The
+// splitter committed the same count upstream as well, the bytes are per allocator.
+void VANCBenchmark::RunStartup()
+{
+	static const char* allocatorNames[] = { "fixed_92mb", "vanc_allocator" };
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceFrequency(&frequency);
+
+	for (int nAllocator = 0; nAllocator < 2; nAllocator++)
+	{
+		LONGLONG llTicks = 0;
+		LONGLONG llCommitted = 0;
+		long nRuns = 0;
+
+		for (long i = 0; i < VANC_BENCH_STARTUP_RUNS; i++)
+		{
+			HRESULT hr = NOERROR;
+			IMemAllocator* pAllocator = NULL;
+			CVANCAllocator* pVANCAllocator = NULL;
+
+			if (nAllocator == 0)
+			{
+				pAllocator = new CMemAllocator(NAME("VANCBench fixed allocator"), NULL, &hr);
+				pAllocator->AddRef();
+			}
+			else
+			{
+				hr = CVANCAllocator::CreateInstance(VANC_ALLOCATOR_DEFAULT_BUDGET, FRAME_NUMA_NODE_ANY, &pVANCAllocator);
+				pAllocator = pVANCAllocator;
+			}
+
+			if (FAILED(hr))
+			{
+				if (pAllocator != NULL)
+					pAllocator->Release();
+
+				break;
+			}
+
+			ALLOCATOR_PROPERTIES props, actual;
+			props.cbAlign = 1;
+			props.cbPrefix = 0;
+			props.cbBuffer = (long)m_generator.GetFrameSize();
+			props.cBuffers = (nAllocator == 0) ? (VANC_BENCH_FIXED_COMMIT_BYTES / props.cbBuffer) : VANC_BENCH_UPSTREAM_BUFFERS;
+
+			IMediaSample* pSample = NULL;
+			LARGE_INTEGER start, end;
+
+			QueryPerformanceCounter(&start);
+
+			hr = pAllocator->SetProperties(&props, &actual);
+
+			if (SUCCEEDED(hr))
+				hr = pAllocator->Commit();
+
+			if (SUCCEEDED(hr))
+				hr = pAllocator->GetBuffer(&pSample, NULL, NULL, 0);
+
+			QueryPerformanceCounter(&end);
+
+			if (SUCCEEDED(hr))
+			{
+				llTicks += end.QuadPart - start.QuadPart;
+				nRuns++;
+
+				if (pVANCAllocator != NULL)
+				{
+					_vanc_allocator_stats stats;
+					pVANCAllocator->GetStats(&stats);
+					llCommitted += stats.nFootprint;
+				}
+				else
+					llCommitted += (LONGLONG)actual.cBuffers * (actual.cbBuffer + actual.cbPrefix);
+			}
+
+			if (pSample != NULL)
+				pSample->Release();
+
+			pAllocator->Decommit();
+			pAllocator->Release();
+		}
+
+		if (nRuns == 0)
+		{
+			FilterTrace("VANCBenchmark::RunStartup() startup/%s/%s failed\n", m_pszRaster, allocatorNames[nAllocator]);
+			continue;
+		}
+
+		_vanc_benchmark_result result;
+		ZeroMemory(&result, sizeof(result));
+		sprintf_s(result.name, sizeof(result.name), "startup/%s/%s", m_pszRaster, allocatorNames[nAllocator]);
+		result.nWidth = m_nWidth;
+		result.nIterations = nRuns;
+		result.nsPerFrame = (llTicks * 1e9) / frequency.QuadPart / nRuns;
+		result.committedBytes = (double)llCommitted / nRuns;
+		m_results.push_back(result);
+
+		FilterTrace("VANCBenchmark::RunStartup() %s %.1f us to the first buffer, %.1f MB committed\n", result.name,
+			result.nsPerFrame / 1000, result.committedBytes / 1e6);
+	}
+}
+
+// Name of the backing of a frame buffer
+static const char* FrameBackingName(const _frame_buffer_info& info)
+{
+	if (info.bLargePages)
+		return "large_pages";
+
+	return info.bHeap ? "heap" : "pages";
+}
+
+// Time VANC_BENCH_MEMORY_FRAMES VANC sweeps (every row, line detection) and
+// picture copies with the frame and picture in buffers from AllocFrameBuffer,
+// as the video allocator backs them, or from _aligned_malloc. The label names
+// the backing the buffers got, frame then picture.
+void VANCBenchmark::RunMemory(bool bFrameMemory)
+{
+	SIZE_T cbFrame = m_frames[0].size();
+	SIZE_T cbPicture = m_picture.size();
+	_frame_buffer_info frameInfo, pictureInfo;
+	BYTE* pFrame = NULL;
+	BYTE* pPicture = NULL;
+
+	if (bFrameMemory)
+	{
+		pFrame = AllocFrameBuffer(cbFrame, VANC_BENCH_MEMORY_ALIGNMENT, FRAME_NUMA_NODE_ANY, &frameInfo);
+		pPicture = AllocFrameBuffer(cbPicture, VANC_BENCH_MEMORY_ALIGNMENT, FRAME_NUMA_NODE_ANY, &pictureInfo);
+	}
+	else
+	{
+		pFrame = (BYTE*)_aligned_malloc(cbFrame, VANC_BENCH_MEMORY_ALIGNMENT);
+		pPicture = (BYTE*)_aligned_malloc(cbPicture, VANC_BENCH_MEMORY_ALIGNMENT);
+	}
+
+	if (pFrame != NULL && pPicture != NULL)
+	{
+		LARGE_INTEGER start, end, frequency;
+		_vanc_extractor_stats before, after;
+
+		QueryPerformanceFrequency(&frequency);
+
+		// Fill both buffers once so the timed frames take no first touch page faults
+		memcpy(pFrame, &m_frames[0][0], cbFrame);
+		memset(pPicture, 0, cbPicture);
+
+		m_extractor.Reset();
+		m_extractor.GetStats(&before);
+
+		QueryPerformanceCounter(&start);
+
+		for (long i = 0; i < VANC_BENCH_MEMORY_FRAMES; i++)
+		{
+			m_extractor.ScanFrame(pFrame, m_pfnExtract, m_nScanWidth, 0);
+			m_dwSink += m_extractor.GetFrameData().nCDPCount;
+			m_dwSink += m_extractor.CopyPicture(pFrame, pPicture);
+		}
+
+		QueryPerformanceCounter(&end);
+
+		m_extractor.GetStats(&after);
+
+		double seconds = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+		LONGLONG llBytes = (after.llVANCBytesRead - before.llVANCBytesRead) + (after.llBytesCopied - before.llBytesCopied);
+
+		_vanc_benchmark_result result;
+		ZeroMemory(&result, sizeof(result));
+		sprintf_s(result.name, sizeof(result.name), "memory/%s/%s", m_pszRaster, bFrameMemory ? "frame_memory" : "aligned_malloc");
+
+		if (bFrameMemory)
+			sprintf_s(result.label, sizeof(result.label), "%s/%s", FrameBackingName(frameInfo), FrameBackingName(pictureInfo));
+		else
+			strcpy_s(result.label, sizeof(result.label), "aligned_malloc");
+
+		result.nWidth = m_nWidth;
+		result.nIterations = VANC_BENCH_MEMORY_FRAMES;
+		result.nsPerFrame = (seconds * 1e9) / VANC_BENCH_MEMORY_FRAMES;
+		result.bytesPerSecond = (seconds > 0) ? (llBytes / seconds) : 0;
+		m_results.push_back(result);
+
+		FilterTrace("VANCBenchmark::RunMemory() %s (%s) %.1f us/frame %.1f MB/s\n", result.name, result.label,
+			result.nsPerFrame / 1000, result.bytesPerSecond / 1e6);
+	}
+	else
+		FilterTrace("VANCBenchmark::RunMemory() %s buffers of %s failed\n", bFrameMemory ? "frame memory" : "aligned", m_pszRaster);
+
+	if (bFrameMemory)
+	{
+		if (pFrame != NULL)
+			FreeFrameBuffer(pFrame, frameInfo);
+
+		if (pPicture != NULL)
+			FreeFrameBuffer(pPicture, pictureInfo);
+	}
+	else
+	{
+		_aligned_free(pFrame);
+		_aligned_free(pPicture);
+	}
+}
+
+//
+// CNullSinkPin
+//
+// Input pin of a delivery run, counts the samples it receives. A pin that may
+// block holds its first sample VANC_BENCH_DELIVERY_PREROLL ms.
+//
+class CNullSinkPin : public CBaseInputPin
+{
+	public:
+		CNullSinkPin(CBaseFilter* pFilter, CCritSec* pLock, HRESULT* phr, bool bCanBlock) :
+			CBaseInputPin(NAME("VANCBench null sink pin"), pFilter, pLock, phr, L"In"),
+			m_bCanBlock(bCanBlock),
+			m_lReceived(0)
+		{
+		}
+
+		HRESULT CheckMediaType(const CMediaType*) { return S_OK; }
+		STDMETHODIMP Receive(IMediaSample*)
+		{
+			if (InterlockedIncrement(&m_lReceived) == 1 && m_bCanBlock)
+				Sleep(VANC_BENCH_DELIVERY_PREROLL);
+
+			return S_OK;
+		}
+
+		STDMETHODIMP ReceiveCanBlock() { return m_bCanBlock ? S_OK : S_FALSE; }
+		LONG GetReceived() { return m_lReceived; }
+
+	private:
+		bool m_bCanBlock;
+		volatile LONG m_lReceived;
+};
+
+//
+// CNullSinkFilter
+//
+class CNullSinkFilter : public CBaseFilter
+{
+	public:
+		CNullSinkFilter(HRESULT* phr, bool bCanBlock) :
+			CBaseFilter(NAME("VANCBench null sink"), NULL, &m_csFilter, GUID_NULL),
+			m_pin(this, &m_csFilter, phr, bCanBlock)
+		{
+		}
+
+		int GetPinCount() { return 1; }
+		CBasePin* GetPin(int n) { return (n == 0) ? &m_pin : NULL; }
+		CNullSinkPin* GetSinkPin() { return &m_pin; }
+
+	private:
+		CCritSec m_csFilter;
+		CNullSinkPin m_pin;
+};
+
+// Send a sample per frame to each of VANC_BENCH_DELIVERY_PINS output queues,
+// pacing the frames 1 ms apart like a capture source so the delivery threads
+// sleep between them. The threads are those the queues ended up with, the
+// wakeups those of every delivery thread.
+void VANCBenchmark::RunDelivery(const char* pszName, bool bShared, LONG nBatch)
+{
+	HRESULT hr = S_OK;
+	CNullSinkFilter* pSinks[VANC_BENCH_DELIVERY_PINS] = { NULL };
+	CVANCOutputQueue* pQueues[VANC_BENCH_DELIVERY_PINS] = { NULL };
+	CVANCDeliveryThread* pShared = bShared ? new CVANCDeliveryThread(&hr) : NULL;
+	CMemAllocator* pAllocator = new CMemAllocator(NAME("VANCBench delivery allocator"), NULL, &hr);
+	LARGE_INTEGER start, end, frequency;
+	LONGLONG llTicks = 0;
+	long nFrames = 0;
+
+	pAllocator->AddRef();
+	QueryPerformanceFrequency(&frequency);
+
+	ALLOCATOR_PROPERTIES props, actual;
+	props.cbAlign = 1;
+	props.cbPrefix = 0;
+	props.cbBuffer = 64;
+	props.cBuffers = VANC_OUTPUT_QUEUE_SIZE;
+
+	if (SUCCEEDED(hr))
+		hr = pAllocator->SetProperties(&props, &actual);
+
+	if (SUCCEEDED(hr))
+		hr = pAllocator->Commit();
+
+	for (int i = 0; i < VANC_BENCH_DELIVERY_PINS && SUCCEEDED(hr); i++)
+	{
+		pSinks[i] = new CNullSinkFilter(&hr, i < VANC_BENCH_DELIVERY_BLOCKING);
+		pSinks[i]->AddRef();
+
+		if (SUCCEEDED(hr))
+			pQueues[i] = new CVANCOutputQueue(pSinks[i]->GetSinkPin(), &hr, pShared, nBatch, VANC_DELIVERY_DEFAULT_TIMEOUT);
+	}
+
+	timeBeginPeriod(1);
+
+	for (; nFrames < VANC_BENCH_DELIVERY_FRAMES && SUCCEEDED(hr); nFrames++)
+	{
+		QueryPerformanceCounter(&start);
+
+		for (int i = 0; i < VANC_BENCH_DELIVERY_PINS && SUCCEEDED(hr); i++)
+		{
+			IMediaSample* pSample = NULL;
+
+			if (SUCCEEDED(hr = pAllocator->GetBuffer(&pSample, NULL, NULL, 0)))
+				hr = pQueues[i]->Receive(pSample);
+		}
+
+		QueryPerformanceCounter(&end);
+		llTicks += end.QuadPart - start.QuadPart;
+
+		Sleep(1);
+	}
+
+	// Let the last partial batches go out
+	Sleep(VANC_DELIVERY_DEFAULT_TIMEOUT * 2);
+	timeEndPeriod(1);
+
+	LONG nThreads = (pShared != NULL) ? pShared->GetThreadCount() : 0;
+	LONG nWakeups = (pShared != NULL) ? pShared->GetWakeups() : 0;
+	LONG nReceived = 0;
+
+	for (int i = 0; i < VANC_BENCH_DELIVERY_PINS; i++)
+	{
+		if (pQueues[i] != NULL)
+		{
+			_output_queue_stats stats;
+			pQueues[i]->GetStats(&stats);
+			nWakeups += stats.nWakeups;
+
+			if (pQueues[i]->HasOwnThread())
+				nThreads++;
+
+			delete pQueues[i];
+		}
+
+		if (pSinks[i] != NULL)
+		{
+			nReceived += pSinks[i]->GetSinkPin()->GetReceived();
+			pSinks[i]->Release();
+		}
+	}
+
+	if (pShared != NULL)
+		delete pShared;
+
+	pAllocator->Decommit();
+	pAllocator->Release();
+
+	if (FAILED(hr) || nFrames == 0)
+	{
+		FilterTrace("VANCBenchmark::RunDelivery() delivery/%s failed 0x%08x\n", pszName, hr);
+		return;
+	}
+
+	_vanc_benchmark_result result;
+	ZeroMemory(&result, sizeof(result));
+	sprintf_s(result.name, sizeof(result.name), "delivery/%s", pszName);
+	result.nIterations = nFrames;
+	result.nsPerFrame = (llTicks * 1e9) / frequency.QuadPart / nFrames;
+	result.threads = nThreads;
+	result.wakeupsPerFrame = (double)nWakeups / nFrames;
+	m_results.push_back(result);
+
+	FilterTrace("VANCBenchmark::RunDelivery() %s %i threads, %.2f wakeups/frame, %i of %i samples received\n", result.name,
+		nThreads, result.wakeupsPerFrame, nReceived, nFrames * VANC_BENCH_DELIVERY_PINS);
+}
+
+// One frame through the VANCFrameExtractor calls of CVANCSplitterInputPin::DeliverSample
+// with its default settings, the picture copied to a null video sink and the
+// captions queued and taken by a null caption sink
+void VANCBenchmark::RunPipelineFrame(const BYTE* pFrame, bool bDetect, REFERENCE_TIME tStart)
+{
+	// Sweep the VANC rows, or read only the CDP row when detection is off
+	m_extractor.ScanFrame(pFrame, m_pfnExtract, m_nScanWidth, 0, bDetect ? -1 : m_nCDPRow);
+
+	// Picture rows of each plane to the video sink, fields woven as the pin does
+	m_extractor.CopyPicture(pFrame, &m_picture[0]);
+
+	// Caption records of every CDP to the caption sink, one record per sample. The
+	// generated rasters all run at 29.97 or 59.94 fps, a time code rate of 30.
+	long nCaptions = m_extractor.ParseCaptions(tStart, tStart + VANC_BENCH_PACED_PERIOD, tStart, tStart + VANC_BENCH_PACED_PERIOD,
+		NTSC_CC1, VANC_PADDING_NULL_SAMPLE, 30);
+
+	for (long i = 0; i < nCaptions; i++)
+	{
+		m_captionRing.Push(m_extractor.GetCaption(i).record, CAPTION_DROP_OLDEST);
+
+		while (m_captionRing.GetCount() > 0)
+		{
+			m_captionRing.CopyTo(&m_captionSink, 1);
+			m_captionRing.Pop(1);
+		}
+	}
+
+	m_dwSink += m_captionSink.pair[0];
+}
+
+// Write over a buffer larger than the caches so the next kernel input comes from memory
+void VANCBenchmark::EvictCaches()
+{
+	for (size_t i = 0; i < m_evict.size(); i += 64)
+		m_evict[i]++;
+
+	m_dwSink += m_evict[0];
+}
+
+// Write the results as Google Benchmark JSON. Frame rates are reported as
+// items_per_second, latency percentiles as p50_ns, p99_ns and p999_ns and the
+// memory an allocator committed as committed_bytes. Memory runs carry the
+// backing of their buffers in label, delivery runs their threads and
+// wakeups_per_frame.
+HRESULT VANCBenchmark::WriteJSON(LPCTSTR szPath) const
+{
+	FILE* pFile = NULL;
+	_tfopen_s(&pFile, szPath, L"w");
+
+	if (pFile == NULL)
+		return E_FAIL;
+
+	time_t now = time(NULL);
+	struct tm local;
+	char szDate[64];
+	localtime_s(&local, &now);
+	strftime(szDate, sizeof(szDate), "%Y-%m-%dT%H:%M:%S", &local);
+
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+
+	fprintf(pFile, "{\n  \"context\": {\n");
+	fprintf(pFile, "    \"date\": \"%s\",\n", szDate);
+	fprintf(pFile, "    \"executable\": \"VANCBench\",\n");
+	fprintf(pFile, "    \"num_cpus\": %lu,\n", systemInfo.dwNumberOfProcessors);
+#ifdef _DEBUG
+	fprintf(pFile, "    \"library_build_type\": \"debug\"\n");
+#else
+	fprintf(pFile, "    \"library_build_type\": \"release\"\n");
+#endif
+	fprintf(pFile, "  },\n  \"benchmarks\": [\n");
+
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const _vanc_benchmark_result& result = m_results[i];
+
+		fprintf(pFile, "    {\n");
+		fprintf(pFile, "      \"name\": \"%s\",\n", result.name);
+		fprintf(pFile, "      \"run_name\": \"%s\",\n", result.name);
+		fprintf(pFile, "      \"run_type\": \"iteration\",\n");
+
+		if (result.label[0] != 0)
+			fprintf(pFile, "      \"label\": \"%s\",\n", result.label);
+
+		fprintf(pFile, "      \"width\": %ld,\n", result.nWidth);
+		fprintf(pFile, "      \"iterations\": %ld,\n", result.nIterations);
+		fprintf(pFile, "      \"real_time\": %.3f,\n", result.nsPerFrame);
+		fprintf(pFile, "      \"cpu_time\": %.3f,\n", result.nsPerFrame);
+
+		if (result.bytesPerSecond > 0)
+			fprintf(pFile, "      \"bytes_per_second\": %.1f,\n", result.bytesPerSecond);
+
+		if (result.framesPerSecond > 0)
+			fprintf(pFile, "      \"items_per_second\": %.3f,\n", result.framesPerSecond);
+
+		if (result.cyclesPerFrame != 0)
+		{
+			fprintf(pFile, "      \"cycles_per_frame\": %.1f,\n", result.cyclesPerFrame);
+			fprintf(pFile, "      \"instructions_per_frame\": %.1f,\n", result.instructionsPerFrame);
+			fprintf(pFile, "      \"l1d_misses_per_frame\": %.1f,\n", result.l1dMissesPerFrame);
+			fprintf(pFile, "      \"llc_misses_per_frame\": %.1f,\n", result.llcMissesPerFrame);
+			fprintf(pFile, "      \"branch_misses_per_frame\": %.1f,\n", result.branchMissesPerFrame);
+		}
+
+		if (result.committedBytes > 0)
+			fprintf(pFile, "      \"committed_bytes\": %.0f,\n", result.committedBytes);
+
+		if (result.threads > 0)
+		{
+			fprintf(pFile, "      \"threads\": %.0f,\n", result.threads);
+			fprintf(pFile, "      \"wakeups_per_frame\": %.3f,\n", result.wakeupsPerFrame);
+		}
+
+		if (result.latencyP50 > 0)
+		{
+			fprintf(pFile, "      \"p50_ns\": %.1f,\n", result.latencyP50);
+			fprintf(pFile, "      \"p99_ns\": %.1f,\n", result.latencyP99);
+			fprintf(pFile, "      \"p999_ns\": %.1f,\n", result.latencyP999);
+		}
+
+		fprintf(pFile, "      \"time_unit\": \"ns\"\n");
+		fprintf(pFile, "    }%s\n", (i + 1 < m_results.size()) ? "," : "");
+	}
+
+	fprintf(pFile, "  ]\n}\n");
+
+	HRESULT hr = ferror(pFile) ? E_FAIL : S_OK;
+	fclose(pFile);
+
+	return hr;
+}
@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+#include <vector>
+#include "VANCGenerator.h"
+#include "VANCDecoders.h"
+#include "608CaptionParser.h"
+#include "VANCFrameExtractor.h"
+#include "CaptionRing.h"
+#include "VANCAllocator.h"
+#include "PerfCounters.h"
+#include "FrameMemory.h"
+#include "VANCOutputQueue.h"
+
+// Benchmark suites of VANCBench (bit mask)
+enum vanc_benchmark_suite
+{
+	VANC_BENCH_KERNELS = 0x01,		// the extraction kernels one at a time
+	VANC_BENCH_PIPELINE = 0x02,		// whole frames as fast as they go (frames/s per core)
+	VANC_BENCH_LATENCY = 0x04,		// whole frames paced at 59.94 fps (latency percentiles)
+	VANC_BENCH_STAGES = 0x10,		// CPU cycles and time of each stage of a frame
+	VANC_BENCH_STARTUP = 0x20,		// commit and first buffer of the video allocator
+	VANC_BENCH_MEMORY = 0x40,		// VANC sweep and picture copy per frame buffer backing
+	VANC_BENCH_DELIVERY = 0x80		// delivery threads and wakeups of the output queues
+};
+
+// Stages of a frame timed by the stage suite
+enum vanc_benchmark_stage
+{
+	VANC_STAGE_UNPACK = 0,			// every VANC row to ANC words
+	VANC_STAGE_SCAN = 1,			// ADF scan of the rows and decoder dispatch
+	VANC_STAGE_PARSE = 2,			// Parse and Get608Packets of each CDP
+	VANC_STAGE_DECODE608 = 3,		// C608CaptionParser::BufferCB of each pair
+	VANC_STAGE_COUNT = 4
+};
+
+// Timed kernels of the extraction core
+enum vanc_benchmark_kernel
+{
+	VANC_KERNEL_UNPACK = 0,			// one VANC row to ANC words
+	VANC_KERNEL_VALIDATE = 1,		// IsValidVANCPacket and GetDTVCCPacketPos over the row
+	VANC_KERNEL_INDEX = 2,			// ADF scan of the row
+	VANC_KERNEL_PARSE = 3,			// VANCParser::Parse of the CDP (Validate and ParseUnchecked)
+	VANC_KERNEL_GET608 = 4,			// VANCParser::Get608Packet
+	VANC_KERNEL_DECODE608 = 5,		// C608CaptionParser::BufferCB
+	VANC_KERNEL_FRAME_SCAN = 6,		// unpack, index and dispatch of every VANC row (line detection)
+	VANC_KERNEL_PARSE_UNCHECKED = 7,	// VANCParser::ParseUnchecked, the parse kernel without Validate
+	VANC_KERNEL_COUNT = 8
+};
+
+// Iterations of a kernel when none are given
+#define VANC_BENCH_DEFAULT_ITERATIONS 10000
+
+// Iterations of a cold cache run, each one follows a cache eviction
+#define VANC_BENCH_COLD_ITERATIONS 64
+
+// Bytes written between cold cache iterations, larger than the last level cache
+#define VANC_BENCH_EVICT_BYTES (64 * 1024 * 1024)
+
+// Generated frames whose CDP rows are cycled through
+#define VANC_BENCH_CDP_FRAMES 120
+
+// Whole frames kept for the row, frame and pipeline runs
+#define VANC_BENCH_FULL_FRAMES 2
+
+// Length of a saturation run of the pipeline suite
+#define VANC_BENCH_SATURATION_MS 2000
+
+// Frames of a paced latency run when no count is given
+#define VANC_BENCH_PACED_FRAMES 300
+
+// Frame period of a paced latency run (59.94 fps)
+#define VANC_BENCH_PACED_PERIOD 166833
+
+// Frames of a stage run
+#define VANC_BENCH_STAGE_FRAMES 1000
+
+// Commits timed per allocator of a startup run
+#define VANC_BENCH_STARTUP_RUNS 10
+
+// Bytes of video buffers NotifyAllocator committed per allocator before CVANCAllocator
+#define VANC_BENCH_FIXED_COMMIT_BYTES 92160000
+
+// Buffers an upstream capture filter typically asks for, the initial commit of CVANCAllocator
+#define VANC_BENCH_UPSTREAM_BUFFERS 4
+
+// Frames of a memory run and the alignment of its buffers
+#define VANC_BENCH_MEMORY_FRAMES 500
+#define VANC_BENCH_MEMORY_ALIGNMENT 64
+
+// Output pins of a delivery run, the first VANC_BENCH_DELIVERY_BLOCKING have
+// peers that may block in Receive and hold their first sample for
+// VANC_BENCH_DELIVERY_PREROLL ms like a renderer cueing, the others never block
+#define VANC_BENCH_DELIVERY_PINS 4
+#define VANC_BENCH_DELIVERY_BLOCKING 2
+#define VANC_BENCH_DELIVERY_PREROLL 50
+
+// Frames of a delivery run, paced 1 ms apart, and the batch of its batched runs
+#define VANC_BENCH_DELIVERY_FRAMES 500
+#define VANC_BENCH_DELIVERY_BATCH 4
+
+struct _vanc_benchmark_result
+{
+	char name[64];					// kernel/raster/cache, pipeline/raster/format/detection
+	char label[32];					// memory runs: backing of the buffers, stage runs: source of the counters
+	long nWidth;
+	long nIterations;
+	double nsPerFrame;
+	double bytesPerSecond;			// input bytes per second
+	double framesPerSecond;			// pipeline runs only
+	double latencyP50;				// ns from frame arrival to completion, latency runs only
+	double latencyP99;
+	double latencyP999;
+	double cyclesPerFrame;			// stage runs only, this and the other counters are -1 when unavailable
+	double instructionsPerFrame;
+	double l1dMissesPerFrame;
+	double llcMissesPerFrame;
+	double branchMissesPerFrame;
+	double committedBytes;			// startup runs only, memory committed by the allocator
+	double threads;					// delivery runs only, delivery threads of the output pins
+	double wakeupsPerFrame;			// delivery runs only, delivery thread wakeups per frame
+};
+
+// Times the extraction kernels on generated v210 frames for every raster of
+// VANCGenerator, with the input in cache (hot) and after evicting the caches
+// (cold). The pipeline suites run whole frames of every raster and pixel format
+// through the VANCFrameExtractor of the input pin with null sinks: the VANC
+// sweep (every VANC row with line detection, the CDP row alone without), the
+// picture crop and the caption parse and delivery. Results are written as Google
+// Benchmark compatible JSON so runs can be compared with the usual tools.
+//
+// The stage suite splits a frame into unpack, scan, parse and 608 decode and
+// reports the time and the hardware counters (PerfCounters) of each: cycles,
+// instructions retired, L1D, LLC and branch misses on Linux, cycles alone from
+// QueryThreadCycleTime on Windows.
+//
+// The startup suite times the Commit and first GetBuffer of the video allocator
+// for a frame of each raster: the CMemAllocator holding 92 MB of buffers that
+// NotifyAllocator committed before, and CVANCAllocator with the upstream count.
+//
+// The memory suite times the VANC sweep and picture copy of v210 frames held in
+// _aligned_malloc buffers and in AllocFrameBuffer buffers, and labels each run
+// with the backing the buffers actually got (large pages need the lock memory
+// privilege, without it AllocFrameBuffer falls back to normal pages).
+//
+// The delivery suite sends a sample per frame to each of four output queues
+// with null sink peers, two of which may block and hold their first sample, with
+// a thread per queue and with the shared delivery threads, and reports the
+// threads and wakeups.
+//
+// nIterations is the iteration count of a kernel and the frame count of a
+// latency run, which takes nIterations / 59.94 seconds per configuration.
+class VANCBenchmark
+{
+	public:
+		VANCBenchmark(void);
+		~VANCBenchmark(void);
+
+	public:
+		HRESULT Run(LONG nSuites, long nIterations);
+		HRESULT WriteJSON(LPCTSTR szPath) const;
+		long GetResultCount() const { return (long)m_results.size(); }
+		const _vanc_benchmark_result* GetResult(long n) const;
+
+	private:
+		struct _cdp_frame
+		{
+			std::vector<__int16> words;	// unpacked CDP row
+			DWORD dwWords;
+			long nPacket;				// word offset of the CDP in the row
+			long nPacketWords;
+		};
+
+		HRESULT LoadRaster(vanc_generator_raster raster, DWORD fourcc, long nFrames);
+		void RunKernel(vanc_benchmark_kernel kernel, long nIterations, bool bColdCache);
+		DWORD RunIteration(vanc_benchmark_kernel kernel, long i);
+		void RunPipeline(const char* pszFormat, bool bDetect);
+		void RunLatency(const char* pszFormat, bool bDetect, long nFrames);
+		void RunStages();
+		void RunStartup();
+		void RunMemory(bool bFrameMemory);
+		void RunDelivery(const char* pszName, bool bShared, LONG nBatch);
+		void RunPipelineFrame(const BYTE* pFrame, bool bDetect, REFERENCE_TIME tStart);
+		void EvictCaches();
+
+	private:
+		VANCGenerator m_generator;
+		const char* m_pszRaster;
+		const _pixel_format* m_pFormat;
+		_frame_layout m_layout;
+		PFN_EXTRACT_LINE m_pfnExtract;
+		long m_nWidth;
+		long m_nScanWidth;
+		DWORD m_dwRowBytes;
+		DWORD m_dwWordsPerLine;
+		long m_nCDPRow;
+		std::vector<BYTE> m_frames[VANC_BENCH_FULL_FRAMES];
+		std::vector<_cdp_frame> m_cdpFrames;
+		std::vector<__int16> m_vancData;
+		std::vector<BYTE> m_picture;		// null video sink
+		VANC_CAPTION_RECORD m_captionSink;	// null caption sink
+		std::vector<BYTE> m_evict;
+		VANCParser* m_pParsers;			// one parsed CDP per entry of m_cdpFrames
+		C608CaptionParser m_608Parser;
+		VANCParser m_parser;
+		VANCIndex m_index;
+		_vanc_frame_data m_frameData;
+		VANCFrameExtractor m_extractor;	// per-frame work of the input pin
+		CCaptionRing m_captionRing;
+		std::vector<_vanc_benchmark_result> m_results;
+		volatile DWORD m_dwSink;		// keeps the kernel results alive
+};
@@ -0,0 +1,420 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCGenerator.h"
+
+// Geometry and frame period of each generated raster
+static const struct
+{
+	long nWidth;
+	long nHeight;
+	bool bInterlaced;
+	REFERENCE_TIME avgTimePerFrame;
+} g_generatorRasters[] =
+{
+	{  720,  525, true,  333667 },
+	{ 1920, 1125, true,  333667 },
+	{ 1920, 1125, false, 333667 },
+	{ 1280,  750, false, 166833 },
+	{ 3840, 2160 + FRAME_LAYOUT_DEFAULT_VANC, false, 333667 }
+};
+
+// Preamble address codes of rows 1-15, white, indent 0
+static const BYTE g_pacCodes[15][2] =
+{
+	{ 0x11, 0x40 }, { 0x11, 0x60 }, { 0x12, 0x40 }, { 0x12, 0x60 }, { 0x15, 0x40 },
+	{ 0x15, 0x60 }, { 0x16, 0x40 }, { 0x16, 0x60 }, { 0x17, 0x40 }, { 0x17, 0x60 },
+	{ 0x10, 0x40 }, { 0x13, 0x40 }, { 0x13, 0x60 }, { 0x14, 0x40 }, { 0x14, 0x60 }
+};
+
+// CC1 control codes
+#define CC_RCL 0x20			// resume caption loading
+#define CC_RU2 0x25			// roll-up captions, 2 rows
+#define CC_RDC 0x29			// resume direct captioning
+#define CC_CR  0x2D			// carriage return
+#define CC_ENM 0x2E			// erase non-displayed memory
+#define CC_EOC 0x2F			// end of caption (flip memories)
+
+#define CAPTION_MAX_ROWS 15
+
+// 7-bit character with the odd parity bit of line 21 data
+static inline BYTE OddParity(BYTE value)
+{
+	BYTE parity = (BYTE)(value & 0x7f);
+	parity ^= parity >> 4;
+	parity ^= parity >> 2;
+	parity ^= parity >> 1;
+
+	return (BYTE)((value & 0x7f) | (((parity & 1) ^ 1) << 7));
+}
+
+VANCGenerator::VANCGenerator(void) :
+	m_pFormat(NULL),
+	m_nWidth(0),
+	m_avgTimePerFrame(333667),
+	m_nTimecodeRate(30),
+	m_nFramesPerLabel(1),
+	m_nVANCLine(-1),
+	m_dwRandom(1),
+	m_nNextPair(0),
+	m_nFrame(0),
+	m_nWords(0)
+{
+	ZeroMemory(&m_layout, sizeof(m_layout));
+	ZeroMemory(&m_errors, sizeof(m_errors));
+	ZeroMemory(&m_stats, sizeof(m_stats));
+	m_lastPair[0] = m_lastPair[1] = 0x80;
+
+	SetRaster(VANC_GEN_1080I);
+}
+
+VANCGenerator::~VANCGenerator(void)
+{
+}
+
+// Select the raster and pixel format of the generated frames
+HRESULT VANCGenerator::SetRaster(vanc_generator_raster raster, DWORD fourcc)
+{
+	if (raster < VANC_GEN_525I || raster > VANC_GEN_2160P)
+		return E_INVALIDARG;
+
+	const _pixel_format* pFormat = FindPixelFormat(FOURCCMap(fourcc));
+
+	if (pFormat == NULL)
+		return E_INVALIDARG;
+
+	m_pFormat = pFormat;
+	m_nWidth = g_generatorRasters[raster].nWidth;
+	m_avgTimePerFrame = g_generatorRasters[raster].avgTimePerFrame;
+	long nFrameRate = (long)((10000000 + (m_avgTimePerFrame / 2)) / m_avgTimePerFrame);
+	m_nTimecodeRate = min(nFrameRate, 30L);
+	m_nFramesPerLabel = nFrameRate / m_nTimecodeRate;
+
+	ComputeFrameLayout(m_pFormat, m_nWidth, g_generatorRasters[raster].nHeight, g_generatorRasters[raster].bInterlaced, &m_layout);
+	m_encoder.SetFrameRate(m_avgTimePerFrame);
+
+	// Black row (Cb Cr 0x200, Y 0x040) of every plane used for the picture and the blanking
+	std::vector<__int16> samples((m_nWidth * 2) + PIXEL_FORMAT_WORD_SLACK);
+
+	for (long i = 0; i < m_nWidth * 2; i++)
+		samples[i] = (i & 1) ? 0x040 : 0x200;
+
+	m_blankRow.assign(m_layout.dwStride * m_layout.nPlanes, 0);
+	m_pFormat->pfnInsertMultiplexed(&m_blankRow[0], m_layout.dwStride, 1, 0, &samples[0], (DWORD)(m_nWidth * 2));
+
+	return S_OK;
+}
+
+// Set the error rates, the random sequence restarts from the seed
+void VANCGenerator::SetErrors(const _vanc_generator_errors& errors)
+{
+	m_errors = errors;
+	m_dwRandom = (errors.dwSeed != 0) ? errors.dwSeed : 1;
+}
+
+// Pair with the parity bits set, sent from nFrame on
+void VANCGenerator::QueuePair(long nFrame, BYTE b1, BYTE b2)
+{
+	_scheduled_pair scheduled;
+	scheduled.nFrame = nFrame;
+	scheduled.pair[0] = OddParity(b1);
+	scheduled.pair[1] = OddParity(b2);
+	m_pairs.push_back(scheduled);
+}
+
+// Control codes are sent twice, the decoder ignores the repeat
+void VANCGenerator::QueueControl(long nFrame, BYTE b1, BYTE b2)
+{
+	QueuePair(nFrame, b1, b2);
+	QueuePair(nFrame, b1, b2);
+}
+
+// Add the CC1 pairs of a caption. Pairs go out one per frame in the order they
+// were added, the first no earlier than nStartFrame.
+HRESULT VANCGenerator::AddCaption(long nStartFrame, caption_script_style style, const char* pszText)
+{
+	CheckPointer(pszText, E_POINTER);
+
+	if (style < CAPTION_POP_ON || style > CAPTION_PAINT_ON)
+		return E_INVALIDARG;
+
+	// Split the text in rows
+	std::vector<std::string> rows(1);
+
+	for (const char* p = pszText; *p != 0 && *p != '\r' && *p != '\n'; p++)
+	{
+		if (*p == '|')
+			rows.push_back(std::string());
+		else
+			rows.back() += *p;
+	}
+
+	if (rows.size() > CAPTION_MAX_ROWS)
+		rows.resize(CAPTION_MAX_ROWS);
+
+	long nRows = (long)rows.size();
+	bool bRollUp = (style >= CAPTION_ROLL_UP_2 && style <= CAPTION_ROLL_UP_4);
+
+	if (style == CAPTION_POP_ON)
+	{
+		QueueControl(nStartFrame, 0x14, CC_RCL);
+		QueueControl(nStartFrame, 0x14, CC_ENM);
+	}
+	else if (bRollUp)
+		QueueControl(nStartFrame, 0x14, (BYTE)(CC_RU2 + (style - CAPTION_ROLL_UP_2)));
+	else
+		QueueControl(nStartFrame, 0x14, CC_RDC);
+
+	for (long i = 0; i < nRows; i++)
+	{
+		// Roll-up rows are written on the base row and scrolled, the others fill the bottom rows
+		if (bRollUp)
+		{
+			QueueControl(nStartFrame, 0x14, CC_CR);
+			QueueControl(nStartFrame, g_pacCodes[CAPTION_MAX_ROWS - 1][0], g_pacCodes[CAPTION_MAX_ROWS - 1][1]);
+		}
+		else
+		{
+			long nRow = CAPTION_MAX_ROWS - nRows + i;
+			QueueControl(nStartFrame, g_pacCodes[nRow][0], g_pacCodes[nRow][1]);
+		}
+
+		const std::string& text = rows[i];
+
+		for (size_t n = 0; n < text.size(); n += 2)
+			QueuePair(nStartFrame, (BYTE)text[n], (n + 1 < text.size()) ? (BYTE)text[n + 1] : 0x00);
+	}
+
+	if (style == CAPTION_POP_ON)
+		QueueControl(nStartFrame, 0x14, CC_EOC);
+
+	return S_OK;
+}
+
+// Read a caption script, see the class description for the format
+HRESULT VANCGenerator::LoadScript(LPCTSTR szPath)
+{
+	FILE* pF = NULL;
+	_tfopen_s(&pF, szPath, L"r");
+
+	if (pF == NULL)
+		return E_FAIL;
+
+	static const struct { const char* name; caption_script_style style; } styles[] =
+	{
+		{ "popon", CAPTION_POP_ON },
+		{ "rollup2", CAPTION_ROLL_UP_2 },
+		{ "rollup3", CAPTION_ROLL_UP_3 },
+		{ "rollup4", CAPTION_ROLL_UP_4 },
+		{ "painton", CAPTION_PAINT_ON }
+	};
+
+	HRESULT hr = S_OK;
+	char line[1024];
+
+	while (fgets(line, sizeof(line), pF) != NULL)
+	{
+		long nFrame = 0;
+		char style[16];
+		int nText = 0;
+
+		if (line[0] == '#' || sscanf_s(line, "%ld %15s %n", &nFrame, style, (unsigned)sizeof(style), &nText) < 2)
+			continue;
+
+		int i = 0;
+
+		while (i < (int)(sizeof(styles) / sizeof(styles[0])) && strcmp(styles[i].name, style) != 0)
+			i++;
+
+		if (i == (int)(sizeof(styles) / sizeof(styles[0])))
+		{
+			hr = S_FALSE;
+			continue;
+		}
+
+		AddCaption(nFrame, styles[i].style, line + nText);
+	}
+
+	fclose(pF);
+	return hr;
+}
+
+DWORD VANCGenerator::Random()
+{
+	m_dwRandom = (m_dwRandom * 1103515245) + 12345;
+	return (m_dwRandom >> 16) & 0x7fff;
+}
+
+// True nRate times in 1000
+bool VANCGenerator::Inject(LONG nRate)
+{
+	return (nRate > 0) && ((LONG)(Random() % 1000) < nRate);
+}
+
+// Build the next frame, pszGolden receives its line of the golden file
+void VANCGenerator::GenerateFrame(BYTE* pFrame, char* pszGolden, size_t cchGolden)
+{
+	for (long nPlane = 0; nPlane < m_layout.nPlanes; nPlane++)
+	{
+		for (long nRow = 0; nRow < m_layout.nHeight; nRow++)
+			memcpy(pFrame + (((nPlane * m_layout.nHeight) + nRow) * m_layout.dwStride), &m_blankRow[nPlane * m_layout.dwStride], m_layout.dwStride);
+	}
+
+	std::string flags;
+	long nRow = GetVANCRow();
+	bool bRepeat = (m_nWords > 0 && Inject(m_errors.nRepeatCDP));
+
+	if (bRepeat)
+	{
+		// The previous CDP again, the scheduled pair waits for the next frame
+		flags += " repeat";
+		m_stats.nRepeated++;
+	}
+	else
+	{
+		BYTE pair[2] = { 0x80, 0x80 };
+
+		if (m_nNextPair < m_pairs.size() && m_pairs[m_nNextPair].nFrame <= m_nFrame)
+		{
+			pair[0] = m_pairs[m_nNextPair].pair[0];
+			pair[1] = m_pairs[m_nNextPair].pair[1];
+			m_nNextPair++;
+			m_stats.nPairs++;
+		}
+
+		// CC1 in field 1, a null pair in field 2
+		BYTE ccData[2][3] = { { 0x04 | NTSC_CC1, pair[0], pair[1] }, { 0x04 | NTSC_CC2, 0x80, 0x80 } };
+
+		long nLabel = m_nFrame / m_nFramesPerLabel;
+		_smpte_timecode timecode = { true };
+		timecode.frames = (unsigned char)(nLabel % m_nTimecodeRate);
+		timecode.seconds = (unsigned char)((nLabel / m_nTimecodeRate) % 60);
+		timecode.minutes = (unsigned char)((nLabel / (m_nTimecodeRate * 60)) % 60);
+		timecode.hours = (unsigned char)((nLabel / (m_nTimecodeRate * 3600)) % 24);
+
+		m_nWords = m_encoder.Encode(ccData, 2, &timecode, m_words);
+		m_lastPair[0] = pair[0];
+		m_lastPair[1] = pair[1];
+	}
+
+	if (!bRepeat && Inject(m_errors.nDropCDP))
+	{
+		flags += " drop";
+		m_stats.nDropped++;
+	}
+	else
+	{
+		__int16 line[(ANC_MAX_PACKET_WORDS * 2) + PIXEL_FORMAT_WORD_SLACK];
+		long nWords = 0;
+
+		// A packet of random words, a decoder has to step over it
+		if (Inject(m_errors.nGarbageANC))
+		{
+			long nDC = (long)(Random() % 32) + 1;
+
+			line[nWords++] = 0x000;
+			line[nWords++] = 0x3ff;
+			line[nWords++] = 0x3ff;
+			line[nWords++] = (__int16)(0x150 + (Random() % 16));	// clear of the DIDs the splitter decodes
+			line[nWords++] = (__int16)(0x100 | (Random() & 0xff));
+			line[nWords++] = (__int16)(0x200 | nDC);
+
+			for (long i = 0; i <= nDC; i++)
+				line[nWords++] = (__int16)(Random() & 0x3ff);
+
+			flags += " garbage";
+			m_stats.nGarbage++;
+		}
+
+		__int16* pCDP = line + nWords;
+		memcpy(pCDP, m_words, m_nWords * sizeof(__int16));
+		nWords += m_nWords;
+
+		if (Inject(m_errors.nBadChecksum))
+		{
+			pCDP[m_nWords - 1] ^= 0x001;
+			flags += " checksum";
+			m_stats.nBadChecksums++;
+		}
+
+		// b8 is covered by the checksum, so the packet also fails its checksum
+		if (Inject(m_errors.nParityFlip))
+		{
+			pCDP[ANC_WORD_UDW + (Random() % (pCDP[ANC_WORD_DC] & 0xff))] ^= 0x100;
+			flags += " parity";
+			m_stats.nParityFlips++;
+		}
+
+		long nMoved = nRow + m_layout.vanc[0].nRowStep;
+
+		if (Inject(m_errors.nLineMove) && nMoved < FrameLayoutVANCRow(m_layout, 0, m_layout.vanc[0].nRows))
+		{
+			nRow = nMoved;
+			flags += " move";
+			m_stats.nLineMoves++;
+		}
+
+		PFN_INSERT_LINE pfnInsert = (m_nWidth <= 720) ? m_pFormat->pfnInsertMultiplexed : m_pFormat->pfnInsertLuma;
+		pfnInsert(pFrame, m_layout.dwStride, m_layout.nHeight, nRow, line, (DWORD)nWords);
+		m_stats.nCDPs++;
+	}
+
+	if (pszGolden != NULL)
+		sprintf_s(pszGolden, cchGolden, "%ld %ld %02x %02x%s\n", m_nFrame, nRow, m_lastPair[0], m_lastPair[1], flags.c_str());
+
+	m_nFrame++;
+	m_stats.nFrames++;
+}
+
+// Write nFrames frames to szPath and the golden file to szPath.golden
+HRESULT VANCGenerator::WriteFrames(LPCTSTR szPath, long nFrames)
+{
+	TCHAR szGolden[MAX_PATH];
+	_tcscpy_s<MAX_PATH>(szGolden, szPath);
+	_tcscat_s<MAX_PATH>(szGolden, L".golden");
+
+	FILE* pFrames = NULL;
+	FILE* pGolden = NULL;
+	_tfopen_s(&pFrames, szPath, L"wb");
+	_tfopen_s(&pGolden, szGolden, L"w");
+
+	BYTE* pFrame = (BYTE*)malloc(GetFrameSize());
+	HRESULT hr = S_OK;
+
+	if (pFrames == NULL || pGolden == NULL)
+		hr = E_FAIL;
+	else if (pFrame == NULL)
+		hr = E_OUTOFMEMORY;
+	else
+	{
+		fprintf(pGolden, "# %s %ld x %ld %s, %s\n", m_pFormat->name, m_nWidth, m_layout.nHeight, m_layout.bInterlaced ? "interlaced" : "progressive", m_layout.standard);
+		fprintf(pGolden, "# frame row cc1 errors\n");
+
+		for (long i = 0; i < nFrames && SUCCEEDED(hr); i++)
+		{
+			char golden[128];
+			GenerateFrame(pFrame, golden, sizeof(golden));
+
+			if (fwrite(pFrame, 1, GetFrameSize(), pFrames) != GetFrameSize())
+				hr = E_FAIL;
+
+			fputs(golden, pGolden);
+		}
+	}
+
+	if (pFrame != NULL)
+		free(pFrame);
+
+	if (pFrames != NULL)
+		fclose(pFrames);
+
+	if (pGolden != NULL)
+		fclose(pGolden);
+
+	return hr;
+}
@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "VANCEncoder.h"
+#include "PixelFormat.h"
+#include "FrameLayout.h"
+
+// Rasters of the generated frames
+enum vanc_generator_raster
+{
+	VANC_GEN_525I = 0,				// 720 x 525 full raster, ANC multiplexed across Cb Y Cr Y
+	VANC_GEN_1080I = 1,				// 1920 x 1125 full raster
+	VANC_GEN_1080P = 2,				// 1920 x 1125 full raster
+	VANC_GEN_720P = 3,				// 1280 x 750 full raster
+	VANC_GEN_2160P = 4				// 3840 x 2160 with the default VANC rows above the picture
+};
+
+// How a caption of the script is put on screen
+enum caption_script_style
+{
+	CAPTION_POP_ON = 0,
+	CAPTION_ROLL_UP_2 = 1,
+	CAPTION_ROLL_UP_3 = 2,
+	CAPTION_ROLL_UP_4 = 3,
+	CAPTION_PAINT_ON = 4
+};
+
+// Errors injected into the generated VANC, each a rate per 1000 frames
+struct _vanc_generator_errors
+{
+	LONG nBadChecksum;				// ANC checksum word corrupted
+	LONG nParityFlip;				// parity bit of a UDW inverted
+	LONG nLineMove;					// CDP written to the next VANC row of the field
+	LONG nDropCDP;					// CDP encoded but not written (sequence gap)
+	LONG nRepeatCDP;				// previous CDP written again
+	LONG nGarbageANC;				// packet of random words ahead of the CDP
+	DWORD dwSeed;					// the same seed produces the same corpus
+};
+
+// What went into the generated frames
+struct _vanc_generator_stats
+{
+	LONG nFrames;
+	LONG nCDPs;						// CDPs written
+	LONG nPairs;					// non null 608 pairs written
+	LONG nDropped;
+	LONG nRepeated;
+	LONG nBadChecksums;
+	LONG nParityFlips;
+	LONG nLineMoves;
+	LONG nGarbage;
+};
+
+// Writes raw frames (v210 unless SetRaster picks another format) carrying a CDP
+// caption stream built from a caption script, for benchmarks and regression runs
+// of the parser. Each frame carries one CC1 pair, one pair per frame as at 29.97.
+// Next to the frame file a .golden text file lists per frame the row, the CC1
+// pair written and the injected errors, which is the expected output of the
+// splitter checked by VANCGoldenTest.
+//
+// Script lines: <start frame> <popon|rollup2|rollup3|rollup4|painton> <text>,
+// a '|' in the text starts a new caption row. Lines starting with '#' are comments.
+class VANCGenerator
+{
+	public:
+		VANCGenerator(void);
+		~VANCGenerator(void);
+
+	public:
+		HRESULT SetRaster(vanc_generator_raster raster, DWORD fourcc = MAKEFOURCC('v', '2', '1', '0'));
+		void SetVANCLine(long nRow) { m_nVANCLine = nRow; }
+		void SetErrors(const _vanc_generator_errors& errors);
+		HRESULT AddCaption(long nStartFrame, caption_script_style style, const char* pszText);
+		HRESULT LoadScript(LPCTSTR szPath);
+		HRESULT WriteFrames(LPCTSTR szPath, long nFrames);
+		void GenerateFrame(BYTE* pFrame, char* pszGolden, size_t cchGolden);
+		DWORD GetFrameSize() const { return m_layout.dwStride * m_layout.nHeight * m_layout.nPlanes; }
+		long GetWidth() const { return m_nWidth; }
+		long GetHeight() const { return m_layout.nHeight; }
+		long GetVANCRow() const { return (m_nVANCLine >= 0) ? m_nVANCLine : FrameLayoutVANCRow(m_layout, 0, 2); }
+		const _frame_layout& GetLayout() const { return m_layout; }
+		const _pixel_format* GetPixelFormat() const { return m_pFormat; }
+		void GetStats(_vanc_generator_stats* pStats) const { *pStats = m_stats; }
+
+	private:
+		struct _scheduled_pair
+		{
+			long nFrame;				// first frame the pair may go out on
+			BYTE pair[2];
+		};
+
+		void QueuePair(long nFrame, BYTE b1, BYTE b2);
+		void QueueControl(long nFrame, BYTE b1, BYTE b2);
+		bool Inject(LONG nRate);
+		DWORD Random();
+
+	private:
+		const _pixel_format* m_pFormat;
+		_frame_layout m_layout;
+		std::vector<BYTE> m_blankRow;
+		long m_nWidth;
+		REFERENCE_TIME m_avgTimePerFrame;
+		long m_nTimecodeRate;
+		long m_nFramesPerLabel;		// frames sharing a time code label (2 above 30 fps)
+		long m_nVANCLine;			// frame row of the CDP (-1 = third VANC row of field 1)
+		_vanc_generator_errors m_errors;
+		DWORD m_dwRandom;
+		VANCEncoder m_encoder;
+		std::vector<_scheduled_pair> m_pairs;
+		size_t m_nNextPair;
+		long m_nFrame;
+		__int16 m_words[ANC_MAX_PACKET_WORDS + PIXEL_FORMAT_WORD_SLACK];
+		long m_nWords;				// words of the last CDP packet, for repeats
+		BYTE m_lastPair[2];
+		_vanc_generator_stats m_stats;
+};
@@ -0,0 +1,290 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCGenerator.h"
+#include "VANCFrameExtractor.h"
+
+// VANCGoldenTest runs generated frames through the VANCFrameExtractor of the
+// input pin and compares what comes out of each frame with its line of the
+// .golden file written by VANCGenerator.
+//
+//   VANCGoldenTest <frames>	frames and <frames>.golden written by VANCBench -generate
+//   VANCGoldenTest			a corpus of every raster in v210 and UYVY generated in memory with errors injected
+//
+// The exit code is 0 when every frame matches, 1 on a mismatch and 2 on a failure.
+
+// Frame period of the caption times (29.97 fps)
+#define GOLDEN_TEST_FRAME_PERIOD 333667
+
+// Frames of each raster of the in memory corpus
+#define GOLDEN_TEST_FRAMES 600
+
+// Error rate per 1000 frames of the in memory corpus
+#define GOLDEN_TEST_ERROR_RATE 40
+
+// Mismatches printed before the rest are only counted
+#define GOLDEN_TEST_MAX_REPORTS 20
+
+// A line of the golden file
+struct _golden_frame
+{
+	long nFrame;
+	long nRow;						// row the CDP was written to
+	BYTE pair[2];					// CC1 pair of the CDP
+	bool bDrop;						// no CDP on the frame
+	bool bRepeat;					// the CDP of the previous frame again
+	bool bChecksum;					// ANC checksum word corrupted
+	bool bParity;					// b8 of a UDW inverted
+};
+
+// Expected output of the frames seen so far
+struct _golden_state
+{
+	VANCFrameExtractor extractor;
+	PFN_EXTRACT_LINE pfnExtract;
+	long nScanWidth;
+	bool bParityChecked;			// the format carries b8, so the checksum sees a parity flip
+	long nCDP;						// CDPs encoded so far, a repeat carries the last one again
+	long nAcceptedCDP;				// last CDP that came out of the extractor
+	long nFrames;
+	long nMismatches;
+};
+
+// Parse a frame line, "<frame> <row> <cc1 byte 1> <cc1 byte 2> [repeat] [drop] [garbage] [checksum] [parity] [move]"
+static bool ParseGoldenLine(const char* pszLine, _golden_frame* pGolden)
+{
+	char* pszEnd = NULL;
+
+	pGolden->nFrame = strtol(pszLine, &pszEnd, 10);
+
+	if (pszEnd == pszLine)
+		return false;
+
+	pGolden->nRow = strtol(pszEnd, &pszEnd, 10);
+	pGolden->pair[0] = (BYTE)strtol(pszEnd, &pszEnd, 16);
+	pGolden->pair[1] = (BYTE)strtol(pszEnd, &pszEnd, 16);
+	pGolden->bDrop = (strstr(pszEnd, " drop") != NULL);
+	pGolden->bRepeat = (strstr(pszEnd, " repeat") != NULL);
+	pGolden->bChecksum = (strstr(pszEnd, " checksum") != NULL);
+	pGolden->bParity = (strstr(pszEnd, " parity") != NULL);
+	return true;
+}
+
+// Set up the extractor the way the input pin does with its default settings
+static HRESULT SetFormat(_golden_state* pState, const _pixel_format* pFormat, long nWidth, long nHeight, bool bInterlaced)
+{
+	HRESULT hr = pState->extractor.SetFormat(pFormat, nWidth, nHeight, bInterlaced);
+
+	pState->pfnExtract = (nWidth <= 720) ? pFormat->pfnExtractMultiplexed : pFormat->pfnExtractLuma;
+	pState->nScanWidth = min(nWidth, (long)VANC_SCAN_DEFAULT_WIDTH);
+	pState->bParityChecked = (pFormat->checksum_mask & 0x100) != 0;
+	pState->nCDP = 0;
+	pState->nAcceptedCDP = 0;
+	pState->extractor.Reset();
+	return hr;
+}
+
+static void ReportMismatch(_golden_state* pState, const _golden_frame& golden, const char* pszWhat)
+{
+	if (pState->nMismatches++ < GOLDEN_TEST_MAX_REPORTS)
+		printf("VANCGoldenTest: frame %ld (row %ld, %02x %02x) %s\n", golden.nFrame, golden.nRow, golden.pair[0], golden.pair[1], pszWhat);
+}
+
+// Run a frame through the extractor and compare the output with its golden line.
+// Every CDP written delivers its CC1 pair, unless it repeats the last CDP
+// delivered or fails its ANC checksum. A parity flip only fails the checksum of
+// the 10-bit formats, an 8-bit format does not carry b8.
+static void CheckFrame(_golden_state* pState, const BYTE* pFrame, const _golden_frame& golden)
+{
+	VANCFrameExtractor& extractor = pState->extractor;
+
+	if (!golden.bRepeat)
+		pState->nCDP++;
+
+	extractor.ScanFrame(pFrame, pState->pfnExtract, pState->nScanWidth, 0);
+
+	const _vanc_frame_data& frame = extractor.GetFrameData();
+	long nCaptions = extractor.ParseCaptions(0, GOLDEN_TEST_FRAME_PERIOD, 0, GOLDEN_TEST_FRAME_PERIOD, NTSC_CC1, VANC_PADDING_NULL_SAMPLE, 30);
+	pState->nFrames++;
+
+	if (golden.bDrop)
+	{
+		if (frame.nCDPCount != 0 || nCaptions != 0)
+			ReportMismatch(pState, golden, "CDP found on a frame without one");
+
+		return;
+	}
+
+	if (golden.bChecksum || (golden.bParity && pState->bParityChecked))
+	{
+		if (frame.nCDPCount != 0 || frame.nCDPChecksumErrors != 1 || nCaptions != 0)
+			ReportMismatch(pState, golden, "CDP with a bad checksum not dropped");
+
+		return;
+	}
+
+	if (frame.nCDPCount != 1 || frame.pCDP[0]->line != golden.nRow)
+	{
+		ReportMismatch(pState, golden, "CDP not found on its row");
+		return;
+	}
+
+	if (pState->nCDP == pState->nAcceptedCDP)
+	{
+		if (nCaptions != 0)
+			ReportMismatch(pState, golden, "repeated CDP delivered");
+
+		return;
+	}
+
+	pState->nAcceptedCDP = pState->nCDP;
+
+	if (nCaptions != 1)
+		ReportMismatch(pState, golden, "CDP did not deliver one pair");
+	else if (memcmp(extractor.GetCaption(0).record.pair, golden.pair, 2) != 0)
+		ReportMismatch(pState, golden, "wrong CC1 pair delivered");
+}
+
+// Compare a frame file with its .golden file
+static int CheckFile(_golden_state* pState, LPCTSTR szPath)
+{
+	TCHAR szGolden[MAX_PATH];
+	_tcscpy_s<MAX_PATH>(szGolden, szPath);
+	_tcscat_s<MAX_PATH>(szGolden, L".golden");
+
+	FILE* pFrames = NULL;
+	FILE* pGolden = NULL;
+	_tfopen_s(&pFrames, szPath, L"rb");
+	_tfopen_s(&pGolden, szGolden, L"r");
+
+	int nResult = 2;
+	char line[256];
+	char szFormat[8] = { 0 };
+	char szScan[16] = { 0 };
+	long nWidth = 0, nHeight = 0;
+	const _pixel_format* pFormat = NULL;
+
+	// "# <format> <width> x <height> <interlaced|progressive>, <standard>"
+	if (pFrames != NULL && pGolden != NULL && fgets(line, sizeof(line), pGolden) != NULL &&
+		sscanf_s(line, "# %4s %ld x %ld %15[a-z]", szFormat, (unsigned)sizeof(szFormat), &nWidth, &nHeight, szScan, (unsigned)sizeof(szScan)) == 4)
+	{
+		pFormat = FindPixelFormat(FOURCCMap(MAKEFOURCC(szFormat[0], szFormat[1], szFormat[2], szFormat[3])));
+	}
+
+	if (pFormat == NULL || FAILED(SetFormat(pState, pFormat, nWidth, nHeight, strcmp(szScan, "interlaced") == 0)))
+		_tprintf(L"VANCGoldenTest: cannot read %s and its golden file\n", szPath);
+	else
+	{
+		std::vector<BYTE> frame(FrameLayoutFrameLength(pState->extractor.GetLayout()));
+		nResult = 0;
+
+		while (fgets(line, sizeof(line), pGolden) != NULL)
+		{
+			_golden_frame golden;
+
+			if (line[0] == '#' || !ParseGoldenLine(line, &golden))
+				continue;
+
+			if (fread(&frame[0], 1, frame.size(), pFrames) != frame.size())
+			{
+				printf("VANCGoldenTest: frame %ld missing from the frame file\n", golden.nFrame);
+				nResult = 2;
+				break;
+			}
+
+			CheckFrame(pState, &frame[0], golden);
+		}
+	}
+
+	if (pFrames != NULL)
+		fclose(pFrames);
+
+	if (pGolden != NULL)
+		fclose(pGolden);
+
+	return nResult;
+}
+
+// Generate GOLDEN_TEST_FRAMES frames of every raster, in a 10-bit and an 8-bit
+// format, and compare each with the golden line the generator writes for it
+static int CheckGenerated(_golden_state* pState)
+{
+	static const char* rasterNames[] = { "525i", "1080i", "1080p", "720p", "2160p" };
+	static const DWORD formats[] = { MAKEFOURCC('v', '2', '1', '0'), MAKEFOURCC('U', 'Y', 'V', 'Y') };
+
+	for (int n = 0; n < (VANC_GEN_2160P + 1) * 2; n++)
+	{
+		int raster = n / 2;
+		VANCGenerator generator;
+		HRESULT hr = generator.SetRaster((vanc_generator_raster)raster, formats[n % 2]);
+
+		if (SUCCEEDED(hr))
+			hr = generator.AddCaption(0, CAPTION_POP_ON, "GOLDEN OUTPUT TEST|SECOND ROW");
+
+		if (SUCCEEDED(hr))
+			hr = generator.AddCaption(120, CAPTION_ROLL_UP_3, "ROLLING UP THREE ROWS");
+
+		if (SUCCEEDED(hr))
+			hr = generator.AddCaption(300, CAPTION_PAINT_ON, "PAINTED ON");
+
+		const _frame_layout& layout = generator.GetLayout();
+
+		if (SUCCEEDED(hr))
+			hr = SetFormat(pState, generator.GetPixelFormat(), generator.GetWidth(), layout.nHeight, layout.bInterlaced);
+
+		if (FAILED(hr))
+		{
+			printf("VANCGoldenTest: cannot set up %s, hr 0x%08x\n", rasterNames[raster], hr);
+			return 2;
+		}
+
+		_vanc_generator_errors errors;
+		errors.nBadChecksum = errors.nParityFlip = errors.nLineMove = GOLDEN_TEST_ERROR_RATE;
+		errors.nDropCDP = errors.nRepeatCDP = errors.nGarbageANC = GOLDEN_TEST_ERROR_RATE;
+		errors.dwSeed = (DWORD)n + 1;
+		generator.SetErrors(errors);
+
+		std::vector<BYTE> frame(generator.GetFrameSize());
+		long nMismatches = pState->nMismatches;
+
+		for (long i = 0; i < GOLDEN_TEST_FRAMES; i++)
+		{
+			char line[128];
+			_golden_frame golden;
+
+			generator.GenerateFrame(&frame[0], line, sizeof(line));
+
+			if (!ParseGoldenLine(line, &golden))
+				return 2;
+
+			CheckFrame(pState, &frame[0], golden);
+		}
+
+		printf("VANCGoldenTest: %s %s %ld frames, %ld mismatches\n", rasterNames[raster], generator.GetPixelFormat()->name,
+			(long)GOLDEN_TEST_FRAMES, pState->nMismatches - nMismatches);
+	}
+
+	return 0;
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	_golden_state* pState = new _golden_state;
+	pState->nFrames = 0;
+	pState->nMismatches = 0;
+
+	int nResult = (argc > 1) ? CheckFile(pState, argv[1]) : CheckGenerated(pState);
+
+	printf("VANCGoldenTest: %ld frames, %ld mismatches\n", pState->nFrames, pState->nMismatches);
+
+	if (nResult == 0 && pState->nMismatches > 0)
+		nResult = 1;
+
+	delete pState;
+	return nResult;
+}
@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////
+// VANCSplitter - A VANC 608 caption parser Direct Show Filter.
+//
+// Copyright (c) 2024 David Levinson
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "VANCParser.h"
+#include "VANCIndex.h"
+#include "VANCDecoders.h"
+
+// VANCParserFuzz is a libFuzzer target for the parsing of untrusted VANC rows.
+// The input is taken as 16-bit words, first as a CDP handed straight to
+// VANCParser, then as a VANC row swept by VANCIndex whose CDPs go through the
+// same Validate and decode as in the input pin. The words are copied to a
+// buffer of their exact size so AddressSanitizer catches any read past them.
+//
+// VANCParserFuzz.vcxproj builds it with AddressSanitizer and libFuzzer
+// (/fsanitize=address /fsanitize=fuzzer), which needs Visual Studio 2019 16.9
+// or later. libFuzzer supplies main, so the target runs from the command line:
+//
+//   VANCParserFuzz.exe -max_len=1024 corpus
+//
+// A corpus can be seeded with rows cut from the frames of VANCBench -generate.
+// With clang the same files build with -fsanitize=fuzzer,address.
+
+// Decode a packet that passed Validate the way the input pin does
+static void DecodeCDP(VANCParser& parser, const __int16* packet)
+{
+	BYTE line21Pairs[CDP_MAX_CC_COUNT][2];
+	_smpte_timecode timecode;
+	_cdp_service_info_packet services[CDP_MAX_SERVICES];
+	long nPairs = 0;
+
+	VANCParser::IsPadding(packet, NTSC_CC1, &nPairs);
+	parser.ParseServiceInfo(packet);
+	parser.ParseUnchecked(packet, true);
+
+	for (int packetType = NTSC_CC1; packetType <= NTSC_DTVCC_START; packetType++)
+		parser.Get608Packets(line21Pairs, CDP_MAX_CC_COUNT, (cc_packet_type)packetType);
+
+	parser.GetTimecode(&timecode);
+	parser.GetServices(services, CDP_MAX_SERVICES);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t nSize)
+{
+	DWORD dwWords = (DWORD)(nSize / sizeof(__int16));
+
+	if (dwWords == 0)
+		return 0;
+
+	std::vector<__int16> words(dwWords);
+	memcpy(&words[0], pData, dwWords * sizeof(__int16));
+
+	VANCParser parser;
+
+	// The input as a CDP, Parse must agree with Validate
+	bool bValid = parser.Validate(&words[0], dwWords, true);
+
+	if (parser.Parse(&words[0], dwWords, true) != bValid)
+		abort();
+
+	if (bValid)
+		DecodeCDP(parser, &words[0]);
+
+	// The input as a VANC row
+	VANCIndex index;
+	_vanc_frame_data frame;
+
+	index.IndexLine(&words[0], dwWords, 9);
+	ResetVANCFrameData(frame);
+	DispatchVANCPackets(index, frame);
+
+	for (long i = 0; i < frame.nCDPCount; i++)
+	{
+		const _anc_packet_entry* pCDP = frame.pCDP[i];
+
+		if (parser.Validate(pCDP->words, ANC_WORD_UDW + pCDP->dc + 1, true))
+			DecodeCDP(parser, pCDP->words);
+	}
+
+	return 0;
+}